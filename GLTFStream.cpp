@@ -0,0 +1,388 @@
+#include "GLTFStream.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+
+// nlohmann::json, shipped with tinygltf
+#include "json.hpp"
+
+namespace GLTFStream {
+    using json = nlohmann::json;
+
+    static constexpr uint32_t GLB_MAGIC = 0x46546C67;      // "glTF"
+    static constexpr uint32_t GLB_CHUNK_JSON = 0x4E4F534A; // "JSON"
+    static constexpr uint32_t GLB_CHUNK_BIN = 0x004E4942;  // "BIN\0"
+
+    static uint32_t readU32(const uint8_t* data) {
+        uint32_t value;
+        memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    static uint32_t componentSize(uint32_t componentType) {
+        switch (componentType) {
+        case 5120: // BYTE
+        case COMPONENT_TYPE_UNSIGNED_BYTE:
+            return 1;
+        case 5122: // SHORT
+        case COMPONENT_TYPE_UNSIGNED_SHORT:
+            return 2;
+        case COMPONENT_TYPE_UNSIGNED_INT:
+        case COMPONENT_TYPE_FLOAT:
+            return 4;
+        default:
+            return 0;
+        }
+    }
+
+    static uint32_t componentCount(const std::string& type) {
+        static const struct {
+            const char* name;
+            uint32_t count;
+        } types[] = { { "SCALAR", 1 }, { "VEC2", 2 }, { "VEC3", 3 }, { "VEC4", 4 }, { "MAT2", 4 }, { "MAT3", 9 }, { "MAT4", 16 } };
+        for (const auto& t : types) {
+            if (type == t.name) {
+                return t.count;
+            }
+        }
+        return 0;
+    }
+
+    static bool decodeBase64(const char* src, size_t length, std::vector<uint8_t>& out) {
+        out.clear();
+        out.reserve(length / 4 * 3);
+        uint32_t bits = 0;
+        int bitCount = 0;
+        for (size_t i = 0; i < length && src[i] != '='; i++) {
+            const char c = src[i];
+            uint32_t value;
+            if (c >= 'A' && c <= 'Z') {
+                value = c - 'A';
+            } else if (c >= 'a' && c <= 'z') {
+                value = c - 'a' + 26;
+            } else if (c >= '0' && c <= '9') {
+                value = c - '0' + 52;
+            } else if (c == '+' || c == '-') {
+                value = 62;
+            } else if (c == '/' || c == '_') {
+                value = 63;
+            } else {
+                return false;
+            }
+            bits = (bits << 6) | value;
+            bitCount += 6;
+            if (bitCount >= 8) {
+                bitCount -= 8;
+                out.push_back((uint8_t)(bits >> bitCount));
+            }
+        }
+        return true;
+    }
+
+    // Relative URIs may percent-encode characters such as spaces.
+    static std::string decodeUri(const std::string& uri) {
+        std::string path;
+        path.reserve(uri.size());
+        for (size_t i = 0; i < uri.size(); i++) {
+            if (uri[i] == '%' && i + 2 < uri.size()) {
+                char hex[3] = { uri[i + 1], uri[i + 2], 0 };
+                char* end = NULL;
+                const long value = strtol(hex, &end, 16);
+                if (end == hex + 2) {
+                    path.push_back((char)value);
+                    i += 2;
+                    continue;
+                }
+            }
+            path.push_back(uri[i]);
+        }
+        return path;
+    }
+
+    template<typename T>
+    static T value(const json& object, const char* key, T fallback) {
+        auto it = object.find(key);
+        return it != object.end() && it->is_number() ? it->get<T>() : fallback;
+    }
+
+    static const json* array(const json& object, const char* key) {
+        auto it = object.find(key);
+        return it != object.end() && it->is_array() ? &*it : nullptr;
+    }
+
+    bool isBinary(const char* path) {
+        FILE* file = fopen(path, "rb");
+        if (!file) {
+            return false;
+        }
+        uint8_t magic[4] = {};
+        const bool read = fread(magic, 1, sizeof(magic), file) == sizeof(magic);
+        fclose(file);
+        return read && readU32(magic) == GLB_MAGIC;
+    }
+
+    // Splits a mapped GLB into its JSON and BIN chunks, both pointing into the mapping.
+    static bool splitGLB(const uint8_t* data, size_t size, const char*& jsonText, size_t& jsonSize, const uint8_t*& bin, size_t& binSize) {
+        if (size < 20 || readU32(data) != GLB_MAGIC || readU32(data + 4) != 2 || readU32(data + 8) > size) {
+            return false;
+        }
+        size = readU32(data + 8);
+        jsonText = NULL;
+        bin = NULL;
+        binSize = 0;
+        for (size_t offset = 12; offset + 8 <= size;) {
+            const uint64_t chunkSize = readU32(data + offset);
+            const uint32_t chunkType = readU32(data + offset + 4);
+            if (chunkSize > size - offset - 8) {
+                return false;
+            }
+            if (chunkType == GLB_CHUNK_JSON && !jsonText) {
+                jsonText = (const char*)data + offset + 8;
+                jsonSize = (size_t)chunkSize;
+            } else if (chunkType == GLB_CHUNK_BIN && !bin) {
+                bin = data + offset + 8;
+                binSize = (size_t)chunkSize;
+            }
+            offset += 8 + (size_t)((chunkSize + 3) & ~3ull);
+        }
+        return jsonText != NULL;
+    }
+
+    static std::string baseDirectory(const char* path) {
+        const std::string directory = path;
+        const size_t slash = directory.find_last_of("/\\");
+        return slash == std::string::npos ? std::string() : directory.substr(0, slash + 1);
+    }
+
+    static bool parseBuffers(const json& root, const std::string& baseDir, const uint8_t* bin, size_t binSize, Model& model) {
+        const json* buffers = array(root, "buffers");
+        if (!buffers) {
+            return true;
+        }
+        for (const json& buffer : *buffers) {
+            Buffer entry = {};
+            entry.size = value<uint64_t>(buffer, "byteLength", 0);
+            entry.mapping = -1;
+            auto uriIt = buffer.find("uri");
+            if (uriIt != buffer.end() && !uriIt->is_string()) {
+                printf("buffer %zu has an invalid uri\n", model.buffers.size());
+                return false;
+            }
+            if (uriIt == buffer.end()) {
+                // The GLB BIN chunk, padded to 4 bytes, so it may be longer than byteLength
+                if (!bin || entry.size > binSize) {
+                    printf("GLB buffer %zu has no BIN chunk of %llu bytes\n", model.buffers.size(), (unsigned long long)entry.size);
+                    return false;
+                }
+                entry.data = bin;
+                entry.mapping = 0;
+            } else if (uriIt->get_ref<const std::string&>().compare(0, 5, "data:") == 0) {
+                const std::string& uri = uriIt->get_ref<const std::string&>();
+                const size_t comma = uri.find(',');
+                model.decoded.emplace_back();
+                if (comma == std::string::npos || uri.rfind(";base64", comma) == std::string::npos ||
+                    !decodeBase64(uri.c_str() + comma + 1, uri.size() - comma - 1, model.decoded.back()) ||
+                    model.decoded.back().size() < entry.size) {
+                    printf("buffer %zu has an invalid data URI\n", model.buffers.size());
+                    return false;
+                }
+                entry.data = model.decoded.back().data();
+            } else {
+                const std::string path = baseDir + decodeUri(uriIt->get_ref<const std::string&>());
+                MeshletCache::MappedFile mapping;
+                if (!MeshletCache::mapFile(path.c_str(), mapping)) {
+                    printf("failed to map buffer %s\n", path.c_str());
+                    return false;
+                }
+                if (mapping.mappingSize < entry.size) {
+                    printf("buffer %s is %zu bytes, expected %llu\n", path.c_str(), mapping.mappingSize, (unsigned long long)entry.size);
+                    MeshletCache::unmapFile(mapping);
+                    return false;
+                }
+                entry.data = (const uint8_t*)mapping.pMapping;
+                entry.mapping = (int32_t)model.mappings.size();
+                model.mappings.push_back(mapping);
+            }
+            model.buffers.push_back(entry);
+        }
+        return true;
+    }
+
+    static void parseTables(const json& root, Model& model) {
+        if (const json* bufferViews = array(root, "bufferViews")) {
+            for (const json& view : *bufferViews) {
+                BufferView entry = {};
+                entry.buffer = value<uint32_t>(view, "buffer", UINT32_MAX);
+                entry.byteOffset = value<uint64_t>(view, "byteOffset", 0);
+                entry.byteLength = value<uint64_t>(view, "byteLength", 0);
+                entry.byteStride = value<uint32_t>(view, "byteStride", 0);
+                model.bufferViews.push_back(entry);
+            }
+        }
+
+        if (const json* accessors = array(root, "accessors")) {
+            for (const json& accessor : *accessors) {
+                Accessor entry = {};
+                entry.bufferView = value<int32_t>(accessor, "bufferView", -1);
+                entry.byteOffset = value<uint64_t>(accessor, "byteOffset", 0);
+                entry.componentType = value<uint32_t>(accessor, "componentType", 0);
+                auto type = accessor.find("type");
+                entry.componentCount = type != accessor.end() && type->is_string() ? componentCount(type->get<std::string>()) : 0;
+                entry.count = value<uint64_t>(accessor, "count", 0);
+                entry.sparse = accessor.contains("sparse");
+                model.accessors.push_back(entry);
+            }
+        }
+
+        const json* meshes = array(root, "meshes");
+        if (!meshes) {
+            return;
+        }
+        for (size_t meshIndex = 0; meshIndex < meshes->size(); meshIndex++) {
+            const json* primitives = (*meshes)[meshIndex].is_object() ? array((*meshes)[meshIndex], "primitives") : nullptr;
+            if (!primitives) {
+                continue;
+            }
+            for (const json& primitive : *primitives) {
+                Primitive entry = {};
+                auto attributes = primitive.find("attributes");
+                entry.position = attributes != primitive.end() ? value<int32_t>(*attributes, "POSITION", -1) : -1;
+                entry.indices = value<int32_t>(primitive, "indices", -1);
+                entry.mode = value<uint32_t>(primitive, "mode", MODE_TRIANGLES);
+                entry.meshIndex = (uint32_t)meshIndex;
+                model.primitives.push_back(entry);
+            }
+        }
+    }
+
+    uint64_t hashSource(const char* path) {
+        uint64_t hash = MeshletCache::hashFile(path);
+        MeshletCache::MappedFile file;
+        if (hash == 0 || !MeshletCache::mapFile(path, file)) {
+            return 0;
+        }
+        const uint8_t* data = (const uint8_t*)file.pMapping;
+        const char* jsonText = (const char*)data;
+        size_t jsonSize = file.mappingSize;
+        const uint8_t* bin = NULL;
+        size_t binSize = 0;
+        // Malformed files keep the hash of their bytes, open() reports them.
+        if (file.mappingSize >= 4 && readU32(data) == GLB_MAGIC && !splitGLB(data, file.mappingSize, jsonText, jsonSize, bin, binSize)) {
+            MeshletCache::unmapFile(file);
+            return hash;
+        }
+        const json root = json::parse(jsonText, jsonText + jsonSize, nullptr, false);
+        MeshletCache::unmapFile(file);
+        const json* buffers = root.is_object() ? array(root, "buffers") : nullptr;
+        if (!buffers) {
+            return hash;
+        }
+        const std::string baseDir = baseDirectory(path);
+        for (const json& buffer : *buffers) {
+            auto uriIt = buffer.find("uri");
+            if (uriIt == buffer.end() || !uriIt->is_string() || uriIt->get_ref<const std::string&>().compare(0, 5, "data:") == 0) {
+                continue;
+            }
+            hash = MeshletCache::hashFile((baseDir + decodeUri(uriIt->get_ref<const std::string&>())).c_str(), hash);
+            if (hash == 0) {
+                return 0;
+            }
+        }
+        return hash;
+    }
+
+    bool open(const char* path, Model& model) {
+        close(model);
+        MeshletCache::MappedFile file;
+        if (!MeshletCache::mapFile(path, file)) {
+            printf("failed to map %s\n", path);
+            return false;
+        }
+        model.mappings.push_back(file);
+
+        const uint8_t* data = (const uint8_t*)file.pMapping;
+        const char* jsonText = (const char*)data;
+        size_t jsonSize = file.mappingSize;
+        const uint8_t* bin = NULL;
+        size_t binSize = 0;
+        if (file.mappingSize >= 4 && readU32(data) == GLB_MAGIC && !splitGLB(data, file.mappingSize, jsonText, jsonSize, bin, binSize)) {
+            printf("malformed GLB: %s\n", path);
+            close(model);
+            return false;
+        }
+
+        // The JSON is parsed straight from the mapping and dropped once the tables are built.
+        json root = json::parse(jsonText, jsonText + jsonSize, nullptr, false);
+        if (root.is_discarded() || !root.is_object()) {
+            printf("failed to parse glTF JSON: %s\n", path);
+            close(model);
+            return false;
+        }
+
+        if (!parseBuffers(root, baseDirectory(path), bin, binSize, model)) {
+            close(model);
+            return false;
+        }
+        parseTables(root, model);
+
+        // For a .gltf the mapping only held the JSON, a GLB keeps it for the BIN chunk.
+        if (!bin) {
+            MeshletCache::releaseMappedRange(model.mappings[0], data, file.mappingSize);
+        }
+        return true;
+    }
+
+    void close(Model& model) {
+        for (MeshletCache::MappedFile& mapping : model.mappings) {
+            MeshletCache::unmapFile(mapping);
+        }
+        model = {};
+    }
+
+    static bool accessorRange(const Model& model, int32_t accessorIndex, const uint8_t*& data, size_t& stride, size_t& size) {
+        if (accessorIndex < 0 || (size_t)accessorIndex >= model.accessors.size()) {
+            return false;
+        }
+        const Accessor& accessor = model.accessors[accessorIndex];
+        if (accessor.sparse || accessor.bufferView < 0 || (size_t)accessor.bufferView >= model.bufferViews.size()) {
+            return false;
+        }
+        const BufferView& view = model.bufferViews[accessor.bufferView];
+        if (view.buffer >= model.buffers.size()) {
+            return false;
+        }
+        const Buffer& buffer = model.buffers[view.buffer];
+        const uint64_t elementSize = (uint64_t)componentSize(accessor.componentType) * accessor.componentCount;
+        stride = view.byteStride ? view.byteStride : (size_t)elementSize;
+        if (elementSize == 0 || view.byteOffset > buffer.size || view.byteLength > buffer.size - view.byteOffset) {
+            return false;
+        }
+        const uint64_t byteSize = accessor.count ? (accessor.count - 1) * stride + elementSize : 0;
+        if (accessor.byteOffset > view.byteLength || byteSize > view.byteLength - accessor.byteOffset) {
+            return false;
+        }
+        data = buffer.data + view.byteOffset + accessor.byteOffset;
+        size = (size_t)byteSize;
+        return true;
+    }
+
+    bool resolveAccessor(const Model& model, int32_t accessor, const uint8_t*& data, size_t& stride) {
+        size_t size = 0;
+        return accessorRange(model, accessor, data, stride, size);
+    }
+
+    void releaseAccessor(const Model& model, int32_t accessor) {
+        const uint8_t* data = NULL;
+        size_t stride = 0;
+        size_t size = 0;
+        if (!accessorRange(model, accessor, data, stride, size)) {
+            return;
+        }
+        const int32_t mapping = model.buffers[model.bufferViews[model.accessors[accessor].bufferView].buffer].mapping;
+        if (mapping >= 0) {
+            MeshletCache::releaseMappedRange(model.mappings[mapping], data, size);
+        }
+    }
+} // namespace GLTFStream
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "MeshletCache.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// glTF 2.0 reader for the meshlet bake that never copies the model's binary data. .gltf files
+// with external .bin buffers and .glb files are both accepted: the JSON is parsed into the small
+// tables below, and the buffers (the GLB BIN chunk or the .bin files) stay memory mapped, so a
+// primitive's data is only read from disk when the builder touches it. data: URIs, which are
+// rare in large scenes, are decoded into memory.
+//
+// Only what the bake reads is kept: buffers, buffer views, accessors and mesh primitives.
+namespace GLTFStream {
+    static constexpr uint32_t COMPONENT_TYPE_UNSIGNED_BYTE = 5121;
+    static constexpr uint32_t COMPONENT_TYPE_UNSIGNED_SHORT = 5123;
+    static constexpr uint32_t COMPONENT_TYPE_UNSIGNED_INT = 5125;
+    static constexpr uint32_t COMPONENT_TYPE_FLOAT = 5126;
+    static constexpr uint32_t MODE_TRIANGLES = 4;
+
+    struct Buffer {
+        const uint8_t* data;
+        uint64_t size;   // byteLength
+        int32_t mapping; // index in Model::mappings, -1 for decoded data: URIs
+    };
+
+    struct BufferView {
+        uint32_t buffer;
+        uint64_t byteOffset;
+        uint64_t byteLength;
+        uint32_t byteStride; // 0 = tightly packed
+    };
+
+    struct Accessor {
+        int32_t bufferView; // -1 = all zeros, not supported by the bake
+        uint64_t byteOffset;
+        uint32_t componentType;
+        uint32_t componentCount; // 1 for SCALAR, 3 for VEC3, ...
+        uint64_t count;
+        bool sparse;
+    };
+
+    struct Primitive {
+        int32_t position; // POSITION accessor, -1 if missing
+        int32_t indices;  // -1 for non-indexed primitives
+        uint32_t mode;
+        uint32_t meshIndex;
+    };
+
+    struct Model {
+        std::vector<MeshletCache::MappedFile> mappings; // the .glb or .gltf first, then external buffers
+        std::vector<std::vector<uint8_t>> decoded;      // data: URI buffers
+        std::vector<Buffer> buffers;
+        std::vector<BufferView> bufferViews;
+        std::vector<Accessor> accessors;
+        std::vector<Primitive> primitives; // in mesh/primitive order
+    };
+
+    // True if path starts with the GLB magic. tinygltf's ASCII loader can't read those.
+    bool isBinary(const char* path);
+
+    // Key of the scene for MeshletCache: the file and, in buffer order, every external buffer file
+    // its JSON references, hashed with MeshletCache::hashFile. data: URIs are part of the JSON.
+    // 0 if any of the files can't be read.
+    uint64_t hashSource(const char* path);
+
+    // Parses the JSON and maps every buffer. Fails, with nothing left open, on malformed files,
+    // missing buffers or buffers shorter than their byteLength.
+    bool open(const char* path, Model& model);
+    void close(Model& model);
+
+    // First element of an accessor and the distance between elements, after checking that all
+    // count elements lie inside the buffer view and the view inside its buffer. False for sparse
+    // accessors and accessors without a buffer view.
+    bool resolveAccessor(const Model& model, int32_t accessor, const uint8_t*& data, size_t& stride);
+
+    // Drops the pages behind an accessor from the working set once it has been consumed (see
+    // MeshletCache::releaseMappedRange). Decoded buffers are left alone.
+    void releaseAccessor(const Model& model, int32_t accessor);
+} // namespace GLTFStream
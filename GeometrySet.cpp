@@ -0,0 +1,703 @@
+#include "GeometrySet.h"
+
+#include "Common_3/Graphics/Interfaces/IGraphics.h"
+#include "Common_3/Resources/ResourceLoader/Interfaces/IResourceLoader.h"
+#include "Common_3/Utilities/Interfaces/IFileSystem.h"
+#include "Common_3/Utilities/Interfaces/ILog.h"
+#include "Common_3/Utilities/Interfaces/ITime.h"
+#include "Common_3/Utilities/ThirdParty/OpenSource/Nothings/stb_ds.h"
+
+#include "Common_3/Utilities/Interfaces/IMemory.h"
+
+static void addGeometryPoolBuffer(const GeometryPool* pPool, uint32_t capacity, Buffer** ppBuffer) {
+    // Raw views address the buffer in 32 bit words, compact formats may end mid-word.
+    const uint64_t bufferSize = round_up_64((uint64_t)capacity * pPool->mElementSize, sizeof(uint32_t));
+    BufferLoadDesc loadDesc = {};
+    loadDesc.ppBuffer = ppBuffer;
+    loadDesc.mDesc.mDescriptors = (DescriptorType)pPool->mDescriptors;
+    loadDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_ONLY;
+    loadDesc.mDesc.mStartState = RESOURCE_STATE_COMMON;
+    loadDesc.mDesc.mStructStride = sizeof(uint32_t);
+    loadDesc.mDesc.mElementCount = bufferSize / sizeof(uint32_t);
+    loadDesc.mDesc.mSize = bufferSize;
+    loadDesc.mDesc.pName = pPool->pName;
+    SyncToken token = {};
+    addResource(&loadDesc, &token);
+    waitForToken(&token);
+}
+
+void addGeometryPool(Renderer* pRenderer, const GeometryPoolDesc* pDesc, GeometryPool** ppPool) {
+    ASSERT(pRenderer && pDesc && ppPool);
+    ASSERT(pDesc->mElementSize > 0);
+
+    GeometryPool* pPool = (GeometryPool*)tf_calloc(1, sizeof(GeometryPool));
+    pPool->pRenderer = pRenderer;
+    pPool->pQueue = pDesc->pQueue;
+    pPool->pName = pDesc->pName;
+    pPool->mDescriptors = pDesc->mDescriptors;
+    pPool->mElementSize = pDesc->mElementSize;
+    pPool->mCapacity = pDesc->mInitialCapacity > 0 ? pDesc->mInitialCapacity : 1;
+    pPool->mMaxCapacity = pDesc->mMaxCapacity;
+    ASSERT(!pPool->mMaxCapacity || pPool->mCapacity <= pPool->mMaxCapacity);
+
+    // The allocator's node storage follows it in the same block
+    const uint32_t maxAllocations = pDesc->mMaxAllocations > 0 ? pDesc->mMaxAllocations : 128 * 1024;
+    const size_t allocatorSize = sizeof(OffsetAllocator::Allocator);
+    void* pAllocatorMemory = tf_malloc(allocatorSize + OffsetAllocator::Allocator::memoryRequirement(maxAllocations));
+    pPool->pAllocator = (OffsetAllocator::Allocator*)pAllocatorMemory;
+    tf_placement_new<OffsetAllocator::Allocator>(
+        pPool->pAllocator, pPool->mCapacity, maxAllocations, (uint8_t*)pAllocatorMemory + allocatorSize, pDesc->mAllocationPolicy);
+    addGeometryPoolBuffer(pPool, pPool->mCapacity, &pPool->pBuffer);
+
+    pPool->mCompactBudget = pDesc->mCompactBudget;
+    if (pPool->mCompactBudget > 0) {
+        BufferLoadDesc loadDesc = {};
+        loadDesc.ppBuffer = &pPool->pCompactScratch;
+        loadDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_ONLY;
+        loadDesc.mDesc.mStartState = RESOURCE_STATE_COMMON;
+        loadDesc.mDesc.mSize = (uint64_t)pPool->mCompactBudget * pPool->mElementSize;
+        loadDesc.mDesc.pName = "Geometry Pool Compaction Scratch";
+        addResource(&loadDesc, NULL);
+    }
+
+    if (pDesc->pTracePath) {
+        pPool->pTrace = (OffsetAllocator::TraceRecorder*)tf_malloc(sizeof(OffsetAllocator::TraceRecorder));
+        tf_placement_new<OffsetAllocator::TraceRecorder>(pPool->pTrace);
+        if (!pPool->pTrace->open(pDesc->pTracePath, pPool->mCapacity, maxAllocations, pDesc->mAllocationPolicy)) {
+            LOGF(LogLevel::eWARNING, "Failed to open allocation trace %s for %s", pDesc->pTracePath, pPool->pName);
+        }
+    }
+
+    *ppPool = pPool;
+}
+
+void removeGeometryPool(GeometryPool* pPool) {
+    if (!pPool) {
+        return;
+    }
+    removeResource(pPool->pBuffer);
+    if (pPool->pCompactScratch) {
+        removeResource(pPool->pCompactScratch);
+    }
+    if (pPool->pTrace) {
+        pPool->pTrace->~TraceRecorder(); // completes the file
+        tf_free(pPool->pTrace);
+    }
+    pPool->pAllocator->~Allocator();
+    tf_free(pPool->pAllocator); // node storage included
+    tf_free(pPool);
+}
+
+// Replaces the pool buffer with one of at least minCapacity elements and copies the old
+// contents over on the GPU. Blocks until the copy has finished, so growth belongs in load
+// paths, not in the middle of a frame.
+static bool growGeometryPool(GeometryPool* pPool, uint64_t minCapacity) {
+    const uint64_t maxCapacity = pPool->mMaxCapacity > 0 ? pPool->mMaxCapacity : OffsetAllocator::Allocator::MAX_SIZE;
+    if (minCapacity > maxCapacity) {
+        return false;
+    }
+    // Doubling keeps the number of copies logarithmic in the final size.
+    uint64_t newCapacity = (uint64_t)pPool->mCapacity * 2 > minCapacity ? (uint64_t)pPool->mCapacity * 2 : minCapacity;
+    newCapacity = newCapacity < maxCapacity ? newCapacity : maxCapacity;
+    if (!pPool->pAllocator->grow((uint32_t)newCapacity)) {
+        return false;
+    }
+    if (pPool->pTrace) {
+        pPool->pTrace->grow((uint32_t)newCapacity);
+    }
+
+    Buffer* pNewBuffer = NULL;
+    addGeometryPoolBuffer(pPool, (uint32_t)newCapacity, &pNewBuffer);
+
+    // Staging updates still in flight target the old buffer, let them land before copying.
+    waitForAllResourceLoads();
+
+    Renderer* pRenderer = pPool->pRenderer;
+    CmdPool* pCmdPool = NULL;
+    Cmd* pCmd = NULL;
+    Fence* pFence = NULL;
+    CmdPoolDesc cmdPoolDesc = {};
+    cmdPoolDesc.pQueue = pPool->pQueue;
+    cmdPoolDesc.mTransient = true;
+    addCmdPool(pRenderer, &cmdPoolDesc, &pCmdPool);
+    CmdDesc cmdDesc = {};
+    cmdDesc.pPool = pCmdPool;
+    addCmd(pRenderer, &cmdDesc, &pCmd);
+    addFence(pRenderer, &pFence);
+
+    beginCmd(pCmd);
+    BufferBarrier barriers[] = { { pPool->pBuffer, RESOURCE_STATE_COMMON, RESOURCE_STATE_COPY_SOURCE },
+                                 { pNewBuffer, RESOURCE_STATE_COMMON, RESOURCE_STATE_COPY_DEST } };
+    cmdResourceBarrier(pCmd, TF_ARRAY_COUNT(barriers), barriers, 0, NULL, 0, NULL);
+    cmdUpdateBuffer(pCmd, pNewBuffer, 0, pPool->pBuffer, 0, pPool->pBuffer->mSize);
+    barriers[0] = { pPool->pBuffer, RESOURCE_STATE_COPY_SOURCE, RESOURCE_STATE_COMMON };
+    barriers[1] = { pNewBuffer, RESOURCE_STATE_COPY_DEST, RESOURCE_STATE_COMMON };
+    cmdResourceBarrier(pCmd, TF_ARRAY_COUNT(barriers), barriers, 0, NULL, 0, NULL);
+    endCmd(pCmd);
+
+    QueueSubmitDesc submitDesc = {};
+    submitDesc.mCmdCount = 1;
+    submitDesc.ppCmds = &pCmd;
+    submitDesc.pSignalFence = pFence;
+    queueSubmit(pPool->pQueue, &submitDesc);
+    waitForFences(pRenderer, 1, &pFence);
+
+    removeFence(pRenderer, pFence);
+    removeCmd(pRenderer, pCmd);
+    removeCmdPool(pRenderer, pCmdPool);
+
+    removeResource(pPool->pBuffer);
+    pPool->pBuffer = pNewBuffer;
+    pPool->mCapacity = (uint32_t)newCapacity;
+    pPool->mGrowCount++;
+    LOGF(LogLevel::eINFO, "Grew %s to %u elements", pPool->pName, pPool->mCapacity);
+    return true;
+}
+
+// Every allocator call is traced, failed attempts before a grow included, so a replay
+// sees the same sequence of calls. The attempt after a grow is traced as a retry of the failed
+// one: it reuses its ids, and replays that satisfied the first attempt skip it.
+static OffsetAllocator::Allocation tracedAllocate(GeometryPool* pPool, uint32_t count) {
+    const OffsetAllocator::Allocation allocation = pPool->pAllocator->allocate(count);
+    if (pPool->pTrace) {
+        pPool->pTrace->allocate(allocation, count);
+    }
+    return allocation;
+}
+
+static bool tracedAllocateBatch(GeometryPool* pPool, const uint32_t* pSizes, uint32_t count, OffsetAllocator::Allocation* pAllocations) {
+    const bool allocated = pPool->pAllocator->allocateBatch(pSizes, count, pAllocations);
+    if (pPool->pTrace) {
+        pPool->pTrace->allocateBatch(pAllocations, pSizes, count);
+    }
+    return allocated;
+}
+
+OffsetAllocator::Allocation allocateFromGeometryPool(GeometryPool* pPool, uint32_t count) {
+    OffsetAllocator::Allocation allocation = tracedAllocate(pPool, count);
+    if (allocation.offset != OffsetAllocator::Allocation::NO_SPACE) {
+        return allocation;
+    }
+    // The tail free node receives all of the new space, so count always fits after a grow
+    // unless the allocator is out of nodes.
+    if (!growGeometryPool(pPool, (uint64_t)pPool->mCapacity + count)) {
+        return allocation;
+    }
+    if (pPool->pTrace) {
+        pPool->pTrace->retry();
+    }
+    return tracedAllocate(pPool, count);
+}
+
+bool allocateBatchFromGeometryPool(GeometryPool* pPool, const uint32_t* pSizes, uint32_t count, OffsetAllocator::Allocation* pAllocations) {
+    if (tracedAllocateBatch(pPool, pSizes, count, pAllocations)) {
+        return true;
+    }
+    // Growing adds the whole batch to the tail free node, so the retry lands in one piece.
+    uint64_t totalCount = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        totalCount += pSizes[i];
+    }
+    if (!growGeometryPool(pPool, (uint64_t)pPool->mCapacity + totalCount)) {
+        return false;
+    }
+    if (pPool->pTrace) {
+        pPool->pTrace->retry();
+    }
+    return tracedAllocateBatch(pPool, pSizes, count, pAllocations);
+}
+
+void freeFromGeometryPool(GeometryPool* pPool, OffsetAllocator::Allocation allocation) {
+    if (pPool->pTrace) {
+        pPool->pTrace->free(allocation);
+    }
+    pPool->pAllocator->free(allocation);
+}
+
+void markGeometryPoolFrame(GeometryPool* pPool) {
+    if (pPool->pTrace) {
+        pPool->pTrace->frame();
+    }
+}
+
+// A run of meshlets whose destination ranges and source data are both contiguous,
+// uploaded with a single begin/endUpdateResource pair.
+struct UploadRun {
+    uint64_t mDstElement;
+    uint64_t mSrcElement;
+    uint64_t mElementCount;
+    uint32_t mFirstMeshlet;
+    uint32_t mMeshletCount;
+};
+
+static void addToRun(
+    UploadRun** ppRuns, uint32_t meshletIndex, uint64_t dstElement, uint64_t srcElement, uint64_t elementCount, uint64_t maxElements) {
+    UploadRun* pLast = arrlenu(*ppRuns) ? &arrlast(*ppRuns) : NULL;
+    if (pLast && pLast->mDstElement + pLast->mElementCount == dstElement && pLast->mSrcElement + pLast->mElementCount == srcElement &&
+        pLast->mElementCount + elementCount <= maxElements) {
+        pLast->mElementCount += elementCount;
+        pLast->mMeshletCount++;
+        return;
+    }
+    UploadRun run = { dstElement, srcElement, elementCount, meshletIndex, 1 };
+    arrpush(*ppRuns, run);
+}
+
+uint32_t compactGeometryPool(GeometryPool* pPool, Cmd* pCmd, OffsetAllocator::Move* pMoves, uint32_t maxMoves) {
+    ASSERT(pPool->pCompactScratch);
+    const uint32_t moveCount = pPool->pAllocator->defragment(pMoves, maxMoves, pPool->mCompactBudget);
+    const uint64_t elementSize = pPool->mElementSize;
+    const uint64_t scratchSize = pPool->pCompactScratch->mSize;
+
+    // Moves slide allocations down in address order, so handling them in order in scratch-sized
+    // batches is memmove safe: every batch reads all its sources before writing its destinations,
+    // and no destination reaches into a source of a later batch. The allocator may hand out one
+    // move larger than the budget, it is split into scratch-sized pieces.
+    uint32_t move = 0;
+    uint64_t moveDone = 0; // bytes of pMoves[move] copied by earlier batches
+    while (move < moveCount) {
+        const uint32_t batchMove = move;
+        const uint64_t batchMoveDone = moveDone;
+
+        BufferBarrier barriers[] = { { pPool->pBuffer, RESOURCE_STATE_COMMON, RESOURCE_STATE_COPY_SOURCE },
+                                     { pPool->pCompactScratch, RESOURCE_STATE_COMMON, RESOURCE_STATE_COPY_DEST } };
+        cmdResourceBarrier(pCmd, TF_ARRAY_COUNT(barriers), barriers, 0, NULL, 0, NULL);
+        uint64_t batchSize = 0;
+        while (move < moveCount && batchSize < scratchSize) {
+            const uint64_t moveSize = pMoves[move].size * elementSize;
+            const uint64_t size = moveSize - moveDone < scratchSize - batchSize ? moveSize - moveDone : scratchSize - batchSize;
+            cmdUpdateBuffer(pCmd, pPool->pCompactScratch, batchSize, pPool->pBuffer, pMoves[move].srcOffset * elementSize + moveDone, size);
+            batchSize += size;
+            moveDone += size;
+            if (moveDone == moveSize) {
+                move++;
+                moveDone = 0;
+            }
+        }
+
+        barriers[0] = { pPool->pBuffer, RESOURCE_STATE_COPY_SOURCE, RESOURCE_STATE_COPY_DEST };
+        barriers[1] = { pPool->pCompactScratch, RESOURCE_STATE_COPY_DEST, RESOURCE_STATE_COPY_SOURCE };
+        cmdResourceBarrier(pCmd, TF_ARRAY_COUNT(barriers), barriers, 0, NULL, 0, NULL);
+        // Same walk again, scratch -> destinations
+        uint32_t m = batchMove;
+        uint64_t done = batchMoveDone;
+        for (uint64_t scratchOffset = 0; scratchOffset < batchSize;) {
+            const uint64_t moveSize = pMoves[m].size * elementSize;
+            const uint64_t size = moveSize - done < batchSize - scratchOffset ? moveSize - done : batchSize - scratchOffset;
+            cmdUpdateBuffer(pCmd, pPool->pBuffer, pMoves[m].dstOffset * elementSize + done, pPool->pCompactScratch, scratchOffset, size);
+            scratchOffset += size;
+            done += size;
+            if (done == moveSize) {
+                m++;
+                done = 0;
+            }
+        }
+
+        barriers[0] = { pPool->pBuffer, RESOURCE_STATE_COPY_DEST, RESOURCE_STATE_COMMON };
+        barriers[1] = { pPool->pCompactScratch, RESOURCE_STATE_COPY_SOURCE, RESOURCE_STATE_COMMON };
+        cmdResourceBarrier(pCmd, TF_ARRAY_COUNT(barriers), barriers, 0, NULL, 0, NULL);
+    }
+    return moveCount;
+}
+
+void dumpGeometryPoolStats(const GeometryPool* const* ppPools, uint32_t count, const char* pFileName) {
+    char path[FS_MAX_PATH] = {};
+    snprintf(path, sizeof(path), "%s.json", pFileName);
+    FileStream jsonFile = {};
+    if (!fsOpenStreamFromPath(RD_DEBUG, path, FM_WRITE, &jsonFile)) {
+        LOGF(LogLevel::eERROR, "Failed to open %s", path);
+        return;
+    }
+    snprintf(path, sizeof(path), "%s.csv", pFileName);
+    FileStream csvFile = {};
+    if (!fsOpenStreamFromPath(RD_DEBUG, path, FM_WRITE, &csvFile)) {
+        LOGF(LogLevel::eERROR, "Failed to open %s", path);
+        fsCloseStream(&jsonFile);
+        return;
+    }
+
+    fsPrintToStream(&jsonFile, "{\n  \"pools\": [");
+    fsPrintToStream(&csvFile, "pool,regionSize,freeRegions\n");
+    for (uint32_t i = 0; i < count; i++) {
+        const GeometryPool* pPool = ppPools[i];
+        const OffsetAllocator::AllocatorStats stats = pPool->pAllocator->stats();
+        const OffsetAllocator::StorageReport report = pPool->pAllocator->storageReport();
+        const OffsetAllocator::StorageReportFull histogram = pPool->pAllocator->storageReportFull();
+        fsPrintToStream(&jsonFile,
+                        "%s\n    {\n"
+                        "      \"name\": \"%s\", \"elementSize\": %u, \"capacity\": %u, \"growCount\": %u,\n"
+                        "      \"allocationCount\": %u, \"usedSize\": %u, \"freeSize\": %u, \"largestFreeRegion\": %u,"
+                        " \"fragmentation\": %.4f,\n"
+                        "      \"freeRegionCount\": %u, \"peakAllocationCount\": %u, \"peakUsedSize\": %u, \"peakNodeCount\": %u,"
+                        " \"failedAllocations\": %u,\n"
+                        "      \"freeRegions\": [",
+                        i > 0 ? "," : "", pPool->pName, pPool->mElementSize, pPool->mCapacity, pPool->mGrowCount,
+                        stats.allocationCount, stats.usedSize, report.totalFreeSpace, report.largestFreeRegion, report.fragmentation(),
+                        stats.freeRegionCount, stats.peakAllocationCount, stats.peakUsedSize, stats.peakNodeCount, stats.failedAllocations);
+        // Non-empty bins only, as [region size, count] with the size rounded down to the bin
+        bool first = true;
+        for (uint32_t bin = 0; bin < OffsetAllocator::NUM_LEAF_BINS; bin++) {
+            const OffsetAllocator::StorageReportFull::StorageReportRegion& region = histogram.freeRegions[bin];
+            if (region.count == 0) {
+                continue;
+            }
+            fsPrintToStream(&jsonFile, "%s[%u, %u]", first ? "" : ", ", region.size, region.count);
+            fsPrintToStream(&csvFile, "%s,%u,%u\n", pPool->pName, region.size, region.count);
+            first = false;
+        }
+        fsPrintToStream(&jsonFile, "]\n    }");
+    }
+    fsPrintToStream(&jsonFile, "\n  ]\n}\n");
+
+    fsCloseStream(&csvFile);
+    fsCloseStream(&jsonFile);
+    LOGF(LogLevel::eINFO, "Wrote geometry pool stats to %s.json and %s.csv", pFileName, pFileName);
+}
+
+void addTransientBuffer(Renderer* pRenderer, const TransientBufferDesc* pDesc, TransientBuffer** ppBuffer) {
+    ASSERT(pRenderer && pDesc && ppBuffer);
+    ASSERT(pDesc->mSize > 0 && pDesc->mFrameCount > 0);
+
+    // The ring allocator lives in the same block
+    TransientBuffer* pBuffer = (TransientBuffer*)tf_calloc(1, sizeof(TransientBuffer) + sizeof(OffsetAllocator::RingAllocator));
+    pBuffer->pRenderer = pRenderer;
+    pBuffer->pName = pDesc->pName;
+    pBuffer->pAllocator = (OffsetAllocator::RingAllocator*)(pBuffer + 1);
+    tf_placement_new<OffsetAllocator::RingAllocator>(pBuffer->pAllocator, pDesc->mSize, pDesc->mFrameCount);
+
+    BufferLoadDesc loadDesc = {};
+    loadDesc.ppBuffer = &pBuffer->pBuffer;
+    loadDesc.mDesc.mDescriptors = (DescriptorType)pDesc->mDescriptors;
+    loadDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_TO_GPU;
+    loadDesc.mDesc.mFlags = BUFFER_CREATION_FLAG_PERSISTENT_MAP_BIT;
+    loadDesc.mDesc.mSize = pDesc->mSize;
+    loadDesc.mDesc.pName = pDesc->pName;
+    SyncToken token = {};
+    addResource(&loadDesc, &token);
+    waitForToken(&token);
+
+    *ppBuffer = pBuffer;
+}
+
+void removeTransientBuffer(TransientBuffer* pBuffer) {
+    if (!pBuffer) {
+        return;
+    }
+    removeResource(pBuffer->pBuffer);
+    pBuffer->pAllocator->~RingAllocator();
+    tf_free(pBuffer);
+}
+
+void beginTransientFrame(TransientBuffer* pBuffer, Fence* pFence, uint32_t frameIndex) {
+    FenceStatus fenceStatus;
+    getFenceStatus(pBuffer->pRenderer, pFence, &fenceStatus);
+    if (fenceStatus == FENCE_STATUS_INCOMPLETE) {
+        waitForFences(pBuffer->pRenderer, 1, &pFence);
+    }
+    pBuffer->pAllocator->beginFrame(frameIndex);
+}
+
+OffsetAllocator::Allocation allocateFromTransientBuffer(TransientBuffer* pBuffer, uint32_t size, uint32_t alignment, void** ppMapped) {
+    OffsetAllocator::Allocation allocation = pBuffer->pAllocator->allocate(size, alignment);
+    if (allocation.offset == OffsetAllocator::Allocation::NO_SPACE) {
+        LOGF(LogLevel::eWARNING, "%s is full: %u of %u bytes in flight, %u requested", pBuffer->pName, pBuffer->pAllocator->usedSize(),
+             pBuffer->pAllocator->size(), size);
+        *ppMapped = NULL;
+        return allocation;
+    }
+    *ppMapped = (uint8_t*)pBuffer->pBuffer->pCpuMappedAddress + allocation.offset;
+    return allocation;
+}
+
+static void freeMeshletSlots(const MeshletUploadDesc* pDesc, const MeshletSlot* pSlots, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (pSlots[i].m_ownsVertexAlloc && pSlots[i].m_vertexAlloc.offset != OffsetAllocator::Allocation::NO_SPACE) {
+            freeFromGeometryPool(pDesc->pPositionPool, pSlots[i].m_vertexAlloc);
+        }
+        if (pSlots[i].m_vertexTableAlloc.offset != OffsetAllocator::Allocation::NO_SPACE) {
+            freeFromGeometryPool(pDesc->pVertexTablePool, pSlots[i].m_vertexTableAlloc);
+        }
+        if (pSlots[i].m_indexAlloc.offset != OffsetAllocator::Allocation::NO_SPACE) {
+            freeFromGeometryPool(pDesc->pIndexPool, pSlots[i].m_indexAlloc);
+        }
+    }
+}
+
+bool uploadMeshlets(
+    const MeshletUploadDesc* pDesc, const MeshletBuilder::MeshletData& data, MeshletSlot** ppSlots, MeshletUploadStats* pStats) {
+    HiresTimer timer;
+    initHiresTimer(&timer);
+
+    // In the shared vertex layout the per-meshlet vertex ranges are table ranges, and each
+    // primitive's vertices are a single extra allocation in the position pool.
+    const MeshletBuilder::SharedVertexLayout* pShared = pDesc->pSharedVertices;
+    ASSERT(!pShared || (pDesc->pVertexTablePool && pDesc->mPositionFormat == MeshletBuilder::POSITION_FORMAT_FLOAT3));
+    GeometryPool* pMeshletVertexPool = pShared ? pDesc->pVertexTablePool : pDesc->pPositionPool;
+
+    // Reserve every range up front in one pass: the allocator is single threaded, so the
+    // builder hands us prefix-summed sizes and all allocator traffic happens here.
+    const size_t firstSlot = arrlenu(*ppSlots);
+    arrsetlen(*ppSlots, firstSlot + data.meshletCount);
+    MeshletSlot* slots = *ppSlots + firstSlot;
+    for (size_t i = 0; i < data.meshletCount; i++) {
+        slots[i] = {};
+    }
+
+    // Each primitive is one allocateBatch per pool, which carves its meshlets' ranges back to
+    // back out of a single node. Meshlets are packed back to back in data too, so a primitive
+    // collapses into one run per buffer.
+    UploadRun* positionRuns = NULL;
+    UploadRun* vertexTableRuns = NULL;
+    UploadRun* indexRuns = NULL;
+    uint32_t* vertexSizes = NULL;
+    uint32_t* indexSizes = NULL;
+    OffsetAllocator::Allocation* vertexAllocs = NULL;
+    OffsetAllocator::Allocation* indexAllocs = NULL;
+    const MeshletBuilder::PositionFormat positionFormat = pDesc->mPositionFormat;
+    const uint32_t positionElementSize = MeshletBuilder::positionElementSize(positionFormat);
+    const uint64_t maxPositionElements = MESHLET_UPLOAD_MAX_BATCH_SIZE / positionElementSize;
+    const uint64_t maxVertexTableElements = MESHLET_UPLOAD_MAX_BATCH_SIZE / sizeof(uint32_t);
+    const MeshletBuilder::MicroIndexFormat indexFormat = pDesc->mMicroIndexFormat;
+    const uint32_t indexElementSize = MeshletBuilder::microIndexElementSize(indexFormat);
+    const uint32_t indexElementsPerTriangle = MeshletBuilder::microIndexElementsPerTriangle(indexFormat);
+    const uint64_t maxIndexElements = MESHLET_UPLOAD_MAX_BATCH_SIZE / indexElementSize;
+    const size_t batchCount = data.primitiveCount > 0 ? data.primitiveCount : 1;
+    bool allocated = true;
+    for (size_t b = 0; b < batchCount && allocated; b++) {
+        const size_t first = data.primitiveCount > 0 ? data.primitives[b].meshletOffset : 0;
+        const uint32_t count = (uint32_t)(data.primitiveCount > 0 ? data.primitives[b].meshletCount : data.meshletCount);
+        ASSERT(first + count <= data.meshletCount);
+        if (pShared && count == 0) {
+            continue;
+        }
+        arrsetlen(vertexSizes, count);
+        arrsetlen(indexSizes, count);
+        arrsetlen(vertexAllocs, count);
+        arrsetlen(indexAllocs, count);
+        for (uint32_t i = 0; i < count; i++) {
+            vertexSizes[i] = data.meshlets[first + i].vertexCount;
+            indexSizes[i] = data.meshlets[first + i].triangleCount * indexElementsPerTriangle;
+        }
+
+        OffsetAllocator::Allocation primitiveVertexAlloc = {};
+        if (pShared) {
+            primitiveVertexAlloc = allocateFromGeometryPool(pDesc->pPositionPool, pShared->primitiveVertexCount[b]);
+            allocated = primitiveVertexAlloc.offset != OffsetAllocator::Allocation::NO_SPACE;
+        }
+        if (allocated && !allocateBatchFromGeometryPool(pMeshletVertexPool, vertexSizes, count, vertexAllocs)) {
+            allocated = false;
+        } else if (allocated && !allocateBatchFromGeometryPool(pDesc->pIndexPool, indexSizes, count, indexAllocs)) {
+            for (uint32_t i = 0; pMeshletVertexPool->pTrace && i < count; i++) {
+                pMeshletVertexPool->pTrace->free(vertexAllocs[i]);
+            }
+            pMeshletVertexPool->pAllocator->freeBatch(vertexAllocs, count);
+            allocated = false;
+        }
+        if (!allocated) {
+            if (primitiveVertexAlloc.offset != OffsetAllocator::Allocation::NO_SPACE) {
+                freeFromGeometryPool(pDesc->pPositionPool, primitiveVertexAlloc);
+            }
+            LOGF(LogLevel::eERROR, "Geometry pools are full, failed to upload meshlets %zu-%zu of %zu", first, first + count,
+                 data.meshletCount);
+            break;
+        }
+
+        if (pShared) {
+            // Split so a single primitive never exceeds the staging limit
+            const uint64_t primitiveVertexCount = pShared->primitiveVertexCount[b];
+            for (uint64_t done = 0; done < primitiveVertexCount; done += maxPositionElements) {
+                const uint64_t elementCount =
+                    primitiveVertexCount - done < maxPositionElements ? primitiveVertexCount - done : maxPositionElements;
+                addToRun(&positionRuns, (uint32_t)first, primitiveVertexAlloc.offset + done, pShared->primitiveVertexOffset[b] + done,
+                         elementCount, maxPositionElements);
+            }
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            const size_t m = first + i;
+            const MeshletBuilder::Meshlet& src = data.meshlets[m];
+            MeshletSlot& meshlet = slots[m];
+            meshlet.m_vertexAlloc = pShared ? primitiveVertexAlloc : vertexAllocs[i];
+            meshlet.m_vertexTableAlloc = pShared ? vertexAllocs[i] : OffsetAllocator::Allocation{};
+            meshlet.m_ownsVertexAlloc = !pShared || i == 0;
+            meshlet.m_indexAlloc = indexAllocs[i];
+            meshlet.m_numVerts = src.vertexCount;
+            meshlet.m_numIndecies = src.triangleCount * 3;
+
+            addToRun(
+                pShared ? &vertexTableRuns : &positionRuns,
+                (uint32_t)m,
+                vertexAllocs[i].offset,
+                src.vertexOffset,
+                src.vertexCount,
+                pShared ? maxVertexTableElements : maxPositionElements);
+            addToRun(
+                &indexRuns,
+                (uint32_t)m,
+                meshlet.m_indexAlloc.offset,
+                src.triangleOffset * indexElementsPerTriangle,
+                src.triangleCount * indexElementsPerTriangle,
+                maxIndexElements);
+        }
+    }
+    arrfree(vertexSizes);
+    arrfree(indexSizes);
+    arrfree(vertexAllocs);
+    arrfree(indexAllocs);
+
+    if (!allocated) {
+        freeMeshletSlots(pDesc, slots, data.meshletCount);
+        arrsetlen(*ppSlots, firstSlot);
+        arrfree(positionRuns);
+        arrfree(vertexTableRuns);
+        arrfree(indexRuns);
+        return false;
+    }
+
+    // Pools may have grown above, so the buffers are only looked up now.
+    Buffer* pPositionBuffer = pDesc->pPositionPool->pBuffer;
+    Buffer* pIndexBuffer = pDesc->pIndexPool->pBuffer;
+    const float* pPositions = pShared ? pShared->positions.data() : data.positions;
+    uint64_t bytesUploaded = 0;
+    for (ptrdiff_t i = 0; i < arrlen(positionRuns); i++) {
+        const UploadRun& run = positionRuns[i];
+        BufferUpdateDesc positionUpdateDesc = { pPositionBuffer,
+                                                run.mDstElement * positionElementSize,
+                                                run.mElementCount * positionElementSize };
+        beginUpdateResource(&positionUpdateDesc);
+        if (positionFormat == MeshletBuilder::POSITION_FORMAT_FLOAT3) {
+            memcpy(positionUpdateDesc.pMappedData, &pPositions[run.mSrcElement * 3], run.mElementCount * positionElementSize);
+        } else {
+            // Quantized positions are relative to each meshlet's own AABB.
+            for (uint32_t m = run.mFirstMeshlet; m < run.mFirstMeshlet + run.mMeshletCount; m++) {
+                const MeshletBuilder::Meshlet& src = data.meshlets[m];
+                const uint64_t dstOffset = (slots[m].m_vertexAlloc.offset - run.mDstElement) * positionElementSize;
+                uint8_t* pDst = (uint8_t*)positionUpdateDesc.pMappedData + dstOffset;
+                MeshletBuilder::encodePositions(
+                    positionFormat, &data.positions[src.vertexOffset * 3], src.vertexCount, src.aabbMin, src.aabbMax, pDst);
+            }
+        }
+        endUpdateResource(&positionUpdateDesc);
+        bytesUploaded += positionUpdateDesc.mSize;
+    }
+
+    for (ptrdiff_t i = 0; i < arrlen(vertexTableRuns); i++) {
+        const UploadRun& run = vertexTableRuns[i];
+        BufferUpdateDesc tableUpdateDesc = { pDesc->pVertexTablePool->pBuffer,
+                                             run.mDstElement * sizeof(uint32_t),
+                                             run.mElementCount * sizeof(uint32_t) };
+        beginUpdateResource(&tableUpdateDesc);
+        memcpy(tableUpdateDesc.pMappedData, &pShared->meshletVertices[run.mSrcElement], run.mElementCount * sizeof(uint32_t));
+        endUpdateResource(&tableUpdateDesc);
+        bytesUploaded += tableUpdateDesc.mSize;
+    }
+
+    for (ptrdiff_t i = 0; i < arrlen(indexRuns); i++) {
+        const UploadRun& run = indexRuns[i];
+        BufferUpdateDesc indexUpdateDesc = { pIndexBuffer,
+                                             run.mDstElement * indexElementSize,
+                                             run.mElementCount * indexElementSize };
+        beginUpdateResource(&indexUpdateDesc);
+        // Micro-indices are meshlet local, so a run spanning several meshlets encodes in one pass.
+        MeshletBuilder::encodeMicroIndices(
+            indexFormat,
+            &data.triangles[run.mSrcElement / indexElementsPerTriangle * 3],
+            run.mElementCount / indexElementsPerTriangle,
+            indexUpdateDesc.pMappedData);
+        endUpdateResource(&indexUpdateDesc);
+        bytesUploaded += indexUpdateDesc.mSize;
+    }
+
+    if (pStats) {
+        pStats->mBytesUploaded = bytesUploaded;
+        pStats->mUpdateCount = (uint32_t)(arrlen(positionRuns) + arrlen(vertexTableRuns) + arrlen(indexRuns));
+        pStats->mMeshletCount = (uint32_t)data.meshletCount;
+        pStats->mSeconds = (double)getHiresTimerUSec(&timer, false) / 1e6;
+    }
+
+    arrfree(positionRuns);
+    arrfree(vertexTableRuns);
+    arrfree(indexRuns);
+    return true;
+}
+
+void refreshMeshletSlots(const MeshletUploadDesc* pDesc, MeshletSlot* pSlots, size_t count) {
+    const OffsetAllocator::Allocator* pPositionAllocator = pDesc->pPositionPool->pAllocator;
+    const OffsetAllocator::Allocator* pIndexAllocator = pDesc->pIndexPool->pAllocator;
+    for (size_t i = 0; i < count; i++) {
+        pSlots[i].m_vertexAlloc.offset = pPositionAllocator->allocationOffset(pSlots[i].m_vertexAlloc);
+        pSlots[i].m_indexAlloc.offset = pIndexAllocator->allocationOffset(pSlots[i].m_indexAlloc);
+        if (pSlots[i].m_vertexTableAlloc.offset != OffsetAllocator::Allocation::NO_SPACE) {
+            pSlots[i].m_vertexTableAlloc.offset = pDesc->pVertexTablePool->pAllocator->allocationOffset(pSlots[i].m_vertexTableAlloc);
+        }
+    }
+}
+
+void getMeshletDrawRanges(const MeshletSlot* pSlots, size_t count, MeshletDrawArgs::MeshletDrawRange* pRanges) {
+    for (size_t i = 0; i < count; i++) {
+        pRanges[i].firstIndex = pSlots[i].m_indexAlloc.offset;
+        pRanges[i].indexCount = (uint32_t)pSlots[i].m_numIndecies;
+        pRanges[i].baseVertex = (int32_t)pSlots[i].m_vertexAlloc.offset;
+    }
+}
+
+void uploadMeshletTable(const MeshletTableDesc* pDesc, const MeshletBuilder::MeshletBoundsTable& table, const MeshletSlot* pSlots) {
+    ASSERT(table.count <= pDesc->mStreamCapacity);
+
+    const size_t maxBlocks = MESHLET_UPLOAD_MAX_BATCH_SIZE / sizeof(MeshletBlock);
+    for (size_t first = 0; first < table.count; first += maxBlocks) {
+        const size_t count = table.count - first < maxBlocks ? table.count - first : maxBlocks;
+        BufferUpdateDesc updateDesc = { pDesc->pMeshletBuffer, first * sizeof(MeshletBlock), count * sizeof(MeshletBlock) };
+        beginUpdateResource(&updateDesc);
+        MeshletBlock* pBlocks = (MeshletBlock*)updateDesc.pMappedData;
+        for (size_t i = 0; i < count; i++) {
+            const size_t m = first + i;
+            MeshletBlock block = {};
+            // Node transforms aren't applied yet, so toWorld is just the position decode frame.
+            const float aabbMin[3] = { table.aabbMinX[m], table.aabbMinY[m], table.aabbMinZ[m] };
+            const float aabbMax[3] = { table.aabbMaxX[m], table.aabbMaxY[m], table.aabbMaxZ[m] };
+            float offset[3];
+            float scale[3];
+            MeshletBuilder::positionDecodeFrame(pDesc->mPositionFormat, aabbMin, aabbMax, offset, scale);
+            block.mToWorld = mat4::translation(vec3(offset[0], offset[1], offset[2])) * mat4::scale(vec3(scale[0], scale[1], scale[2]));
+            const bool sharedVertices = pSlots[m].m_vertexTableAlloc.offset != OffsetAllocator::Allocation::NO_SPACE;
+            block.mGeometry[0] = pSlots[m].m_indexAlloc.offset;
+            block.mGeometry[1] = sharedVertices ? pSlots[m].m_vertexTableAlloc.offset : pSlots[m].m_vertexAlloc.offset;
+            block.mGeometry[2] = (uint32_t)(pSlots[m].m_numIndecies / 3);
+            block.mGeometry[3] = sharedVertices ? pSlots[m].m_vertexAlloc.offset : 0;
+            memcpy(&pBlocks[i], &block, sizeof(block));
+        }
+        endUpdateResource(&updateDesc);
+    }
+
+    const size_t maxElements = MESHLET_UPLOAD_MAX_BATCH_SIZE / sizeof(float4);
+    for (uint32_t stream = 0; stream < MESHLET_BOUNDS_STREAM_COUNT; stream++) {
+        for (size_t first = 0; first < table.count; first += maxElements) {
+            const size_t count = table.count - first < maxElements ? table.count - first : maxElements;
+            const uint64_t dstOffset = ((uint64_t)stream * pDesc->mStreamCapacity + first) * sizeof(float4);
+            BufferUpdateDesc updateDesc = { pDesc->pBoundsBuffer, dstOffset, count * sizeof(float4) };
+            beginUpdateResource(&updateDesc);
+            float4* pDst = (float4*)updateDesc.pMappedData;
+            for (size_t i = 0; i < count; i++) {
+                const size_t m = first + i;
+                switch (stream) {
+                case MESHLET_BOUNDS_STREAM_SPHERE:
+                    pDst[i] = float4(table.centerX[m], table.centerY[m], table.centerZ[m], table.radius[m]);
+                    break;
+                case MESHLET_BOUNDS_STREAM_AABB_MIN:
+                    pDst[i] = float4(table.aabbMinX[m], table.aabbMinY[m], table.aabbMinZ[m], 0.0f);
+                    break;
+                case MESHLET_BOUNDS_STREAM_AABB_MAX:
+                    pDst[i] = float4(table.aabbMaxX[m], table.aabbMaxY[m], table.aabbMaxZ[m], 0.0f);
+                    break;
+                case MESHLET_BOUNDS_STREAM_CONE_APEX:
+                    pDst[i] = float4(table.coneApexX[m], table.coneApexY[m], table.coneApexZ[m], 0.0f);
+                    break;
+                default:
+                    pDst[i] = float4(table.coneAxisX[m], table.coneAxisY[m], table.coneAxisZ[m], table.coneCutoff[m]);
+                    break;
+                }
+            }
+            endUpdateResource(&updateDesc);
+        }
+    }
+}
@@ -1 +1,179 @@
+#pragma once
 
+#include "MeshletBuilder.h"
+#include "MeshletDrawArgs.h"
+#include "offsetAllocator.h"
+#include "offsetAllocatorTrace.h"
+#include "ringOffsetAllocator.h"
+
+#include "Common_3/Utilities/Math/MathTypes.h"
+
+// Smallest capacity a geometry pool is created with, in elements.
+#define GEOMETRY_POOL_MIN_CAPACITY (64 * 1024)
+
+// Upper bound on a single coalesced staging update, keeps runs inside the resource loader's staging buffer.
+#define MESHLET_UPLOAD_MAX_BATCH_SIZE (16 * 1024 * 1024)
+
+struct Buffer;
+struct Cmd;
+struct Fence;
+struct Queue;
+struct Renderer;
+
+// A GPU buffer sub-allocated by an OffsetAllocator in units of mElementSize bytes. When the
+// allocator runs out of space the pool grows: the allocator range is extended and the buffer is
+// replaced by a larger one, with the old contents copied over on the GPU. pBuffer therefore
+// changes on growth, bind it after the allocations are done.
+struct GeometryPoolDesc {
+    Queue* pQueue;             // queue the grow copy is submitted on
+    const char* pName;
+    uint32_t mDescriptors;     // DescriptorType flags of the buffer
+    uint32_t mElementSize;     // bytes per allocator element
+    uint32_t mInitialCapacity; // elements
+    uint32_t mMaxCapacity;     // elements, 0 = OffsetAllocator::Allocator::MAX_SIZE
+    uint32_t mMaxAllocations;  // allocator nodes, 0 = allocator default
+    uint32_t mCompactBudget;   // elements moved per compactGeometryPool call, 0 = no compaction
+    OffsetAllocator::AllocationPolicy mAllocationPolicy; // zero-initialized = POLICY_GOOD_FIT
+    const char* pTracePath;    // records every allocator call to this file for OffsetAllocatorBench --replay, NULL = off
+};
+
+struct GeometryPool {
+    OffsetAllocator::Allocator* pAllocator;
+    Buffer* pBuffer;
+    Renderer* pRenderer;
+    Queue* pQueue;
+    const char* pName;
+    uint32_t mDescriptors;
+    uint32_t mElementSize;
+    uint32_t mCapacity; // elements
+    uint32_t mMaxCapacity;
+    uint32_t mGrowCount;
+    Buffer* pCompactScratch; // mCompactBudget elements, moves are copied through it
+    uint32_t mCompactBudget;
+    OffsetAllocator::TraceRecorder* pTrace; // NULL unless GeometryPoolDesc::pTracePath was set
+};
+
+void addGeometryPool(Renderer* pRenderer, const GeometryPoolDesc* pDesc, GeometryPool** ppPool);
+void removeGeometryPool(GeometryPool* pPool);
+
+// Allocates count elements, growing the pool if needed. Returns an allocation with offset
+// OffsetAllocator::Allocation::NO_SPACE when the pool is at mMaxCapacity or out of allocator nodes.
+OffsetAllocator::Allocation allocateFromGeometryPool(GeometryPool* pPool, uint32_t count);
+// OffsetAllocator::Allocator::allocateBatch (all or nothing) that grows the pool on failure.
+bool allocateBatchFromGeometryPool(GeometryPool* pPool, const uint32_t* pSizes, uint32_t count, OffsetAllocator::Allocation* pAllocations);
+void freeFromGeometryPool(GeometryPool* pPool, OffsetAllocator::Allocation allocation);
+// Ends a frame in the allocation trace, if one is recorded. Replays sample fragmentation there.
+void markGeometryPoolFrame(GeometryPool* pPool);
+
+// One step of incremental compaction: asks the allocator for at most maxMoves moves worth up to
+// mCompactBudget elements and records the copies into pCmd, going through pCompactScratch so
+// overlapping moves are safe. Call once per frame before the pool is read; the moves are
+// written to pMoves and their count returned. Moved allocations keep their metadata, refresh
+// the offsets held elsewhere (for example with refreshMeshletSlots) before building draws.
+uint32_t compactGeometryPool(GeometryPool* pPool, Cmd* pCmd, OffsetAllocator::Move* pMoves, uint32_t maxMoves);
+
+// Writes the allocator counters, fragmentation and free region histogram of every pool to
+// <pFileName>.json and the histograms alone to <pFileName>.csv, both in RD_DEBUG. Sizes are in
+// elements of the pool.
+void dumpGeometryPoolStats(const GeometryPool* const* ppPools, uint32_t count, const char* pFileName);
+
+// A persistently mapped CPU_TO_GPU buffer for data written every frame and read by the GPU
+// until that frame's fence signals: indirect arguments, visible lists, uniforms. Ranges come
+// from an OffsetAllocator::RingAllocator and are released a whole frame at a time.
+struct TransientBufferDesc {
+    const char* pName;
+    uint32_t mDescriptors; // DescriptorType flags of the buffer
+    uint32_t mSize;        // bytes, enough for mFrameCount frames of data
+    uint32_t mFrameCount;  // frames in flight, gDataBufferCount
+};
+
+struct TransientBuffer {
+    OffsetAllocator::RingAllocator* pAllocator;
+    Buffer* pBuffer;
+    Renderer* pRenderer;
+    const char* pName;
+};
+
+void addTransientBuffer(Renderer* pRenderer, const TransientBufferDesc* pDesc, TransientBuffer** ppBuffer);
+void removeTransientBuffer(TransientBuffer* pBuffer);
+
+// Call once per frame before allocating, with the fence the previous submit of frameIndex
+// signals. Waits for it if needed, then releases everything that frame allocated.
+void beginTransientFrame(TransientBuffer* pBuffer, Fence* pFence, uint32_t frameIndex);
+// size bytes at an offset that is a multiple of alignment, *ppMapped receives the CPU address
+// of the range. Returns an allocation with offset OffsetAllocator::Allocation::NO_SPACE when
+// the frames in flight fill the buffer.
+OffsetAllocator::Allocation allocateFromTransientBuffer(TransientBuffer* pBuffer, uint32_t size, uint32_t alignment, void** ppMapped);
+
+struct MeshletSlot {
+    OffsetAllocator::Allocation m_vertexAlloc;      // shared vertex layout: the primitive's vertices, same in all its slots
+    OffsetAllocator::Allocation m_indexAlloc;
+    OffsetAllocator::Allocation m_vertexTableAlloc; // shared vertex layout only
+    size_t m_numVerts;
+    size_t m_numIndecies;
+    bool m_ownsVertexAlloc; // false for every slot but a primitive's first in the shared vertex layout
+};
+
+struct MeshletUploadDesc {
+    GeometryPool* pPositionPool; // elements of mPositionFormat
+    GeometryPool* pIndexPool;    // elements of mMicroIndexFormat
+    MeshletBuilder::MicroIndexFormat mMicroIndexFormat;
+    MeshletBuilder::PositionFormat mPositionFormat;
+    // Shared vertex layout, built from the same data: each primitive's vertices are uploaded once
+    // and every meshlet gets a range of pVertexTablePool (uint32 elements) pointing into them.
+    // Requires POSITION_FORMAT_FLOAT3. NULL = every meshlet owns a copy of its vertices.
+    const MeshletBuilder::SharedVertexLayout* pSharedVertices;
+    GeometryPool* pVertexTablePool;
+};
+
+// Must match MeshletBlock in resources.h.fsl
+struct MeshletBlock {
+    mat4 mToWorld;         // includes the decode frame of quantized positions
+    // x: first micro-index element, y: first vertex, z: triangle count. Shared vertex layout:
+    // y is the first vertex table element instead and w the primitive's first vertex.
+    uint32_t mGeometry[4];
+};
+
+// GPU copy of MeshletBuilder::MeshletBoundsTable: one float4 stream per attribute, each
+// mStreamCapacity elements long and indexed like the meshlet slots.
+enum MeshletBoundsStream {
+    MESHLET_BOUNDS_STREAM_SPHERE = 0,      // xyz: center, w: radius
+    MESHLET_BOUNDS_STREAM_AABB_MIN = 1,    // xyz
+    MESHLET_BOUNDS_STREAM_AABB_MAX = 2,    // xyz
+    MESHLET_BOUNDS_STREAM_CONE_APEX = 3,   // xyz
+    MESHLET_BOUNDS_STREAM_CONE_AXIS = 4,   // xyz: axis, w: cutoff
+    MESHLET_BOUNDS_STREAM_COUNT,
+};
+
+struct MeshletTableDesc {
+    Buffer* pMeshletBuffer; // MeshletBlock per meshlet
+    Buffer* pBoundsBuffer;  // MESHLET_BOUNDS_STREAM_COUNT * mStreamCapacity float4
+    uint32_t mStreamCapacity;
+    MeshletBuilder::PositionFormat mPositionFormat; // of the position pool, see MeshletBuilder::positionDecodeFrame
+};
+
+struct MeshletUploadStats {
+    uint64_t mBytesUploaded;
+    uint32_t mUpdateCount; // begin/endUpdateResource pairs issued
+    uint32_t mMeshletCount;
+    double mSeconds;       // CPU time spent allocating and writing staging memory
+};
+
+// Carves a range per meshlet out of the geometry pools, one batch per primitive, and copies
+// the baked positions / encoded micro-indices into the pool buffers, growing the pools as
+// needed. data may point straight into a mapped cache file. Slots are appended to *ppSlots
+// (stb array). Meshlets whose ranges are contiguous are coalesced into a single staging update.
+// Returns false, with nothing allocated or appended, if a pool can't fit the data.
+bool uploadMeshlets(
+    const MeshletUploadDesc* pDesc, const MeshletBuilder::MeshletData& data, MeshletSlot** ppSlots, MeshletUploadStats* pStats = NULL);
+
+// Re-reads the vertex and index offsets of count slots from the pools, after compaction moved them.
+void refreshMeshletSlots(const MeshletUploadDesc* pDesc, MeshletSlot* pSlots, size_t count);
+
+// Per-meshlet geometry ranges consumed by the indirect argument emitters, indexed like pSlots.
+// Indexed draws need a base vertex per meshlet, so only slots of the duplicated layout work there.
+void getMeshletDrawRanges(const MeshletSlot* pSlots, size_t count, MeshletDrawArgs::MeshletDrawRange* pRanges);
+
+// Fills the MeshletBlock and bounds stream of the first table.count meshlets. pSlots must be the
+// slots uploadMeshlets returned for the same data, in the same order.
+void uploadMeshletTable(const MeshletTableDesc* pDesc, const MeshletBuilder::MeshletBoundsTable& table, const MeshletSlot* pSlots);
@@ -26,8 +26,15 @@
 // Tests the basic mat4 transformations, such as scaling, rotation, and
 // translation.
 
+#include "GLTFStream.h"
+#include "GeometrySet.h"
+#include "MeshletCache.h"
+#include "MeshletCulling.h"
 #include "offsetAllocator.h"
 
+#include <math.h>
+#include <stdlib.h>
+
 #include "tinyimageformat_query.h"
 #define MAX_PLANETS                                                            \
   20 // Does not affect test, just for allocating space in uniform block. Must
@@ -49,18 +56,15 @@
 #include "Common_3/Utilities/Interfaces/ITime.h"
 
 #include "Common_3/Utilities/RingBuffer.h"
+#include "Common_3/Utilities/ThirdParty/OpenSource/Nothings/stb_ds.h"
 
 // Renderer
 #include "Common_3/Graphics/Interfaces/IGraphics.h"
 #include "Common_3/Resources/ResourceLoader/Interfaces/IResourceLoader.h"
 
-#include "Common_3/Tools/ThirdParty/OpenSource/meshoptimizer/src/meshoptimizer.h"
-
 // Math
 #include "Common_3/Utilities/Math/MathTypes.h"
 
-#define TINYGLTF_IMPLEMENTATION
-#define STB_IMAGE_IMPLEMENTATION
 #include "tiny_gltf.h"
 
 #include "Common_3/Utilities/Interfaces/IMemory.h"
@@ -94,6 +98,11 @@ struct UniformBlockSky {
   CameraMatrix mProjectView;
 };
 
+// Must match sceneBlock in resources.h.fsl
+struct SceneBlock {
+  CameraMatrix mViewProj;
+};
+
 // But we only need Two sets of resources (one in flight and one being used on
 // CPU)
 const uint32_t gDataBufferCount = 2;
@@ -122,12 +131,6 @@ ICameraController *pCameraController = NULL;
 
 UIComponent *pGuiWindow = NULL;
 
-struct MeshletSlot {
-    OffsetAllocator::Allocation m_vertexAlloc;
-    OffsetAllocator::Allocation m_indexAlloc;
-    size_t m_numVerts;
-    size_t m_numIndecies;
-};
 MeshletSlot* meshletSlots = NULL; 
 
 uint32_t gFontID = 0;
@@ -143,28 +146,151 @@ struct MeshletEntry {
   OffsetAllocator::Allocation indexAlloc;
 };
 
-
-#define OPAQUE_POSITION_ELEMENT_SIZE sizeof(float3)
-#define OPAQUE_INDEX_ELEMENT_SIZE sizeof(uint32_t)
-#define OPAQUE_NUM_VERTS 6000000
-#define OPAQUE_NUM_INDICES 6000000
-
-OffsetAllocator::Allocator* opaqueIndexAlloc;
-OffsetAllocator::Allocator* opaqueVertexAlloc;
-Buffer* opaqueIndexBuffer;
-Buffer* opaquePositionBuffer;
+MeshletBuilder::MicroIndexFormat gMicroIndexFormat = MeshletBuilder::MICRO_INDEX_FORMAT_U32;
+MeshletBuilder::PositionFormat gPositionFormat = MeshletBuilder::POSITION_FORMAT_FLOAT3;
+OffsetAllocator::AllocationPolicy gPoolAllocationPolicy = OffsetAllocator::POLICY_GOOD_FIT;
+// Path prefix of the pools' allocation traces, <prefix>.indices.oatrace, <prefix>.positions.oatrace
+// and, with shared vertices, <prefix>.vertex_table.oatrace
+const char* gAllocationTracePrefix = NULL;
+// Upload each primitive's vertices once plus a per-meshlet vertex table instead of a copy of the
+// vertices per meshlet, see MeshletBuilder::SharedVertexLayout. float3 positions only.
+bool gSharedVertices = false;
+GeometryPool* pOpaqueIndexPool = NULL;
+GeometryPool* pOpaquePositionPool = NULL;
+GeometryPool* pMeshletVertexTablePool = NULL; // shared vertices only
+Buffer* pMeshletBuffer = NULL;
+Buffer* pMeshletBoundsBuffer = NULL;
+MeshletBuilder::MeshletBoundsTable gMeshletBounds;
+uint32_t* pVisibleMeshlets = NULL; // indices into meshletSlots that survived culling this frame
+uint32_t gVisibleMeshletCount = 0;
+bool gBackfaceCulling = true;
+// Screen space error the LOD cut is picked for, only used when the scene was baked with a hierarchy
+float gLodPixelError = 1.0f;
+MeshletCulling::CullWorkers* pCullWorkers = NULL;
+MeshletCulling::CullParams gCullParams = {};
+SceneBlock gSceneData = {};
+
+// Visible meshlets are drawn with a single cmdExecuteIndirect. 32 bit indices with float3
+// positions use an indexed draw per meshlet; every other format, and the shared vertex layout,
+// is pulled in the vertex shader.
+bool gIndexedMeshletDraw = true;
+MeshletDrawArgs::MeshletDrawRange* pMeshletDrawRanges = NULL;
+// Per-frame data read by the GPU until the frame's fence signals, currently the indirect args
+TransientBuffer* pFrameDataBuffer = NULL;
+const uint32_t gFrameDataAlignment = 256; // satisfies uniform buffer offsets too
+uint32_t gIndirectArgsOffset = 0;
+Buffer* pSceneUniformBuffer[gDataBufferCount] = {};
+CommandSignature* pMeshletCommandSignature = NULL;
+Pipeline* pOpaquePipeline = NULL;
+DescriptorSet* pDescriptorSetMeshlets = NULL; // UPDATE_FREQ_NONE, vertex pulling only
+DescriptorSet* pDescriptorSetScene = NULL;    // UPDATE_FREQ_PER_FRAME
+
+static void logQuantizationError(const MeshletBuilder::MeshletData& data) {
+  if (gPositionFormat == MeshletBuilder::POSITION_FORMAT_FLOAT3)
+    return;
+  std::vector<MeshletBuilder::QuantizationError> errors = MeshletBuilder::measureQuantizationError(gPositionFormat, data);
+  for (size_t i = 0; i < errors.size(); i++) {
+    LOGF(LogLevel::eINFO, "Mesh %zu position quantization error: max %f mean %f", i, errors[i].maxError, errors[i].meanError);
+  }
+}
 
 static unsigned char gPipelineStatsCharArray[2048] = {};
 static bstring gPipelineStats = bfromarr(gPipelineStatsCharArray);
+static unsigned char gCullStatsCharArray[256] = {};
+static bstring gCullStats = bfromarr(gCullStatsCharArray);
+static unsigned char gPoolStatsCharArray[1024] = {};
+static bstring gPoolStats = bfromarr(gPoolStatsCharArray);
+
+// Fills pools with the geometry pools in use, returns their count (at most 3).
+static uint32_t getGeometryPools(const GeometryPool** pools) {
+  uint32_t count = 0;
+  pools[count++] = pOpaquePositionPool;
+  pools[count++] = pOpaqueIndexPool;
+  if (pMeshletVertexTablePool) {
+    pools[count++] = pMeshletVertexTablePool;
+  }
+  return count;
+}
+
+// Allocator counters are O(1) to read, so the widget is refreshed every frame
+static void updateGeometryPoolStats() {
+  const GeometryPool* pools[3] = {};
+  const uint32_t poolCount = getGeometryPools(pools);
+  bassigncstr(&gPoolStats, "");
+  for (uint32_t i = 0; i < poolCount; i++) {
+    const OffsetAllocator::AllocatorStats stats = pools[i]->pAllocator->stats();
+    const OffsetAllocator::StorageReport report = pools[i]->pAllocator->storageReport();
+    const double toMB = pools[i]->mElementSize / (1024.0 * 1024.0);
+    bformata(&gPoolStats,
+             "\n%s:\n"
+             "    %u allocations (peak %u), %u free regions, %u failed\n"
+             "    %.2f / %.2f MB used (peak %.2f), %u grows\n"
+             "    largest free %.2f MB, fragmentation %.3f\n",
+             pools[i]->pName,
+             stats.allocationCount,
+             stats.peakAllocationCount,
+             stats.freeRegionCount,
+             stats.failedAllocations,
+             stats.usedSize * toMB,
+             pools[i]->mCapacity * toMB,
+             stats.peakUsedSize * toMB,
+             pools[i]->mGrowCount,
+             report.largestFreeRegion * toMB,
+             report.fragmentation());
+  }
+}
 
 class MeshletViewer : public IApp {
 public:
   bstring mSceneGLTF;
+  bool mUseMeshletCache = true;
+  bool mStreamGLTF = false; // load through GLTFStream, implied for .glb scenes
+  bool mOptimizeMeshlets = false;
+  bool mLodHierarchy = false; // bake coarser levels and draw the cut for gLodPixelError
 
   MeshletViewer() {
     for (int i = 0; i < argc; i += 1) {
       if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
         mSceneGLTF = bdynfromcstr(argv[i + 1]);
+      } else if (strcmp(argv[i], "--no-meshlet-cache") == 0) {
+        mUseMeshletCache = false;
+      } else if (strcmp(argv[i], "--stream-gltf") == 0) {
+        mStreamGLTF = true;
+      } else if (strcmp(argv[i], "--optimize-meshlets") == 0) {
+        mOptimizeMeshlets = true;
+      } else if (strcmp(argv[i], "--lod-hierarchy") == 0) {
+        mLodHierarchy = true;
+      } else if (strcmp(argv[i], "--lod-pixel-error") == 0 && i + 1 < argc) {
+        gLodPixelError = (float)atof(argv[i + 1]);
+      } else if (strcmp(argv[i], "--shared-vertices") == 0) {
+        gSharedVertices = true;
+      } else if (strcmp(argv[i], "--micro-index") == 0 && i + 1 < argc) {
+        if (strcmp(argv[i + 1], "u8") == 0) {
+          gMicroIndexFormat = MeshletBuilder::MICRO_INDEX_FORMAT_U8;
+        } else if (strcmp(argv[i + 1], "packed") == 0) {
+          gMicroIndexFormat = MeshletBuilder::MICRO_INDEX_FORMAT_PACKED;
+        } else {
+          gMicroIndexFormat = MeshletBuilder::MICRO_INDEX_FORMAT_U32;
+        }
+      } else if (strcmp(argv[i], "--position-format") == 0 && i + 1 < argc) {
+        // Quantized positions are only decoded on the vertex pulling path.
+        if (strcmp(argv[i + 1], "snorm16") == 0) {
+          gPositionFormat = MeshletBuilder::POSITION_FORMAT_SNORM16;
+        } else if (strcmp(argv[i + 1], "unorm11_11_10") == 0) {
+          gPositionFormat = MeshletBuilder::POSITION_FORMAT_UNORM_11_11_10;
+        } else {
+          gPositionFormat = MeshletBuilder::POSITION_FORMAT_FLOAT3;
+        }
+      } else if (strcmp(argv[i], "--allocation-policy") == 0 && i + 1 < argc) {
+        if (strcmp(argv[i + 1], "best-fit") == 0) {
+          gPoolAllocationPolicy = OffsetAllocator::POLICY_BEST_FIT;
+        } else if (strcmp(argv[i + 1], "lowest-address") == 0) {
+          gPoolAllocationPolicy = OffsetAllocator::POLICY_LOWEST_ADDRESS;
+        } else {
+          gPoolAllocationPolicy = OffsetAllocator::POLICY_GOOD_FIT;
+        }
+      } else if (strcmp(argv[i], "--record-allocations") == 0 && i + 1 < argc) {
+        gAllocationTracePrefix = argv[i + 1];
       }
     }
   }
@@ -190,148 +316,8 @@ public:
     if (!pRenderer)
       return false;
 
-    {
-      opaqueIndexAlloc = (OffsetAllocator::Allocator*)tf_calloc(1, sizeof(OffsetAllocator::Allocator));
-      opaqueVertexAlloc = (OffsetAllocator::Allocator*)tf_calloc(1, sizeof(OffsetAllocator::Allocator));
-      tf_placement_new<OffsetAllocator::Allocator>(opaqueIndexAlloc, OPAQUE_NUM_VERTS );
-      tf_placement_new<OffsetAllocator::Allocator>(opaqueVertexAlloc, OPAQUE_NUM_INDICES);
-      {
-        BufferLoadDesc loadDesc = {};
-        loadDesc.ppBuffer = &opaqueIndexBuffer;
-        loadDesc.mDesc.mDescriptors =
-            DESCRIPTOR_TYPE_INDEX_BUFFER | DESCRIPTOR_TYPE_BUFFER_RAW;
-        loadDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_TO_GPU;
-        loadDesc.mDesc.mStructStride = OPAQUE_INDEX_ELEMENT_SIZE;
-        loadDesc.mDesc.mElementCount = OPAQUE_NUM_INDICES;
-        loadDesc.mDesc.mSize = OPAQUE_NUM_INDICES * OPAQUE_INDEX_ELEMENT_SIZE;
-        loadDesc.mDesc.pName = "Opaque Index Buffer";
-        addResource(&loadDesc, nullptr);
-      }
-      {
-        BufferLoadDesc loadDesc = {};
-        loadDesc.ppBuffer = &opaquePositionBuffer;
-        loadDesc.mDesc.mDescriptors =
-            DESCRIPTOR_TYPE_VERTEX_BUFFER | DESCRIPTOR_TYPE_BUFFER_RAW;
-        loadDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_TO_GPU;
-        loadDesc.mDesc.mStructStride = OPAQUE_POSITION_ELEMENT_SIZE;
-        loadDesc.mDesc.mElementCount = OPAQUE_NUM_VERTS;
-        loadDesc.mDesc.mSize = OPAQUE_NUM_VERTS * OPAQUE_POSITION_ELEMENT_SIZE;
-        loadDesc.mDesc.pName = "Opaque Position Buffer";
-        addResource(&loadDesc, NULL);
-      }
-    }
-
-    tinygltf::TinyGLTF loader;
-    tinygltf::Model model;
-    std::string err;
-    std::string warn;
-    if (!loader.LoadASCIIFromFile(&model, &err, &warn,
-                                  (char *)mSceneGLTF.data)) {
-      printf("failed to load GLTF: %s", (char *)mSceneGLTF.data);
-      if (!warn.empty()) {
-        printf("Warn: %s\n", warn.c_str());
-      }
-
-      if (!err.empty()) {
-        printf("Err: %s\n", err.c_str());
-      }
-      return false;
-    }
-    const size_t max_vertices = 64;
-    const size_t max_triangles = 124;
-    const float cone_weight = 0.0f;
-
-    uint32_t* meshletVerts = NULL;
-    uint8_t* meshletTries = NULL;
-    meshopt_Meshlet* mesoptsMeshlets = NULL;
-
-    for (auto& meshes : model.meshes) {
-        for (auto& prim : meshes.primitives) {
-            tinygltf::Accessor indexAccess = model.accessors[prim.indices];
-            auto& indexBufferView = model.bufferViews[indexAccess.bufferView];
-            auto& indexBuffer = model.buffers[indexBufferView.buffer];
-
-            ASSERT(indexAccess.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT);
-            const size_t numberIndecies = indexBufferView.byteLength / indexBufferView.byteStride;
-
-            tinygltf::Accessor* positionAccessor = NULL;
-
-            for (auto& attrib : prim.attributes) {
-                tinygltf::Accessor accessor = model.accessors[attrib.second];
-                auto& bufferView = model.bufferViews[accessor.bufferView];
-                auto& buffer = model.buffers[bufferView.buffer];
-                if (attrib.first.compare("POSITION") == 0) {
-                    ASSERT(accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT);
-                    ASSERT(accessor.type == TINYGLTF_TYPE_VEC3);
-                    positionAccessor = &accessor;
-                }
-            }
-
-            auto& positionBufferView = model.bufferViews[positionAccessor->bufferView];
-            auto& positionBuffer = model.buffers[positionBufferView.buffer];
-
-            const size_t numberElements = positionBufferView.byteLength / positionBufferView.byteStride;
-
-            const size_t max_meshlets = meshopt_buildMeshletsBound(numberIndecies, 64, 124);
-            arrsetlen(mesoptsMeshlets, max_meshlets);
-            arrsetlen(meshletVerts, max_meshlets * max_vertices);
-            arrsetlen(meshletTries, max_meshlets * max_triangles * 3);
-            size_t meshlet_count = meshopt_buildMeshlets(
-                mesoptsMeshlets,
-                meshletVerts,
-                meshletTries,
-                (uint32_t*)indexBuffer.data.data(),
-                numberIndecies,
-                (float*)positionBuffer.data.data(),
-                numberElements,
-                positionBufferView.byteStride,
-                max_vertices,
-                max_triangles,
-                cone_weight);
-            for (size_t i = 0; i < meshlet_count; i++) {
-                MeshletSlot meshlet = { 0 };
-
-                OffsetAllocator::Allocation vertexAlloc = opaqueVertexAlloc->allocate(mesoptsMeshlets->vertex_count);
-                OffsetAllocator::Allocation indexAlloc = opaqueIndexAlloc->allocate(mesoptsMeshlets->triangle_count * 3);
-                BufferUpdateDesc positionUpdateDesc = { opaquePositionBuffer,
-                                                        vertexAlloc.offset * OPAQUE_POSITION_ELEMENT_SIZE,
-                                                        mesoptsMeshlets->vertex_count * OPAQUE_POSITION_ELEMENT_SIZE };
-                BufferUpdateDesc indexUpdateDesc = { opaqueIndexBuffer,
-                                                     indexAlloc.offset * OPAQUE_INDEX_ELEMENT_SIZE,
-                                                     (mesoptsMeshlets->triangle_count * 3) * OPAQUE_INDEX_ELEMENT_SIZE };
-
-                beginUpdateResource(&positionUpdateDesc);
-                for (size_t j = 0; j < mesoptsMeshlets[i].vertex_count; j++) {
-                    memcpy(
-                        ((uint8_t*)positionUpdateDesc.pMappedData) + (j * OPAQUE_POSITION_ELEMENT_SIZE),
-                        (positionBuffer.data.data() + positionBufferView.byteOffset) +
-                            (meshletVerts[j + mesoptsMeshlets[i].vertex_offset] * positionBufferView.byteStride),
-                        min(positionBufferView.byteStride, OPAQUE_POSITION_ELEMENT_SIZE));
-                }
-                endUpdateResource(&positionUpdateDesc);
-
-                beginUpdateResource(&indexUpdateDesc);
-                for (size_t j = 0; j < mesoptsMeshlets[i].triangle_count; j++) {
-                    *((uint32_t*)(((uint8_t*)indexUpdateDesc.pMappedData) + (((j * 3) + 0) * OPAQUE_INDEX_ELEMENT_SIZE))) =
-                        meshletTries[((j + mesoptsMeshlets[i].triangle_offset) * 3) + 0];
-                    *((uint32_t*)(((uint8_t*)indexUpdateDesc.pMappedData) + (((j * 3) + 1) * OPAQUE_INDEX_ELEMENT_SIZE))) =
-                        meshletTries[((j + mesoptsMeshlets[i].triangle_offset) * 3) + 1];
-                    *((uint32_t*)(((uint8_t*)indexUpdateDesc.pMappedData) + (((j * 3) + 2) * OPAQUE_INDEX_ELEMENT_SIZE))) =
-                        meshletTries[((j + mesoptsMeshlets[i].triangle_offset) * 3) + 2];
-                }
-                endUpdateResource(&indexUpdateDesc);
-                meshlet.m_indexAlloc = indexAlloc;
-                meshlet.m_vertexAlloc = vertexAlloc;
-                meshlet.m_numVerts = mesoptsMeshlets[i].vertex_count;
-                meshlet.m_numIndecies = mesoptsMeshlets[i].triangle_count * 3;
-                arrpush(meshletSlots, meshlet);
-            }
-        }
-    }
-
-    arrfree(meshletVerts);
-    arrfree(meshletTries);
-    arrfree(mesoptsMeshlets);
+    // Geometry and meshlet tables below are loaded through the resource loader.
+    initResourceLoaderInterface(pRenderer);
 
     if (pRenderer->pGpu->mSettings.mPipelineStatsQueries) {
         QueryPoolDesc poolDesc = {};
@@ -357,7 +343,250 @@ public:
 
     addSemaphore(pRenderer, &pImageAcquiredSemaphore);
 
-    initResourceLoaderInterface(pRenderer);
+    {
+      MeshletBuilder::BuildSettings buildSettings;
+      buildSettings.optimize = mOptimizeMeshlets;
+      buildSettings.lodHierarchy = mLodHierarchy;
+      char cachePath[FS_MAX_PATH] = {};
+      snprintf(cachePath, sizeof(cachePath), "%s.meshlets", (char *)mSceneGLTF.data);
+      const uint64_t sourceHash = GLTFStream::hashSource((char *)mSceneGLTF.data);
+
+      // data points either into the mapped cache or into buildResult.
+      MeshletBuilder::MeshletData data = {};
+      MeshletCache::MappedCache cache;
+      MeshletBuilder::BuildResult buildResult;
+      const bool cacheHit =
+          mUseMeshletCache && sourceHash != 0 && MeshletCache::openCache(cachePath, sourceHash, buildSettings, cache);
+      if (cacheHit) {
+        LOGF(LogLevel::eINFO, "Loading baked meshlets from %s", cachePath);
+        data = cache.data;
+      } else {
+        const char* scenePath = (char *)mSceneGLTF.data;
+        if (mStreamGLTF || GLTFStream::isBinary(scenePath)) {
+          // Buffers stay mapped, only the primitives being built are resident
+          GLTFStream::Model model;
+          if (!GLTFStream::open(scenePath, model)) {
+            return false;
+          }
+          // With the cache on, primitives are written into it as they are built and the scene is
+          // uploaded from the mapping, so the baked scene is never resident as a whole either.
+          bool cached = false;
+          if (mUseMeshletCache && sourceHash != 0) {
+            MeshletCache::CacheWriter writer;
+            const bool built = MeshletCache::beginCache(cachePath, sourceHash, buildSettings, writer) &&
+                               MeshletBuilder::build(model, buildSettings,
+                                                     [](void* pUserData, const MeshletBuilder::MeshletData& primitive) {
+                                                       MeshletCache::appendCache(*(MeshletCache::CacheWriter*)pUserData, primitive);
+                                                     },
+                                                     &writer);
+            writer.failed = writer.failed || !built;
+            cached = MeshletCache::endCache(cachePath, writer) && MeshletCache::openCache(cachePath, sourceHash, buildSettings, cache);
+            if (!cached) {
+              LOGF(LogLevel::eWARNING, "Failed to write meshlet cache %s, building in memory", cachePath);
+            }
+          }
+          if (cached) {
+            data = cache.data;
+          } else {
+            MeshletBuilder::build(model, buildSettings, buildResult);
+            data = buildResult.view();
+          }
+          GLTFStream::close(model);
+        } else {
+          tinygltf::Model model;
+          if (!MeshletBuilder::loadGLTF(scenePath, model)) {
+            return false;
+          }
+          MeshletBuilder::build(model, buildSettings, buildResult);
+          data = buildResult.view();
+          if (mUseMeshletCache && sourceHash != 0 && !MeshletCache::writeCache(cachePath, sourceHash, buildSettings, data)) {
+            LOGF(LogLevel::eWARNING, "Failed to write meshlet cache %s", cachePath);
+          }
+        }
+      }
+
+      // Vertex pulling draws address the meshlet through the vertex id (see MeshletDrawArgs.h),
+      // which runs out of bits on very large scenes; those are drawn from regular index buffers.
+      const bool vertexPulling = gMicroIndexFormat != MeshletBuilder::MICRO_INDEX_FORMAT_U32 ||
+                                 gPositionFormat != MeshletBuilder::POSITION_FORMAT_FLOAT3 || gSharedVertices;
+      if (vertexPulling && data.meshletCount > MeshletDrawArgs::MAX_PULLED_MESHLETS) {
+        LOGF(LogLevel::eWARNING, "%zu meshlets are too many for vertex pulling draws, using 32 bit indices and float3 positions",
+             data.meshletCount);
+        gMicroIndexFormat = MeshletBuilder::MICRO_INDEX_FORMAT_U32;
+        gPositionFormat = MeshletBuilder::POSITION_FORMAT_FLOAT3;
+        gSharedVertices = false;
+      }
+      if (gSharedVertices && gPositionFormat != MeshletBuilder::POSITION_FORMAT_FLOAT3) {
+        LOGF(LogLevel::eWARNING, "Shared vertices need float3 positions, uploading a vertex copy per meshlet");
+        gSharedVertices = false;
+      }
+      MeshletBuilder::SharedVertexLayout sharedVertices;
+      if (gSharedVertices) {
+        MeshletBuilder::buildSharedVertexLayout(data, sharedVertices);
+        LOGF(LogLevel::eINFO,
+             "Shared vertices: %zu vertices + %zu table entries, %.2f MB instead of %zu vertices, %.2f MB",
+             sharedVertices.vertexCount(),
+             sharedVertices.meshletVertices.size(),
+             sharedVertices.byteSize() / (1024.0 * 1024.0),
+             data.vertexCount,
+             data.vertexCount * MeshletBuilder::positionElementSize(gPositionFormat) / (1024.0 * 1024.0));
+      }
+      const size_t positionCount = gSharedVertices ? sharedVertices.vertexCount() : data.vertexCount;
+
+      // Pools start at the size of the scene and grow if more geometry is added later. Every
+      // meshlet takes one allocator node, plus at most one free node between allocations.
+      const uint32_t indexElementsPerTriangle = MeshletBuilder::microIndexElementsPerTriangle(gMicroIndexFormat);
+      const uint32_t maxAllocations = (uint32_t)data.meshletCount * 2 + 2 > 128 * 1024 ? (uint32_t)data.meshletCount * 2 + 2 : 128 * 1024;
+      char indexTracePath[FS_MAX_PATH] = {};
+      char positionTracePath[FS_MAX_PATH] = {};
+      char vertexTableTracePath[FS_MAX_PATH] = {};
+      if (gAllocationTracePrefix) {
+        snprintf(indexTracePath, sizeof(indexTracePath), "%s.indices.oatrace", gAllocationTracePrefix);
+        snprintf(positionTracePath, sizeof(positionTracePath), "%s.positions.oatrace", gAllocationTracePrefix);
+        snprintf(vertexTableTracePath, sizeof(vertexTableTracePath), "%s.vertex_table.oatrace", gAllocationTracePrefix);
+      }
+      {
+        // Compact micro-index formats are read as a raw buffer by the vertex shader, only
+        // the U32 format can also be bound as an index buffer.
+        const uint64_t indexCount = (uint64_t)data.triangleCount * indexElementsPerTriangle;
+        GeometryPoolDesc poolDesc = {};
+        poolDesc.pQueue = pGraphicsQueue;
+        poolDesc.pName = "Opaque Index Buffer";
+        poolDesc.mDescriptors = gMicroIndexFormat == MeshletBuilder::MICRO_INDEX_FORMAT_U32
+                                    ? (DESCRIPTOR_TYPE_INDEX_BUFFER | DESCRIPTOR_TYPE_BUFFER_RAW)
+                                    : DESCRIPTOR_TYPE_BUFFER_RAW;
+        poolDesc.mElementSize = MeshletBuilder::microIndexElementSize(gMicroIndexFormat);
+        poolDesc.mInitialCapacity = indexCount > GEOMETRY_POOL_MIN_CAPACITY ? (uint32_t)indexCount : GEOMETRY_POOL_MIN_CAPACITY;
+        poolDesc.mMaxAllocations = maxAllocations;
+        poolDesc.mAllocationPolicy = gPoolAllocationPolicy;
+        poolDesc.pTracePath = gAllocationTracePrefix ? indexTracePath : NULL;
+        addGeometryPool(pRenderer, &poolDesc, &pOpaqueIndexPool);
+      }
+      {
+        GeometryPoolDesc poolDesc = {};
+        poolDesc.pQueue = pGraphicsQueue;
+        poolDesc.pName = "Opaque Position Buffer";
+        poolDesc.mDescriptors = DESCRIPTOR_TYPE_VERTEX_BUFFER | DESCRIPTOR_TYPE_BUFFER_RAW;
+        poolDesc.mElementSize = MeshletBuilder::positionElementSize(gPositionFormat);
+        poolDesc.mInitialCapacity = positionCount > GEOMETRY_POOL_MIN_CAPACITY ? (uint32_t)positionCount : GEOMETRY_POOL_MIN_CAPACITY;
+        poolDesc.mMaxAllocations = maxAllocations;
+        poolDesc.mAllocationPolicy = gPoolAllocationPolicy;
+        poolDesc.pTracePath = gAllocationTracePrefix ? positionTracePath : NULL;
+        addGeometryPool(pRenderer, &poolDesc, &pOpaquePositionPool);
+      }
+      if (gSharedVertices) {
+        // One uint32 per meshlet vertex, so sized like the duplicated position pool
+        GeometryPoolDesc poolDesc = {};
+        poolDesc.pQueue = pGraphicsQueue;
+        poolDesc.pName = "Meshlet Vertex Table";
+        poolDesc.mDescriptors = DESCRIPTOR_TYPE_BUFFER_RAW;
+        poolDesc.mElementSize = sizeof(uint32_t);
+        poolDesc.mInitialCapacity =
+            data.vertexCount > GEOMETRY_POOL_MIN_CAPACITY ? (uint32_t)data.vertexCount : GEOMETRY_POOL_MIN_CAPACITY;
+        poolDesc.mMaxAllocations = maxAllocations;
+        poolDesc.mAllocationPolicy = gPoolAllocationPolicy;
+        poolDesc.pTracePath = gAllocationTracePrefix ? vertexTableTracePath : NULL;
+        addGeometryPool(pRenderer, &poolDesc, &pMeshletVertexTablePool);
+      }
+
+      MeshletUploadDesc uploadDesc = {};
+      uploadDesc.pPositionPool = pOpaquePositionPool;
+      uploadDesc.pIndexPool = pOpaqueIndexPool;
+      uploadDesc.mMicroIndexFormat = gMicroIndexFormat;
+      uploadDesc.mPositionFormat = gPositionFormat;
+      uploadDesc.pSharedVertices = gSharedVertices ? &sharedVertices : NULL;
+      uploadDesc.pVertexTablePool = pMeshletVertexTablePool;
+
+      MeshletUploadStats uploadStats = {};
+      const bool uploaded = uploadMeshlets(&uploadDesc, data, &meshletSlots, &uploadStats);
+      if (uploaded) {
+        MeshletBuilder::buildBoundsTable(data, gMeshletBounds);
+        logQuantizationError(data);
+      }
+      // Uploads are copied into staging memory on begin/endUpdateResource, the mapping can go.
+      MeshletCache::closeCache(cache);
+      if (!uploaded) {
+        return false;
+      }
+
+      // Per-meshlet table read by the vertex shader and by culling, indexed like meshletSlots.
+      const uint32_t meshletCapacity = gMeshletBounds.count > 0 ? (uint32_t)gMeshletBounds.count : 1;
+      {
+        BufferLoadDesc loadDesc = {};
+        loadDesc.ppBuffer = &pMeshletBuffer;
+        loadDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_BUFFER;
+        loadDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_TO_GPU;
+        loadDesc.mDesc.mStructStride = sizeof(MeshletBlock);
+        loadDesc.mDesc.mElementCount = meshletCapacity;
+        loadDesc.mDesc.mSize = (uint64_t)meshletCapacity * sizeof(MeshletBlock);
+        loadDesc.mDesc.pName = "Meshlet Buffer";
+        addResource(&loadDesc, NULL);
+      }
+      {
+        BufferLoadDesc loadDesc = {};
+        loadDesc.ppBuffer = &pMeshletBoundsBuffer;
+        loadDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_BUFFER;
+        loadDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_TO_GPU;
+        loadDesc.mDesc.mStructStride = sizeof(float4);
+        loadDesc.mDesc.mElementCount = (uint64_t)meshletCapacity * MESHLET_BOUNDS_STREAM_COUNT;
+        loadDesc.mDesc.mSize = loadDesc.mDesc.mElementCount * sizeof(float4);
+        loadDesc.mDesc.pName = "Meshlet Bounds Buffer";
+        addResource(&loadDesc, NULL);
+      }
+      MeshletTableDesc tableDesc = {};
+      tableDesc.pMeshletBuffer = pMeshletBuffer;
+      tableDesc.pBoundsBuffer = pMeshletBoundsBuffer;
+      tableDesc.mStreamCapacity = meshletCapacity;
+      tableDesc.mPositionFormat = gPositionFormat;
+      uploadMeshletTable(&tableDesc, gMeshletBounds, meshletSlots);
+      pVisibleMeshlets = (uint32_t*)tf_malloc(meshletCapacity * sizeof(uint32_t));
+      pCullWorkers = MeshletCulling::createCullWorkers(0);
+
+      gIndexedMeshletDraw = gMicroIndexFormat == MeshletBuilder::MICRO_INDEX_FORMAT_U32 &&
+                            gPositionFormat == MeshletBuilder::POSITION_FORMAT_FLOAT3 && !gSharedVertices;
+      ASSERT(buildSettings.maxTriangles * 3 <= MeshletDrawArgs::MAX_MESHLET_CORNERS);
+      ASSERT(gIndexedMeshletDraw || gMeshletBounds.count <= MeshletDrawArgs::MAX_PULLED_MESHLETS);
+      pMeshletDrawRanges = (MeshletDrawArgs::MeshletDrawRange*)tf_malloc(meshletCapacity * sizeof(MeshletDrawArgs::MeshletDrawRange));
+      getMeshletDrawRanges(meshletSlots, gMeshletBounds.count, pMeshletDrawRanges);
+
+      // Written by the culling workers every frame, worst case one command per meshlet.
+      const uint64_t argsSize = gIndexedMeshletDraw ? sizeof(MeshletDrawArgs::DrawIndexedArgs) : sizeof(MeshletDrawArgs::DrawArgs);
+      TransientBufferDesc frameDataDesc = {};
+      frameDataDesc.pName = "Frame Data Buffer";
+      frameDataDesc.mDescriptors = DESCRIPTOR_TYPE_INDIRECT_BUFFER;
+      frameDataDesc.mSize = (uint32_t)(gDataBufferCount * round_up_64(meshletCapacity * argsSize, gFrameDataAlignment));
+      frameDataDesc.mFrameCount = gDataBufferCount;
+      addTransientBuffer(pRenderer, &frameDataDesc, &pFrameDataBuffer);
+      BufferLoadDesc sceneDesc = {};
+      sceneDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+      sceneDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_TO_GPU;
+      sceneDesc.mDesc.mFlags = BUFFER_CREATION_FLAG_PERSISTENT_MAP_BIT;
+      sceneDesc.mDesc.mSize = sizeof(SceneBlock);
+      sceneDesc.mDesc.pName = "Scene Uniform Buffer";
+      for (uint32_t i = 0; i < gDataBufferCount; ++i) {
+        sceneDesc.ppBuffer = &pSceneUniformBuffer[i];
+        addResource(&sceneDesc, NULL);
+      }
+      LOGF(LogLevel::eINFO,
+           "Uploaded %u meshlets: %.2f MB in %u updates, %.2f ms (%.2f MB/s)",
+           uploadStats.mMeshletCount,
+           uploadStats.mBytesUploaded / (1024.0 * 1024.0),
+           uploadStats.mUpdateCount,
+           uploadStats.mSeconds * 1000.0,
+           uploadStats.mSeconds > 0.0 ? uploadStats.mBytesUploaded / (1024.0 * 1024.0) / uploadStats.mSeconds : 0.0);
+      LOGF(LogLevel::eINFO,
+           "Geometry pools: %u positions (%.2f MB), %u index elements (%.2f MB)",
+           pOpaquePositionPool->mCapacity,
+           (double)pOpaquePositionPool->mCapacity * pOpaquePositionPool->mElementSize / (1024.0 * 1024.0),
+           pOpaqueIndexPool->mCapacity,
+           (double)pOpaqueIndexPool->mCapacity * pOpaqueIndexPool->mElementSize / (1024.0 * 1024.0));
+      if (pMeshletVertexTablePool) {
+        LOGF(LogLevel::eINFO,
+             "Meshlet vertex table: %u entries (%.2f MB)",
+             pMeshletVertexTablePool->mCapacity,
+             (double)pMeshletVertexTablePool->mCapacity * pMeshletVertexTablePool->mElementSize / (1024.0 * 1024.0));
+      }
+    }
 
     // Loads Skybox Textures
     //for (int i = 0; i < 6; ++i) {
@@ -443,6 +672,35 @@ public:
     //UIWidget* pVLw = uiCreateComponentWidget(pGuiWindow, "Vertex Layout", &vertexLayoutWidget, WIDGET_TYPE_SLIDER_UINT);
     //uiSetWidgetOnEditedCallback(pVLw, nullptr, reloadRequest);
 
+    CheckboxWidget backfaceCullingWidget;
+    backfaceCullingWidget.pData = &gBackfaceCulling;
+    uiCreateComponentWidget(pGuiWindow, "Backface Cone Culling", &backfaceCullingWidget, WIDGET_TYPE_CHECKBOX);
+
+    if (mLodHierarchy) {
+        SliderFloatWidget lodPixelErrorWidget;
+        lodPixelErrorWidget.pData = &gLodPixelError;
+        lodPixelErrorWidget.mMin = 0.25f;
+        lodPixelErrorWidget.mMax = 16.0f;
+        lodPixelErrorWidget.mStep = 0.25f;
+        uiCreateComponentWidget(pGuiWindow, "LOD Pixel Error", &lodPixelErrorWidget, WIDGET_TYPE_SLIDER_FLOAT);
+    }
+
+    {
+        static float4 color = { 1.0f, 1.0f, 1.0f, 1.0f };
+        DynamicTextWidget cullStatsWidget;
+        cullStatsWidget.pText = &gCullStats;
+        cullStatsWidget.pColor = &color;
+        uiCreateComponentWidget(pGuiWindow, "Culling", &cullStatsWidget, WIDGET_TYPE_DYNAMIC_TEXT);
+    }
+
+    {
+        static float4 color = { 1.0f, 1.0f, 1.0f, 1.0f };
+        DynamicTextWidget poolStatsWidget;
+        poolStatsWidget.pText = &gPoolStats;
+        poolStatsWidget.pColor = &color;
+        uiCreateComponentWidget(pGuiWindow, "Geometry Pools", &poolStatsWidget, WIDGET_TYPE_DYNAMIC_TEXT);
+    }
+
     if (pRenderer->pGpu->mSettings.mPipelineStatsQueries) {
         static float4 color = { 1.0f, 1.0f, 1.0f, 1.0f };
         DynamicTextWidget statsWidget;
@@ -472,6 +730,8 @@ public:
     InputActionDesc actionDesc = { DefaultInputActions::DUMP_PROFILE_DATA,
                                    [](InputActionContext* ctx) {
                                        dumpProfileData(((Renderer*)ctx->pUserData)->pName);
+                                       const GeometryPool* pools[3] = {};
+                                       dumpGeometryPoolStats(pools, getGeometryPools(pools), "GeometryPools");
                                        return true;
                                    },
                                    pRenderer };
@@ -581,6 +841,21 @@ public:
 
       removeSampler(pRenderer, pSampler0);
 
+      removeGeometryPool(pOpaqueIndexPool);
+      removeGeometryPool(pOpaquePositionPool);
+      removeGeometryPool(pMeshletVertexTablePool);
+      pMeshletVertexTablePool = NULL;
+      arrfree(meshletSlots);
+      removeResource(pMeshletBuffer);
+      removeResource(pMeshletBoundsBuffer);
+      tf_free(pVisibleMeshlets);
+      tf_free(pMeshletDrawRanges);
+      MeshletCulling::destroyCullWorkers(pCullWorkers);
+      removeTransientBuffer(pFrameDataBuffer);
+      for (uint32_t i = 0; i < gDataBufferCount; ++i) {
+          removeResource(pSceneUniformBuffer[i]);
+      }
+
       removeGpuCmdRing(pRenderer, &gGraphicsCmdRing);
       removeSemaphore(pRenderer, pImageAcquiredSemaphore);
 
@@ -637,8 +912,7 @@ public:
       unloadUserInterface(pReloadDesc->mType);
 
       if (pReloadDesc->mType & (RELOAD_TYPE_SHADER | RELOAD_TYPE_RENDERTARGET)) {
-          //removeResource(pSphereVertexBuffer);
-          //removeResource(pSphereIndexBuffer);
+          removePipelines();
       }
 
       if (pReloadDesc->mType & (RELOAD_TYPE_RESIZE | RELOAD_TYPE_RENDERTARGET)) {
@@ -670,8 +944,25 @@ public:
 
       const float aspectInverse = (float)mSettings.mHeight / (float)mSettings.mWidth;
       const float horizontal_fov = PI / 2.0f;
-      CameraMatrix projMat = CameraMatrix::perspectiveReverseZ(horizontal_fov, aspectInverse, 0.1f, 1000.0f);
-      //gUniformData.mProjectView = projMat * viewMat;
+      const float zNear = 0.1f;
+      CameraMatrix projMat = CameraMatrix::perspectiveReverseZ(horizontal_fov, aspectInverse, zNear, 1000.0f);
+      gSceneData.mViewProj = projMat * viewMat;
+
+      {
+          const mat4 viewProj = gSceneData.mViewProj.getPrimaryMatrix();
+          const vec3 cameraPosition = pCameraController->getViewPosition();
+          float viewProjColumns[16];
+          for (int c = 0; c < 4; c++) {
+              for (int r = 0; r < 4; r++) {
+                  viewProjColumns[c * 4 + r] = viewProj[c][r];
+              }
+          }
+          const float camera[3] = { cameraPosition.getX(), cameraPosition.getY(), cameraPosition.getZ() };
+          MeshletCulling::makeCullParams(viewProjColumns, camera, gBackfaceCulling, gCullParams);
+          // Pixels covered by one unit at distance 1, along the axis the field of view is given for
+          const float projectionScale = (float)mSettings.mWidth * 0.5f / tanf(horizontal_fov * 0.5f);
+          MeshletCulling::setLodSelection(projectionScale, gLodPixelError, zNear, gCullParams);
+      }
 
       // point light parameters
       //gUniformData.mLightPosition = vec3(0, 0, 0);
@@ -728,13 +1019,23 @@ public:
       RenderTarget* pRenderTarget = pSwapChain->ppRenderTargets[swapchainImageIndex];
       GpuCmdRingElement elem = getNextGpuCmdRingElement(&gGraphicsCmdRing, true, 1);
 
-      // Stall if CPU is running "gDataBufferCount" frames ahead of GPU
-      FenceStatus fenceStatus;
-      getFenceStatus(pRenderer, elem.pFence, &fenceStatus);
-      if (fenceStatus == FENCE_STATUS_INCOMPLETE)
-          waitForFences(pRenderer, 1, &elem.pFence);
+      // Stall if CPU is running "gDataBufferCount" frames ahead of GPU, then reclaim that frame's transient data
+      beginTransientFrame(pFrameDataBuffer, elem.pFence, gFrameIndex);
 
       // Update uniform buffers
+      BufferUpdateDesc sceneCbv = { pSceneUniformBuffer[gFrameIndex] };
+      beginUpdateResource(&sceneCbv);
+      memcpy(sceneCbv.pMappedData, &gSceneData, sizeof(gSceneData));
+      endUpdateResource(&sceneCbv);
+
+      cullMeshlets();
+      updateGeometryPoolStats();
+      markGeometryPoolFrame(pOpaqueIndexPool);
+      markGeometryPoolFrame(pOpaquePositionPool);
+      if (pMeshletVertexTablePool) {
+        markGeometryPoolFrame(pMeshletVertexTablePool);
+      }
+
       //BufferUpdateDesc viewProjCbv = { pProjViewUniformBuffer[gFrameIndex] };
       //beginUpdateResource(&viewProjCbv);
       //memcpy(viewProjCbv.pMappedData, &gUniformData, sizeof(gUniformData));
@@ -796,7 +1097,7 @@ public:
       };
       cmdResourceBarrier(cmd, 0, NULL, 0, NULL, 1, barriers);
 
-      cmdBeginGpuTimestampQuery(cmd, gGpuProfileToken, "Draw Skybox/Planets");
+      cmdBeginGpuTimestampQuery(cmd, gGpuProfileToken, "Draw Meshlets");
 
       // simply record the screen cleaning command
       BindRenderTargetsDesc bindRenderTargets = {};
@@ -807,6 +1108,22 @@ public:
       cmdSetViewport(cmd, 0.0f, 0.0f, (float)pRenderTarget->mWidth, (float)pRenderTarget->mHeight, 0.0f, 1.0f);
       cmdSetScissor(cmd, 0, 0, pRenderTarget->mWidth, pRenderTarget->mHeight);
 
+      // One indirect command per visible meshlet, CPU cost is independent of the meshlet count.
+      if (gVisibleMeshletCount > 0) {
+          cmdBindPipeline(cmd, pOpaquePipeline);
+          cmdBindDescriptorSet(cmd, gFrameIndex, pDescriptorSetScene);
+          if (gIndexedMeshletDraw) {
+              const uint32_t positionStride = sizeof(float) * 3;
+              cmdBindVertexBuffer(cmd, 1, &pOpaquePositionPool->pBuffer, &positionStride, NULL);
+              cmdBindIndexBuffer(cmd, pOpaqueIndexPool->pBuffer, INDEX_TYPE_UINT32, 0);
+          } else {
+              cmdBindDescriptorSet(cmd, 0, pDescriptorSetMeshlets);
+          }
+          cmdExecuteIndirect(
+              cmd, pMeshletCommandSignature, gVisibleMeshletCount, pFrameDataBuffer->pBuffer, gIndirectArgsOffset, NULL, 0);
+      }
+      cmdEndGpuTimestampQuery(cmd, gGpuProfileToken); // Draw Meshlets
+
      // cmdBeginGpuTimestampQuery(cmd, gGpuProfileToken, "Draw Planets");
 
      // cmdBindPipeline(cmd, pSpherePipeline);
@@ -927,25 +1244,97 @@ public:
       return pDepthBuffer != NULL;
   }
 
+  // Culls on the worker pool and writes one indirect command per visible meshlet into this frame's range of pFrameDataBuffer.
+  void cullMeshlets() {
+      HiresTimer cullTimer;
+      initHiresTimer(&cullTimer);
+      // Room for every meshlet, the workers only know their output offsets once culling is done
+      const uint32_t argsSize = gIndexedMeshletDraw ? sizeof(MeshletDrawArgs::DrawIndexedArgs) : sizeof(MeshletDrawArgs::DrawArgs);
+      const uint32_t meshletCapacity = gMeshletBounds.count > 0 ? (uint32_t)gMeshletBounds.count : 1;
+      void* pArgs = NULL;
+      const OffsetAllocator::Allocation argsAlloc =
+          allocateFromTransientBuffer(pFrameDataBuffer, meshletCapacity * argsSize, gFrameDataAlignment, &pArgs);
+      if (argsAlloc.offset == OffsetAllocator::Allocation::NO_SPACE) {
+          gVisibleMeshletCount = 0;
+          return;
+      }
+      gIndirectArgsOffset = argsAlloc.offset;
+      MeshletDrawArgs::EmitTarget emitTarget = { pMeshletDrawRanges, pArgs };
+      const MeshletCulling::CullPath cullPath = MeshletCulling::bestCullPath();
+      gVisibleMeshletCount = (uint32_t)MeshletCulling::cullMeshletsParallel(
+          pCullWorkers,
+          cullPath,
+          gCullParams,
+          gMeshletBounds,
+          gIndexedMeshletDraw ? MeshletDrawArgs::emitDrawIndexedArgs : MeshletDrawArgs::emitDrawArgs,
+          &emitTarget);
+      const float cullMs = (float)getHiresTimerUSec(&cullTimer, false) / 1000.0f;
+      bformat(&gCullStats,
+              "%u / %u meshlets visible, %.3f ms (%s, %u threads)",
+              gVisibleMeshletCount,
+              (uint32_t)gMeshletBounds.count,
+              cullMs,
+              MeshletCulling::cullPathName(cullPath),
+              MeshletCulling::cullWorkerCount(pCullWorkers));
+  }
+
   void addDescriptorSets() {
+      DescriptorSetDesc setDesc = { pRootSignature, DESCRIPTOR_UPDATE_FREQ_PER_FRAME, gDataBufferCount };
+      addDescriptorSet(pRenderer, &setDesc, &pDescriptorSetScene);
+      for (uint32_t i = 0; i < gDataBufferCount; ++i) {
+          DescriptorData params[1] = {};
+          params[0].pName = "sceneBlock";
+          params[0].ppBuffers = &pSceneUniformBuffer[i];
+          updateDescriptorSet(pRenderer, i, pDescriptorSetScene, 1, params);
+      }
+
+      if (!gIndexedMeshletDraw) {
+          setDesc = { pRootSignature, DESCRIPTOR_UPDATE_FREQ_NONE, 1 };
+          addDescriptorSet(pRenderer, &setDesc, &pDescriptorSetMeshlets);
+          DescriptorData params[4] = {};
+          params[0].pName = "uniformMeshletBuffer";
+          params[0].ppBuffers = &pMeshletBuffer;
+          params[1].pName = "opaqueIndexBuffer";
+          params[1].ppBuffers = &pOpaqueIndexPool->pBuffer;
+          params[2].pName = "opaquePositionBuffer";
+          params[2].ppBuffers = &pOpaquePositionPool->pBuffer;
+          params[3].pName = "meshletVertexBuffer";
+          params[3].ppBuffers = gSharedVertices ? &pMeshletVertexTablePool->pBuffer : NULL;
+          updateDescriptorSet(pRenderer, 0, pDescriptorSetMeshlets, gSharedVertices ? 4 : 3, params);
+      }
   }
 
   void removeDescriptorSets() {
+      removeDescriptorSet(pRenderer, pDescriptorSetScene);
+      if (pDescriptorSetMeshlets) {
+          removeDescriptorSet(pRenderer, pDescriptorSetMeshlets);
+          pDescriptorSetMeshlets = NULL;
+      }
   }
 
   void addRootSignatures() {
       Shader* shaders[2];
       uint32_t shadersCount = 0;
-      //shaders[shadersCount++] = pSphereShader;
+      shaders[shadersCount++] = pOpaqueShader;
       //shaders[shadersCount++] = pSkyBoxDrawShader;
 
       RootSignatureDesc rootDesc = {};
       rootDesc.mShaderCount = shadersCount;
       rootDesc.ppShaders = shaders;
       addRootSignature(pRenderer, &rootDesc, &pRootSignature);
+
+      IndirectArgumentDescriptor indirectArg = {};
+      indirectArg.mType = gIndexedMeshletDraw ? INDIRECT_DRAW_INDEX : INDIRECT_DRAW;
+      CommandSignatureDesc cmdSignatureDesc = {};
+      cmdSignatureDesc.pRootSignature = pRootSignature;
+      cmdSignatureDesc.mIndirectArgCount = 1;
+      cmdSignatureDesc.pArgDescs = &indirectArg;
+      cmdSignatureDesc.mPacked = true;
+      addIndirectCommandSignature(pRenderer, &cmdSignatureDesc, &pMeshletCommandSignature);
   }
 
   void removeRootSignatures() {
+      removeIndirectCommandSignature(pRenderer, pMeshletCommandSignature);
       removeRootSignature(pRenderer, pRootSignature);
   }
 
@@ -954,8 +1343,19 @@ public:
       //skyShader.mStages[0].pFileName = "skybox.vert";
       //skyShader.mStages[1].pFileName = "skybox.frag";
 
+      // Vertex pulling variants are named after their formats, see ShaderList.fsl.
+      static const char* indexFormatNames[] = { "u32", "u8", "packed" };
+      static const char* positionFormatNames[] = { "f32", "snorm16", "unorm11_11_10" };
+      char pullShaderName[64] = {};
+      snprintf(pullShaderName,
+               sizeof(pullShaderName),
+               "basic_pull_%s_%s%s.vert",
+               indexFormatNames[gMicroIndexFormat],
+               positionFormatNames[gPositionFormat],
+               gSharedVertices ? "_shared" : "");
+
       ShaderLoadDesc basicShader = {};
-      basicShader.mStages[0].pFileName = "basic.vert";
+      basicShader.mStages[0].pFileName = gIndexedMeshletDraw ? "basic.vert" : pullShaderName;
       basicShader.mStages[1].pFileName = "basic.frag";
 
       //addShader(pRenderer, &skyShader, &pSkyBoxDrawShader);
@@ -977,6 +1377,37 @@ public:
       depthStateDesc.mDepthTest = true;
       depthStateDesc.mDepthWrite = true;
       depthStateDesc.mDepthFunc = CMP_GEQUAL;
+
+      // Only the indexed path reads positions through the input assembler.
+      VertexLayout vertexLayout = {};
+      vertexLayout.mBindingCount = 1;
+      vertexLayout.mBindings[0].mStride = sizeof(float) * 3;
+      vertexLayout.mAttribCount = 1;
+      vertexLayout.mAttribs[0].mSemantic = SEMANTIC_POSITION;
+      vertexLayout.mAttribs[0].mFormat = TinyImageFormat_R32G32B32_SFLOAT;
+      vertexLayout.mAttribs[0].mBinding = 0;
+      vertexLayout.mAttribs[0].mLocation = 0;
+      vertexLayout.mAttribs[0].mOffset = 0;
+
+      PipelineDesc desc = {};
+      desc.mType = PIPELINE_TYPE_GRAPHICS;
+      GraphicsPipelineDesc& pipelineSettings = desc.mGraphicsDesc;
+      pipelineSettings.mPrimitiveTopo = PRIMITIVE_TOPO_TRI_LIST;
+      pipelineSettings.mRenderTargetCount = 1;
+      pipelineSettings.pDepthState = &depthStateDesc;
+      pipelineSettings.pColorFormats = &pSwapChain->ppRenderTargets[0]->mFormat;
+      pipelineSettings.mSampleCount = pSwapChain->ppRenderTargets[0]->mSampleCount;
+      pipelineSettings.mSampleQuality = pSwapChain->ppRenderTargets[0]->mSampleQuality;
+      pipelineSettings.mDepthStencilFormat = pDepthBuffer->mFormat;
+      pipelineSettings.pRootSignature = pRootSignature;
+      pipelineSettings.pShaderProgram = pOpaqueShader;
+      pipelineSettings.pVertexLayout = gIndexedMeshletDraw ? &vertexLayout : NULL;
+      pipelineSettings.pRasterizerState = &rasterizerStateDesc;
+      addPipeline(pRenderer, &desc, &pOpaquePipeline);
+  }
+
+  void removePipelines() {
+      removePipeline(pRenderer, pOpaquePipeline);
   }
 };
 DEFINE_APPLICATION_MAIN(MeshletViewer)
@@ -0,0 +1,630 @@
+// Headless meshlet baker: builds the meshlet cache the viewer would otherwise
+// produce on first launch, and reports how long each stage of the bake takes.
+//
+//   MeshletBake <scene.gltf|scene.glb> [-o <cache>] [-t <threads>] [--stream] [--optimize] [--lod] [--verify] [--cull-bench]
+//
+// --stream loads through GLTFStream, which maps the buffers instead of reading them into memory;
+// .glb files always take that path. The peak resident set size is reported to compare the two.
+// --optimize bakes with BuildSettings::optimize and compares ACMR and meshlet fill against an
+// unoptimized build of the same scene, which is not included in the timings.
+// --lod bakes the LOD hierarchy (BuildSettings::lodHierarchy) and reports its levels and the cut
+// picked from a few camera distances; --verify then also checks the hierarchy.
+// --verify also bakes a one triangle .gltf + .bin scene next to the cache and checks that editing
+// the .bin invalidates its cache.
+// The GPU vertex memory of the duplicated and shared vertex layouts is always reported, to pick
+// a layout per asset (see MeshletBuilder::SharedVertexLayout and the viewer's --shared-vertices).
+// --cull-bench times every CPU culling path and the multi-threaded cull from 1 to <threads> workers.
+
+#include "GLTFStream.h"
+#include "MeshletBuilder.h"
+#include "MeshletCache.h"
+#include "MeshletCulling.h"
+#include "MeshletDrawArgs.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "tiny_gltf.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+static double elapsedMs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static double peakResidentMb() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters = {};
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+    struct rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / (1024.0 * 1024.0); // bytes
+#else
+    return usage.ru_maxrss / 1024.0; // kilobytes
+#endif
+#endif
+}
+
+struct MeshletShape {
+    size_t meshletCount;
+    double verticesPerMeshlet;
+    double trianglesPerMeshlet;
+};
+
+static MeshletShape measureShape(const MeshletBuilder::MeshletData& data) {
+    const double meshletCount = data.meshletCount ? (double)data.meshletCount : 1.0;
+    return { data.meshletCount, data.vertexCount / meshletCount, data.triangleCount / meshletCount };
+}
+
+// Streaming build sinks: totals only, for the shape of a build that isn't kept, or straight into a cache.
+static void countMeshlets(void* pUserData, const MeshletBuilder::MeshletData& primitive) {
+    MeshletBuilder::MeshletData& total = *(MeshletBuilder::MeshletData*)pUserData;
+    total.vertexCount += primitive.vertexCount;
+    total.triangleCount += primitive.triangleCount;
+    total.meshletCount += primitive.meshletCount;
+    total.primitiveCount += primitive.primitiveCount;
+}
+
+static void appendToCache(void* pUserData, const MeshletBuilder::MeshletData& primitive) {
+    MeshletCache::appendCache(*(MeshletCache::CacheWriter*)pUserData, primitive);
+}
+
+static void printOptimizeReport(const MeshletBuilder::OptimizeStats& stats, const MeshletShape& before, const MeshletShape& after) {
+    const double triangleCount = stats.triangleCount ? (double)stats.triangleCount : 1.0;
+    printf("  optimize: %llu -> %llu source vertices after welding, ACMR %.3f -> %.3f\n",
+           (unsigned long long)stats.sourceVertexCount,
+           (unsigned long long)stats.uniqueVertexCount,
+           stats.transformedBefore / triangleCount,
+           stats.transformedAfter / triangleCount);
+    printf("  meshlets %zu -> %zu, vertices per meshlet %.1f -> %.1f, triangles per meshlet %.1f -> %.1f\n",
+           before.meshletCount,
+           after.meshletCount,
+           before.verticesPerMeshlet,
+           after.verticesPerMeshlet,
+           before.trianglesPerMeshlet,
+           after.trianglesPerMeshlet);
+}
+
+// Round-trips every meshlet through each GPU micro-index format with the CPU reference
+// decoder and checks it against the builder output.
+static bool verifyMicroIndices(const MeshletBuilder::MeshletData& data) {
+    static const MeshletBuilder::MicroIndexFormat formats[] = {
+        MeshletBuilder::MICRO_INDEX_FORMAT_U32,
+        MeshletBuilder::MICRO_INDEX_FORMAT_U8,
+        MeshletBuilder::MICRO_INDEX_FORMAT_PACKED,
+    };
+    std::vector<uint8_t> encoded;
+    for (MeshletBuilder::MicroIndexFormat format : formats) {
+        const uint32_t elementSize = MeshletBuilder::microIndexElementSize(format);
+        const uint32_t elementsPerTriangle = MeshletBuilder::microIndexElementsPerTriangle(format);
+        encoded.resize(data.triangleCount * elementsPerTriangle * elementSize);
+        MeshletBuilder::encodeMicroIndices(format, data.triangles, data.triangleCount, encoded.data());
+        for (size_t m = 0; m < data.meshletCount; m++) {
+            const MeshletBuilder::Meshlet& meshlet = data.meshlets[m];
+            const uint8_t* meshletIndices = encoded.data() + (size_t)meshlet.triangleOffset * elementsPerTriangle * elementSize;
+            for (uint32_t i = 0; i < meshlet.triangleCount * 3; i++) {
+                const uint32_t decoded = MeshletBuilder::decodeMicroIndex(format, meshletIndices, i);
+                if (decoded != data.triangles[meshlet.triangleOffset * 3 + i] || decoded >= meshlet.vertexCount) {
+                    printf("micro-index mismatch: format %u, triangle %u, corner %u\n", format, meshlet.triangleOffset + i / 3, i % 3);
+                    return false;
+                }
+            }
+        }
+        printf("  micro-index format %u: %zu bytes\n", format, encoded.size());
+    }
+    return true;
+}
+
+static bool writeFile(const std::string& path, const void* data, size_t size) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    const bool written = fwrite(data, 1, size, file) == size;
+    return fclose(file) == 0 && written;
+}
+
+// The cache key has to cover the external buffers: a .gltf whose JSON is unchanged but whose .bin
+// was re-exported must miss. Bakes a one triangle scene, edits its .bin and expects a miss.
+static bool verifySourceHash(const std::string& cachePath) {
+    const std::string basePath = cachePath + ".hashtest";
+    const std::string gltfPath = basePath + ".gltf";
+    const std::string binPath = basePath + ".bin";
+    const std::string testCachePath = basePath + ".meshlets";
+    const size_t slash = binPath.find_last_of("/\\");
+    const std::string binUri = slash == std::string::npos ? binPath : binPath.substr(slash + 1);
+
+    float positions[9] = { 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f };
+    char json[1024];
+    const int jsonSize = snprintf(json,
+                                  sizeof(json),
+                                  "{\"asset\":{\"version\":\"2.0\"},\"buffers\":[{\"uri\":\"%s\",\"byteLength\":%zu}],"
+                                  "\"bufferViews\":[{\"buffer\":0,\"byteLength\":%zu}],"
+                                  "\"accessors\":[{\"bufferView\":0,\"componentType\":5126,\"count\":3,\"type\":\"VEC3\"}],"
+                                  "\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0}}]}]}",
+                                  binUri.c_str(),
+                                  sizeof(positions),
+                                  sizeof(positions));
+    bool ok = jsonSize > 0 && (size_t)jsonSize < sizeof(json) && writeFile(gltfPath, json, (size_t)jsonSize) &&
+              writeFile(binPath, positions, sizeof(positions));
+
+    MeshletBuilder::BuildSettings settings;
+    settings.threadCount = 1;
+    MeshletBuilder::BuildResult result;
+    GLTFStream::Model model;
+    const uint64_t hash = ok ? GLTFStream::hashSource(gltfPath.c_str()) : 0;
+    ok = hash != 0 && GLTFStream::open(gltfPath.c_str(), model) && MeshletBuilder::build(model, settings, result) &&
+         MeshletCache::writeCache(testCachePath.c_str(), hash, settings, result.view());
+    GLTFStream::close(model);
+
+    MeshletCache::MappedCache cache;
+    const bool hit = ok && MeshletCache::openCache(testCachePath.c_str(), GLTFStream::hashSource(gltfPath.c_str()), settings, cache);
+    MeshletCache::closeCache(cache);
+
+    positions[4] = 2.0f;
+    ok = ok && writeFile(binPath, positions, sizeof(positions));
+    const uint64_t editedHash = ok ? GLTFStream::hashSource(gltfPath.c_str()) : 0;
+    const bool editedHit = ok && MeshletCache::openCache(testCachePath.c_str(), editedHash, settings, cache);
+    MeshletCache::closeCache(cache);
+
+    remove(gltfPath.c_str());
+    remove(binPath.c_str());
+    remove(testCachePath.c_str());
+    if (!ok) {
+        printf("failed to bake the source hash test scene %s\n", gltfPath.c_str());
+        return false;
+    }
+    if (!hit || editedHit || editedHash == 0) {
+        printf("source hash: cache %s before and %s after editing %s\n",
+               hit ? "hit" : "missed",
+               editedHit ? "hit" : "missed",
+               binUri.c_str());
+        return false;
+    }
+    printf("  source hash: editing the .bin of a .gltf invalidates its cache\n");
+    return true;
+}
+
+static void printQuantizationError(const MeshletBuilder::MeshletData& data) {
+    static const MeshletBuilder::PositionFormat formats[] = {
+        MeshletBuilder::POSITION_FORMAT_SNORM16,
+        MeshletBuilder::POSITION_FORMAT_UNORM_11_11_10,
+    };
+    for (MeshletBuilder::PositionFormat format : formats) {
+        std::vector<MeshletBuilder::QuantizationError> errors = MeshletBuilder::measureQuantizationError(format, data);
+        printf("  position format %u: %zu bytes\n", format, data.vertexCount * MeshletBuilder::positionElementSize(format));
+        for (size_t i = 0; i < errors.size(); i++) {
+            printf("    mesh %zu: max error %g, mean error %g\n", i, errors[i].maxError, errors[i].meanError);
+        }
+    }
+}
+
+// Compares GPU vertex memory of the duplicated layout, in every position format, with the
+// shared layout (float3 only), and with --verify checks that the shared layout resolves every
+// meshlet vertex to the same position.
+static bool reportSharedVertices(const MeshletBuilder::MeshletData& data, bool verify) {
+    MeshletBuilder::SharedVertexLayout layout;
+    MeshletBuilder::buildSharedVertexLayout(data, layout);
+    const double toMb = 1.0 / (1024.0 * 1024.0);
+    printf("  duplicated vertices: %zu, %.2f MB float3, %.2f MB snorm16, %.2f MB unorm 11_11_10\n",
+           data.vertexCount,
+           data.vertexCount * MeshletBuilder::positionElementSize(MeshletBuilder::POSITION_FORMAT_FLOAT3) * toMb,
+           data.vertexCount * MeshletBuilder::positionElementSize(MeshletBuilder::POSITION_FORMAT_SNORM16) * toMb,
+           data.vertexCount * MeshletBuilder::positionElementSize(MeshletBuilder::POSITION_FORMAT_UNORM_11_11_10) * toMb);
+    printf("  shared vertices: %zu (%.2fx fewer) + %zu table entries, %.2f MB float3\n",
+           layout.vertexCount(),
+           layout.vertexCount() ? (double)data.vertexCount / layout.vertexCount() : 0.0,
+           layout.meshletVertices.size(),
+           layout.byteSize() * toMb);
+    if (!verify) {
+        return true;
+    }
+    for (size_t p = 0; p < data.primitiveCount; p++) {
+        const MeshletBuilder::Primitive& primitive = data.primitives[p];
+        for (uint32_t m = primitive.meshletOffset; m < primitive.meshletOffset + primitive.meshletCount; m++) {
+            const MeshletBuilder::Meshlet& meshlet = data.meshlets[m];
+            for (uint32_t v = meshlet.vertexOffset; v < meshlet.vertexOffset + meshlet.vertexCount; v++) {
+                const uint32_t shared = layout.meshletVertices[v];
+                const bool valid = shared < layout.primitiveVertexCount[p] &&
+                                   memcmp(&layout.positions[(layout.primitiveVertexOffset[p] + shared) * 3],
+                                          &data.positions[v * 3],
+                                          sizeof(float) * 3) == 0;
+                if (!valid) {
+                    printf("shared vertex mismatch: meshlet %u, vertex %u\n", m, v - meshlet.vertexOffset);
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Frustum that contains everything, so only the LOD test decides.
+static void makeLodCullParams(const float camera[3], MeshletCulling::CullParams& params) {
+    params = {};
+    for (int p = 0; p < 6; p++) {
+        params.planes[p][3] = 1.0f;
+    }
+    memcpy(params.cameraPosition, camera, sizeof(params.cameraPosition));
+    // One pixel of error on a 1080 pixel high viewport with a 90 degree field of view
+    MeshletCulling::setLodSelection(1080.0f * 0.5f, 1.0f, 0.0f, params);
+}
+
+// Meshlets and triangles per level of the LOD hierarchy, and the cut drawn from a camera moving
+// away from the scene. With --verify, checks that errors and spheres grow towards the roots, that
+// every culling path picks the same cut and that a camera far enough away draws exactly the roots.
+static bool reportLodHierarchy(const MeshletBuilder::MeshletData& data, bool verify) {
+    std::vector<size_t> levelMeshlets;
+    std::vector<size_t> levelTriangles;
+    size_t rootCount = 0;
+    for (size_t i = 0; i < data.meshletCount; i++) {
+        const MeshletBuilder::MeshletLod& lod = data.lods[i];
+        if (lod.level >= levelMeshlets.size()) {
+            levelMeshlets.resize(lod.level + 1);
+            levelTriangles.resize(lod.level + 1);
+        }
+        levelMeshlets[lod.level]++;
+        levelTriangles[lod.level] += data.meshlets[i].triangleCount;
+        rootCount += lod.parentError == FLT_MAX;
+
+        const float dx = lod.parentBounds[0] - lod.bounds[0];
+        const float dy = lod.parentBounds[1] - lod.bounds[1];
+        const float dz = lod.parentBounds[2] - lod.bounds[2];
+        // Merged spheres are only enclosing up to rounding
+        const float slack = lod.parentBounds[3] * 1e-4f + 1e-6f;
+        const bool encloses = sqrtf(dx * dx + dy * dy + dz * dz) + lod.bounds[3] <= lod.parentBounds[3] + slack;
+        const bool monotonic = lod.parentError >= lod.error && (lod.parentError == FLT_MAX || encloses);
+        if (verify && !monotonic) {
+            printf("LOD hierarchy error: meshlet %zu is coarser than its parent\n", i);
+            return false;
+        }
+    }
+    for (size_t level = 0; level < levelMeshlets.size(); level++) {
+        printf("  lod level %zu: %zu meshlets, %zu triangles\n", level, levelMeshlets[level], levelTriangles[level]);
+    }
+    printf("  lod roots: %zu meshlets\n", rootCount);
+
+    MeshletBuilder::MeshletBoundsTable table;
+    MeshletBuilder::buildBoundsTable(data, table);
+    float sceneMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float sceneMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (size_t m = 0; m < data.meshletCount; m++) {
+        const MeshletBuilder::Meshlet& meshlet = data.meshlets[m];
+        for (int c = 0; c < 3; c++) {
+            sceneMin[c] = fminf(sceneMin[c], meshlet.aabbMin[c]);
+            sceneMax[c] = fmaxf(sceneMax[c], meshlet.aabbMax[c]);
+        }
+    }
+    const float center[3] = { (sceneMin[0] + sceneMax[0]) * 0.5f, (sceneMin[1] + sceneMax[1]) * 0.5f, (sceneMin[2] + sceneMax[2]) * 0.5f };
+    const float radius = fmaxf(fmaxf(sceneMax[0] - sceneMin[0], sceneMax[1] - sceneMin[1]), sceneMax[2] - sceneMin[2]) * 0.5f;
+
+    // The last distance is far enough for every finite error to pass
+    static const float distances[] = { 0.0f, 1.0f, 4.0f, 16.0f, 64.0f, 256.0f, 1e18f };
+    std::vector<uint32_t> reference(table.count);
+    std::vector<uint32_t> visible(table.count);
+    for (float distance : distances) {
+        const float camera[3] = { center[0], center[1], center[2] + (distance < 1e18f ? distance * radius : distance) };
+        MeshletCulling::CullParams params;
+        makeLodCullParams(camera, params);
+        const size_t visibleCount =
+            MeshletCulling::cullMeshlets(MeshletCulling::CULL_PATH_SCALAR, params, table, 0, table.count, reference.data());
+        size_t triangleCount = 0;
+        for (size_t i = 0; i < visibleCount; i++) {
+            triangleCount += data.meshlets[reference[i]].triangleCount;
+        }
+        if (distance < 1e18f) {
+            printf("  lod cut at %g x scene radius: %zu meshlets, %zu triangles\n", distance, visibleCount, triangleCount);
+        }
+        if (!verify) {
+            continue;
+        }
+        for (uint32_t path = 1; path < MeshletCulling::CULL_PATH_COUNT && path <= MeshletCulling::bestCullPath(); path++) {
+            const MeshletCulling::CullPath cullPath = (MeshletCulling::CullPath)path;
+            const size_t count = MeshletCulling::cullMeshlets(cullPath, params, table, 0, table.count, visible.data());
+            if (count != visibleCount || memcmp(visible.data(), reference.data(), count * sizeof(uint32_t)) != 0) {
+                printf("LOD cut mismatch: %s path differs from scalar\n", MeshletCulling::cullPathName(cullPath));
+                return false;
+            }
+        }
+        if (distance == 1e18f) {
+            bool rootsOnly = visibleCount == rootCount;
+            for (size_t i = 0; rootsOnly && i < visibleCount; i++) {
+                rootsOnly = data.lods[reference[i]].parentError == FLT_MAX;
+            }
+            if (!rootsOnly) {
+                printf("LOD cut from far away isn't the roots: %zu meshlets\n", visibleCount);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Culls the baked meshlets with every CPU path against a frustum covering the middle of the
+// scene, checks each path against the scalar reference and reports throughput.
+static bool benchCulling(const MeshletBuilder::MeshletData& data, uint32_t maxThreads) {
+    MeshletBuilder::MeshletBoundsTable table;
+    MeshletBuilder::buildBoundsTable(data, table);
+    if (table.count == 0) {
+        return true;
+    }
+
+    float sceneMin[3] = { table.aabbMinX[0], table.aabbMinY[0], table.aabbMinZ[0] };
+    float sceneMax[3] = { table.aabbMaxX[0], table.aabbMaxY[0], table.aabbMaxZ[0] };
+    for (size_t i = 1; i < table.count; i++) {
+        sceneMin[0] = fminf(sceneMin[0], table.aabbMinX[i]);
+        sceneMin[1] = fminf(sceneMin[1], table.aabbMinY[i]);
+        sceneMin[2] = fminf(sceneMin[2], table.aabbMinZ[i]);
+        sceneMax[0] = fmaxf(sceneMax[0], table.aabbMaxX[i]);
+        sceneMax[1] = fmaxf(sceneMax[1], table.aabbMaxY[i]);
+        sceneMax[2] = fmaxf(sceneMax[2], table.aabbMaxZ[i]);
+    }
+    // Box "projection" mapping the central half of the scene to clip space, column-major.
+    float viewProj[16] = {};
+    for (int c = 0; c < 3; c++) {
+        const float extent = fmaxf(sceneMax[c] - sceneMin[c], 1e-6f);
+        const float center = (sceneMin[c] + sceneMax[c]) * 0.5f;
+        const float scale = c < 2 ? 4.0f / extent : 2.0f / extent;
+        viewProj[c * 4 + c] = scale;
+        viewProj[12 + c] = c < 2 ? -center * scale : -(center - extent * 0.25f) * scale;
+    }
+    viewProj[15] = 1.0f;
+    const float camera[3] = { sceneMin[0] - (sceneMax[0] - sceneMin[0]), sceneMin[1], sceneMin[2] };
+    MeshletCulling::CullParams params;
+    MeshletCulling::makeCullParams(viewProj, camera, true, params);
+    if (data.lods) {
+        MeshletCulling::setLodSelection(1080.0f * 0.5f, 1.0f, 0.0f, params);
+    }
+
+    std::vector<uint32_t> reference(table.count);
+    std::vector<uint32_t> visible(table.count);
+    const size_t referenceCount =
+        MeshletCulling::cullMeshlets(MeshletCulling::CULL_PATH_SCALAR, params, table, 0, table.count, reference.data());
+    const int iterations = (int)(64 * 1024 * 1024 / table.count) + 1;
+    for (uint32_t path = 0; path < MeshletCulling::CULL_PATH_COUNT; path++) {
+        const MeshletCulling::CullPath cullPath = (MeshletCulling::CullPath)path;
+        if (cullPath > MeshletCulling::bestCullPath()) {
+            continue;
+        }
+        size_t visibleCount = 0;
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++) {
+            visibleCount = MeshletCulling::cullMeshlets(cullPath, params, table, 0, table.count, visible.data());
+        }
+        const double ms = elapsedMs(start) / iterations;
+        if (visibleCount != referenceCount || memcmp(visible.data(), reference.data(), visibleCount * sizeof(uint32_t)) != 0) {
+            printf("cull mismatch: %s path differs from scalar\n", MeshletCulling::cullPathName(cullPath));
+            return false;
+        }
+        printf("  cull %-6s: %zu / %zu visible, %.3f ms (%.1f M meshlets/s)\n",
+               MeshletCulling::cullPathName(cullPath),
+               visibleCount,
+               table.count,
+               ms,
+               table.count / (ms * 1000.0));
+    }
+
+    // Scaling of the chunked multi-threaded cull on the fastest path, 1..maxThreads workers.
+    const MeshletCulling::CullPath bestPath = MeshletCulling::bestCullPath();
+    double singleThreadMs = 0.0;
+    for (uint32_t threadCount = 1; threadCount <= maxThreads; threadCount++) {
+        MeshletCulling::CullWorkers* pWorkers = MeshletCulling::createCullWorkers(threadCount);
+        size_t visibleCount = 0;
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++) {
+            visibleCount = MeshletCulling::cullMeshletsParallel(
+                pWorkers, bestPath, params, table, MeshletCulling::emitVisibleIndices, visible.data());
+        }
+        const double ms = elapsedMs(start) / iterations;
+        MeshletCulling::destroyCullWorkers(pWorkers);
+
+        // Workers merge in completion order, compare as a set.
+        std::sort(visible.begin(), visible.begin() + visibleCount);
+        if (visibleCount != referenceCount || memcmp(visible.data(), reference.data(), visibleCount * sizeof(uint32_t)) != 0) {
+            printf("cull mismatch: %u threads differ from scalar\n", threadCount);
+            return false;
+        }
+        if (threadCount == 1) {
+            singleThreadMs = ms;
+        }
+        printf("  cull %s x %2u threads: %.3f ms, %.2fx\n", MeshletCulling::cullPathName(bestPath), threadCount, ms, singleThreadMs / ms);
+    }
+
+    // Cull straight into indexed indirect arguments, ranges laid out as in a fresh upload.
+    std::vector<MeshletDrawArgs::MeshletDrawRange> ranges(table.count);
+    for (size_t i = 0; i < table.count; i++) {
+        ranges[i].firstIndex = data.meshlets[i].triangleOffset * 3;
+        ranges[i].indexCount = data.meshlets[i].triangleCount * 3;
+        ranges[i].baseVertex = (int32_t)data.meshlets[i].vertexOffset;
+    }
+    std::vector<MeshletDrawArgs::DrawIndexedArgs> args(table.count);
+    MeshletDrawArgs::EmitTarget emitTarget = { ranges.data(), args.data() };
+    MeshletCulling::CullWorkers* pWorkers = MeshletCulling::createCullWorkers(maxThreads);
+    size_t argCount = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        argCount =
+            MeshletCulling::cullMeshletsParallel(pWorkers, bestPath, params, table, MeshletDrawArgs::emitDrawIndexedArgs, &emitTarget);
+    }
+    const double argsMs = elapsedMs(start) / iterations;
+    MeshletCulling::destroyCullWorkers(pWorkers);
+    for (size_t i = 0; i < argCount; i++) {
+        visible[i] = args[i].firstInstance;
+        const MeshletDrawArgs::MeshletDrawRange& range = ranges[args[i].firstInstance];
+        if (args[i].indexCount != range.indexCount || args[i].firstIndex != range.firstIndex || args[i].vertexOffset != range.baseVertex ||
+            args[i].instanceCount != 1) {
+            printf("indirect argument mismatch for meshlet %u\n", args[i].firstInstance);
+            return false;
+        }
+    }
+    std::sort(visible.begin(), visible.begin() + argCount);
+    if (argCount != referenceCount || memcmp(visible.data(), reference.data(), argCount * sizeof(uint32_t)) != 0) {
+        printf("indirect arguments don't cover the visible set\n");
+        return false;
+    }
+    printf("  cull + indexed indirect args x %2u threads: %zu draws, %.3f ms\n", maxThreads, argCount, argsMs);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const char* scenePath = NULL;
+    std::string cachePath;
+    MeshletBuilder::BuildSettings settings;
+    bool verify = false;
+    bool cullBench = false;
+    bool stream = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            cachePath = argv[++i];
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            settings.threadCount = (uint32_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            stream = true;
+        } else if (strcmp(argv[i], "--optimize") == 0) {
+            settings.optimize = true;
+        } else if (strcmp(argv[i], "--lod") == 0) {
+            settings.lodHierarchy = true;
+        } else if (strcmp(argv[i], "--verify") == 0) {
+            verify = true;
+        } else if (strcmp(argv[i], "--cull-bench") == 0) {
+            cullBench = true;
+        } else {
+            scenePath = argv[i];
+        }
+    }
+    if (!scenePath) {
+        printf("usage: %s <scene.gltf|scene.glb> [-o <cache>] [-t <threads>] [--stream] [--optimize] [--lod] [--verify] [--cull-bench]\n",
+               argv[0]);
+        return 1;
+    }
+    if (cachePath.empty()) {
+        cachePath = std::string(scenePath) + ".meshlets";
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    const uint64_t sourceHash = GLTFStream::hashSource(scenePath);
+    const double hashMs = elapsedMs(start);
+
+    start = std::chrono::steady_clock::now();
+    stream = stream || GLTFStream::isBinary(scenePath);
+    tinygltf::Model model;
+    GLTFStream::Model streamModel;
+    if (stream ? !GLTFStream::open(scenePath, streamModel) : !MeshletBuilder::loadGLTF(scenePath, model)) {
+        return 1;
+    }
+    const double loadMs = elapsedMs(start);
+
+    MeshletShape unoptimizedShape = {};
+    if (settings.optimize) {
+        MeshletBuilder::BuildSettings unoptimized = settings;
+        unoptimized.optimize = false;
+        MeshletBuilder::MeshletData counts = {};
+        MeshletBuilder::BuildResult result;
+        const bool built = stream ? MeshletBuilder::build(streamModel, unoptimized, countMeshlets, &counts)
+                                  : MeshletBuilder::build(model, unoptimized, result);
+        if (!built) {
+            printf("failed to build meshlets for %s\n", scenePath);
+            return 1;
+        }
+        unoptimizedShape = measureShape(stream ? counts : result.view());
+    }
+
+    // A streaming bake writes each primitive into the cache as soon as it is built and never holds
+    // the baked scene; the reports below read it back from the mapped cache.
+    start = std::chrono::steady_clock::now();
+    MeshletBuilder::BuildResult result;
+    MeshletBuilder::OptimizeStats optimizeStats = {};
+    MeshletCache::CacheWriter writer;
+    bool built = false;
+    if (stream) {
+        built = MeshletCache::beginCache(cachePath.c_str(), sourceHash, settings, writer) &&
+                MeshletBuilder::build(streamModel, settings, appendToCache, &writer, &optimizeStats);
+    } else {
+        built = MeshletBuilder::build(model, settings, result);
+        optimizeStats = result.optimizeStats;
+    }
+    if (!built) {
+        writer.failed = true;
+        MeshletCache::endCache(cachePath.c_str(), writer);
+        printf("failed to build meshlets for %s\n", scenePath);
+        return 1;
+    }
+    const double buildMs = elapsedMs(start);
+    GLTFStream::close(streamModel);
+    model = {};
+
+    start = std::chrono::steady_clock::now();
+    const bool written = stream ? MeshletCache::endCache(cachePath.c_str(), writer)
+                                : MeshletCache::writeCache(cachePath.c_str(), sourceHash, settings, result.view());
+    if (!written) {
+        printf("failed to write %s\n", cachePath.c_str());
+        return 1;
+    }
+    const double writeMs = elapsedMs(start);
+
+    MeshletCache::MappedCache cache;
+    if (stream && !MeshletCache::openCache(cachePath.c_str(), sourceHash, settings, cache)) {
+        printf("failed to read back %s\n", cachePath.c_str());
+        return 1;
+    }
+    const MeshletBuilder::MeshletData data = stream ? cache.data : result.view();
+
+    printf("%s -> %s\n", scenePath, cachePath.c_str());
+    printf("  primitives: %zu meshlets: %zu vertices: %zu triangles: %zu\n",
+           data.primitiveCount,
+           data.meshletCount,
+           data.vertexCount,
+           data.triangleCount);
+    size_t coneCount = 0;
+    for (size_t i = 0; i < data.meshletCount; i++) {
+        coneCount += data.meshlets[i].coneCutoff < 1.0f;
+    }
+    printf("  meshlets with a usable backface cone: %zu (cone weight %.2f)\n", coneCount, settings.coneWeight);
+    printf("  hash %.2f ms, load %.2f ms, build %.2f ms (%u threads), write %.2f ms\n",
+           hashMs,
+           loadMs,
+           buildMs,
+           MeshletBuilder::resolveThreadCount(settings.threadCount, data.primitiveCount),
+           writeMs);
+    printf("  %s load, peak resident %.1f MB\n", stream ? "streaming" : "tinygltf", peakResidentMb());
+    if (settings.optimize) {
+        printOptimizeReport(optimizeStats, unoptimizedShape, measureShape(data));
+    }
+    if (!reportSharedVertices(data, verify)) {
+        return 1;
+    }
+    if (settings.lodHierarchy && !reportLodHierarchy(data, verify)) {
+        return 1;
+    }
+    if (verify) {
+        if (!verifyMicroIndices(data)) {
+            return 1;
+        }
+        if (!verifySourceHash(cachePath)) {
+            return 1;
+        }
+        printQuantizationError(data);
+    }
+    if (cullBench && !benchCulling(data, MeshletBuilder::resolveThreadCount(settings.threadCount, SIZE_MAX))) {
+        return 1;
+    }
+    MeshletCache::closeCache(cache);
+    return 0;
+}
@@ -0,0 +1,1146 @@
+#include "MeshletBuilder.h"
+#include "GLTFStream.h"
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MESHLET_BUILDER_SSE2
+#endif
+
+#include "meshoptimizer.h"
+
+#define TINYGLTF_IMPLEMENTATION
+#define STB_IMAGE_IMPLEMENTATION
+#include "tiny_gltf.h"
+
+namespace MeshletBuilder {
+    // Meshlets for a single primitive, built independently of every other primitive
+    // so that primitives can be processed on any worker in any order.
+    struct PrimitiveMeshlets {
+        std::vector<float> positions;
+        std::vector<uint8_t> triangles;
+        std::vector<Meshlet> meshlets; // offsets relative to this primitive
+        std::vector<MeshletLod> lods;  // BuildSettings::lodHierarchy only
+        OptimizeStats stats = {};
+    };
+
+    // A meshlet of the LOD hierarchy that still has to be grouped with its neighbours.
+    struct LodCluster {
+        uint32_t meshlet;     // in PrimitiveMeshlets::meshlets
+        uint32_t indexOffset; // first of its triangles, as primitive vertices, in BuildScratch::clusterIndices
+        uint32_t indexCount;
+    };
+
+    // Per-worker meshopt output, reused across all primitives a worker picks up.
+    struct BuildScratch {
+        std::vector<meshopt_Meshlet> mesoptsMeshlets;
+        std::vector<uint32_t> meshletVerts;
+        std::vector<uint8_t> meshletTries;
+        std::vector<uint32_t> indices; // widened or generated indices, see primitiveIndices
+        // BuildSettings::optimize only
+        std::vector<uint32_t> remap;
+        std::vector<uint32_t> optimizedIndices;
+        std::vector<float> optimizedPositions;
+        std::vector<float> meshletCenters;
+        std::vector<uint32_t> meshletOrder;
+        // BuildSettings::lodHierarchy only
+        std::vector<LodCluster> clusters;
+        std::vector<LodCluster> nextClusters;
+        std::vector<uint32_t> clusterIndices;
+        std::vector<uint32_t> nextClusterIndices;
+        std::vector<uint32_t> groupIndices;   // merged group, as group vertices
+        std::vector<uint32_t> groupVertices;  // group vertex -> primitive vertex
+        std::vector<uint32_t> vertexToGroup;  // primitive vertex -> group vertex, ~0u outside the current group
+        std::vector<float> groupPositions;
+        std::vector<uint32_t> simplifiedIndices;
+    };
+
+    // dst[i] = float3 at src + indices[i] * stride. The SSE path loads a full float4 per
+    // vertex. Accessors only guarantee 12 bytes for the last vertex, whatever the stride, so
+    // blocks that touch it go through the scalar tail; every other vertex has at least 12 more
+    // bytes of the stream behind it.
+    static void gatherFloat3(float* dst, const uint8_t* src, size_t stride, size_t srcCount, const uint32_t* indices, size_t count) {
+        size_t i = 0;
+#ifdef MESHLET_BUILDER_SSE2
+        const uint32_t lastSafe = srcCount > 0 ? (uint32_t)srcCount - 1 : 0;
+        for (; i + 4 <= count; i += 4) {
+            const uint32_t i0 = indices[i + 0];
+            const uint32_t i1 = indices[i + 1];
+            const uint32_t i2 = indices[i + 2];
+            const uint32_t i3 = indices[i + 3];
+            if (i0 >= lastSafe || i1 >= lastSafe || i2 >= lastSafe || i3 >= lastSafe) {
+                for (size_t k = i; k < i + 4; k++) {
+                    memcpy(dst + k * 3, src + indices[k] * stride, sizeof(float) * 3);
+                }
+                continue;
+            }
+            const __m128 a = _mm_loadu_ps((const float*)(src + i0 * stride)); // x0 y0 z0 -
+            const __m128 b = _mm_loadu_ps((const float*)(src + i1 * stride)); // x1 y1 z1 -
+            const __m128 c = _mm_loadu_ps((const float*)(src + i2 * stride)); // x2 y2 z2 -
+            const __m128 d = _mm_loadu_ps((const float*)(src + i3 * stride)); // x3 y3 z3 -
+            const __m128 ab = _mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 2, 2));  // z0 z0 x1 x1
+            const __m128 cd = _mm_shuffle_ps(c, d, _MM_SHUFFLE(0, 0, 2, 2));  // z2 z2 x3 x3
+            _mm_storeu_ps(dst + i * 3 + 0, _mm_shuffle_ps(a, ab, _MM_SHUFFLE(2, 0, 1, 0)));  // x0 y0 z0 x1
+            _mm_storeu_ps(dst + i * 3 + 4, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 0, 2, 1)));   // y1 z1 x2 y2
+            _mm_storeu_ps(dst + i * 3 + 8, _mm_shuffle_ps(cd, d, _MM_SHUFFLE(2, 1, 2, 0)));  // z2 x3 y3 z3
+        }
+#endif
+        for (; i < count; i++) {
+            memcpy(dst + i * 3, src + indices[i] * stride, sizeof(float) * 3);
+        }
+    }
+
+    // AABB, also the frame of quantized positions, and a sphere centered on it.
+    static void computeMeshletBounds(const float* positions, size_t count, Meshlet& meshlet) {
+        float* bounds = meshlet.bounds;
+        float minP[3] = { positions[0], positions[1], positions[2] };
+        float maxP[3] = { positions[0], positions[1], positions[2] };
+        for (size_t i = 1; i < count; i++) {
+            for (int c = 0; c < 3; c++) {
+                minP[c] = fminf(minP[c], positions[i * 3 + c]);
+                maxP[c] = fmaxf(maxP[c], positions[i * 3 + c]);
+            }
+        }
+        float radiusSq = 0.0f;
+        for (int c = 0; c < 3; c++) {
+            meshlet.aabbMin[c] = minP[c];
+            meshlet.aabbMax[c] = maxP[c];
+            bounds[c] = (minP[c] + maxP[c]) * 0.5f;
+        }
+        for (size_t i = 0; i < count; i++) {
+            const float dx = positions[i * 3 + 0] - bounds[0];
+            const float dy = positions[i * 3 + 1] - bounds[1];
+            const float dz = positions[i * 3 + 2] - bounds[2];
+            radiusSq = fmaxf(radiusSq, dx * dx + dy * dy + dz * dz);
+        }
+        bounds[3] = sqrtf(radiusSq);
+    }
+
+    // Zero-copy view of a glTF accessor: element i starts at data + i * stride, inside its buffer.
+    struct AccessorView {
+        const uint8_t* data;
+        size_t stride;
+        size_t count;
+        uint32_t componentType;
+    };
+
+    // One primitive's source streams, wherever the loader keeps them.
+    struct PrimitiveSource {
+        AccessorView positions; // float3
+        AccessorView indices;   // u8, u16 or u32 scalars, data is NULL for non-indexed primitives
+    };
+
+    // Element size of the accessor types the bake reads, 0 for the others.
+    static size_t elementSize(uint32_t componentType, uint32_t componentCount) {
+        switch (componentType) {
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+            return componentCount;
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+            return componentCount * sizeof(uint16_t);
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+        case TINYGLTF_COMPONENT_TYPE_FLOAT:
+            return componentCount * sizeof(uint32_t);
+        default:
+            return 0;
+        }
+    }
+
+    // The checks meshopt and gatherFloat3 rely on: positions are 4 byte aligned float3 with a
+    // stride meshopt accepts, indices are unsigned scalars and a triangle list.
+    static bool checkSource(const PrimitiveSource& source, uint32_t meshIndex) {
+        const AccessorView& positions = source.positions;
+        if (positions.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT || positions.stride < sizeof(float) * 3 ||
+            positions.stride > 256 || positions.stride % sizeof(float) != 0 || (uintptr_t)positions.data % sizeof(float) != 0) {
+            printf("skipping primitive of mesh %u: positions must be float3 with a 4 byte aligned stride\n", meshIndex);
+            return false;
+        }
+        if (source.indices.data && elementSize(source.indices.componentType, 1) == 0) {
+            printf("skipping primitive of mesh %u: unsupported index type %u\n", meshIndex, source.indices.componentType);
+            return false;
+        }
+        return true;
+    }
+
+    static bool resolveAccessor(const tinygltf::Model& model, int accessorIndex, uint32_t componentCount, AccessorView& view) {
+        if (accessorIndex < 0 || (size_t)accessorIndex >= model.accessors.size()) {
+            return false;
+        }
+        const tinygltf::Accessor& accessor = model.accessors[accessorIndex];
+        if (accessor.sparse.isSparse || accessor.bufferView < 0 || (size_t)accessor.bufferView >= model.bufferViews.size() ||
+            (uint32_t)tinygltf::GetNumComponentsInType((uint32_t)accessor.type) != componentCount) {
+            return false;
+        }
+        const tinygltf::BufferView& bufferView = model.bufferViews[accessor.bufferView];
+        if (bufferView.buffer < 0 || (size_t)bufferView.buffer >= model.buffers.size()) {
+            return false;
+        }
+        const std::vector<unsigned char>& buffer = model.buffers[bufferView.buffer].data;
+        const size_t size = elementSize((uint32_t)accessor.componentType, componentCount);
+        const size_t stride = bufferView.byteStride ? bufferView.byteStride : size;
+        if (size == 0 || bufferView.byteOffset > buffer.size() || bufferView.byteLength > buffer.size() - bufferView.byteOffset) {
+            return false;
+        }
+        // Every element, not just the first, has to lie inside the view
+        const uint64_t byteSize = accessor.count ? (uint64_t)(accessor.count - 1) * stride + size : 0;
+        if (accessor.byteOffset > bufferView.byteLength || byteSize > bufferView.byteLength - accessor.byteOffset) {
+            return false;
+        }
+        view.data = buffer.data() + bufferView.byteOffset + accessor.byteOffset;
+        view.stride = stride;
+        view.count = accessor.count;
+        view.componentType = (uint32_t)accessor.componentType;
+        return true;
+    }
+
+    static bool resolvePrimitive(
+        const tinygltf::Model& model, const tinygltf::Primitive& prim, uint32_t meshIndex, PrimitiveSource& source) {
+        // tinygltf reports a missing mode as -1, the glTF default is triangles
+        auto positionAttrib = prim.attributes.find("POSITION");
+        if (positionAttrib == prim.attributes.end() || (prim.mode != TINYGLTF_MODE_TRIANGLES && prim.mode != -1)) {
+            return false;
+        }
+        source = {};
+        if (!resolveAccessor(model, positionAttrib->second, 3, source.positions) ||
+            (prim.indices >= 0 && !resolveAccessor(model, prim.indices, 1, source.indices))) {
+            printf("skipping primitive of mesh %u: invalid, sparse or out of range accessor\n", meshIndex);
+            return false;
+        }
+        return checkSource(source, meshIndex);
+    }
+
+    // Same as above for a streamed model: pointers into the mapped buffers.
+    static bool resolvePrimitive(const GLTFStream::Model& model, const GLTFStream::Primitive& prim, PrimitiveSource& source) {
+        if (prim.position < 0 || prim.mode != GLTFStream::MODE_TRIANGLES) {
+            return false;
+        }
+        auto resolve = [&](int32_t accessorIndex, uint32_t componentCount, AccessorView& view) {
+            if ((size_t)accessorIndex >= model.accessors.size() || model.accessors[accessorIndex].componentCount != componentCount) {
+                return false;
+            }
+            view.count = (size_t)model.accessors[accessorIndex].count;
+            view.componentType = model.accessors[accessorIndex].componentType;
+            return GLTFStream::resolveAccessor(model, accessorIndex, view.data, view.stride);
+        };
+        source = {};
+        if (!resolve(prim.position, 3, source.positions) || (prim.indices >= 0 && !resolve(prim.indices, 1, source.indices))) {
+            printf("skipping primitive of mesh %u: invalid, sparse or out of range accessor\n", prim.meshIndex);
+            return false;
+        }
+        return checkSource(source, prim.meshIndex);
+    }
+
+    // meshopt takes 32 bit indices. Packed, aligned u32 streams are passed through untouched;
+    // narrower or strided ones are widened into scratch and non-indexed primitives get 0, 1, 2..
+    // Returns NULL if an index is past the last vertex, meshopt does not check.
+    static const uint32_t* primitiveIndices(const PrimitiveSource& source, BuildScratch& scratch, size_t& indexCount) {
+        const AccessorView& indices = source.indices;
+        const size_t vertexCount = source.positions.count;
+        if (!indices.data) {
+            indexCount = vertexCount / 3 * 3;
+            scratch.indices.resize(indexCount);
+            for (size_t i = 0; i < indexCount; i++) {
+                scratch.indices[i] = (uint32_t)i;
+            }
+            return scratch.indices.data();
+        }
+
+        indexCount = indices.count / 3 * 3;
+        const uint32_t* result = (const uint32_t*)indices.data;
+        if (indices.componentType != TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT || indices.stride != sizeof(uint32_t) ||
+            (uintptr_t)indices.data % sizeof(uint32_t) != 0) {
+            scratch.indices.resize(indexCount);
+            for (size_t i = 0; i < indexCount; i++) {
+                const uint8_t* element = indices.data + i * indices.stride;
+                if (indices.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE) {
+                    scratch.indices[i] = *element;
+                } else if (indices.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT) {
+                    uint16_t index;
+                    memcpy(&index, element, sizeof(index));
+                    scratch.indices[i] = index;
+                } else {
+                    memcpy(&scratch.indices[i], element, sizeof(uint32_t));
+                }
+            }
+            result = scratch.indices.data();
+        }
+
+        uint32_t maxIndex = 0;
+        for (size_t i = 0; i < indexCount; i++) {
+            maxIndex = result[i] > maxIndex ? result[i] : maxIndex;
+        }
+        return indexCount == 0 || maxIndex < vertexCount ? result : NULL;
+    }
+
+    // Welds vertices with equal positions, then reorders the triangles for the post-transform
+    // cache and the vertices for fetch locality. The result, float3 positions and 32 bit indices,
+    // goes to scratch.optimizedPositions/optimizedIndices; returns its vertex count.
+    static size_t optimizePrimitive(
+        const AccessorView& positions, const uint32_t* indices, size_t indexCount, BuildScratch& scratch, OptimizeStats& stats) {
+        static constexpr unsigned int CACHE_SIZE = 16;
+        const meshopt_Stream stream = { positions.data, sizeof(float) * 3, positions.stride };
+        scratch.remap.resize(positions.count);
+        size_t vertexCount =
+            meshopt_generateVertexRemapMulti(scratch.remap.data(), indices, indexCount, positions.count, &stream, 1);
+
+        scratch.optimizedIndices.resize(indexCount);
+        meshopt_remapIndexBuffer(scratch.optimizedIndices.data(), indices, indexCount, scratch.remap.data());
+        scratch.optimizedPositions.resize(vertexCount * 3);
+        for (size_t i = 0; i < positions.count; i++) {
+            if (scratch.remap[i] != ~0u) {
+                memcpy(&scratch.optimizedPositions[scratch.remap[i] * 3], positions.data + i * positions.stride, sizeof(float) * 3);
+            }
+        }
+
+        uint32_t* optimizedIndices = scratch.optimizedIndices.data();
+        float* optimizedPositions = scratch.optimizedPositions.data();
+        meshopt_optimizeVertexCache(optimizedIndices, optimizedIndices, indexCount, vertexCount);
+        vertexCount = meshopt_optimizeVertexFetch(
+            optimizedPositions, optimizedIndices, indexCount, optimizedPositions, vertexCount, sizeof(float) * 3);
+
+        stats.triangleCount += indexCount / 3;
+        stats.sourceVertexCount += positions.count;
+        stats.uniqueVertexCount += vertexCount;
+        stats.transformedBefore += meshopt_analyzeVertexCache(indices, indexCount, positions.count, CACHE_SIZE, 0, 0).vertices_transformed;
+        stats.transformedAfter +=
+            meshopt_analyzeVertexCache(optimizedIndices, indexCount, vertexCount, CACHE_SIZE, 0, 0).vertices_transformed;
+        return vertexCount;
+    }
+
+    // Order of count float3 points along a space filling curve, kept in scratch.meshletOrder.
+    static const uint32_t* spatialOrder(const float* points, size_t count, BuildScratch& scratch) {
+        // meshopt hands back the new slot of every point, invert it into an order
+        scratch.remap.resize(count);
+        meshopt_spatialSortRemap(scratch.remap.data(), points, count, sizeof(float) * 3);
+        scratch.meshletOrder.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            scratch.meshletOrder[scratch.remap[i]] = (uint32_t)i;
+        }
+        return scratch.meshletOrder.data();
+    }
+
+    // Order of the meshlets along a space filling curve through their vertex centroids, so
+    // meshlets that are close on screen are also close in the packed vertex and index streams.
+    static const uint32_t* sortMeshletsSpatially(const float* positions, size_t meshletCount, BuildScratch& scratch) {
+        scratch.meshletCenters.assign(meshletCount * 3, 0.0f);
+        for (size_t i = 0; i < meshletCount; i++) {
+            const meshopt_Meshlet& meshlet = scratch.mesoptsMeshlets[i];
+            float* center = &scratch.meshletCenters[i * 3];
+            for (size_t v = 0; v < meshlet.vertex_count; v++) {
+                const float* position = positions + scratch.meshletVerts[meshlet.vertex_offset + v] * 3;
+                for (int c = 0; c < 3; c++) {
+                    center[c] += position[c] / (float)meshlet.vertex_count;
+                }
+            }
+        }
+        return spatialOrder(scratch.meshletCenters.data(), meshletCount, scratch);
+    }
+
+    // meshopt meshlets of a triangle list into scratch, returns their count.
+    static size_t buildMeshoptMeshlets(const uint32_t* indices,
+                                       size_t indexCount,
+                                       const uint8_t* positionData,
+                                       size_t vertexCount,
+                                       size_t positionStride,
+                                       const BuildSettings& settings,
+                                       BuildScratch& scratch) {
+        const size_t max_meshlets = meshopt_buildMeshletsBound(indexCount, settings.maxVertices, settings.maxTriangles);
+        scratch.mesoptsMeshlets.resize(max_meshlets);
+        scratch.meshletVerts.resize(max_meshlets * settings.maxVertices);
+        scratch.meshletTries.resize(max_meshlets * settings.maxTriangles * 3);
+        return meshopt_buildMeshlets(
+            scratch.mesoptsMeshlets.data(),
+            scratch.meshletVerts.data(),
+            scratch.meshletTries.data(),
+            indices,
+            indexCount,
+            (const float*)positionData,
+            vertexCount,
+            positionStride,
+            settings.maxVertices,
+            settings.maxTriangles,
+            settings.coneWeight);
+    }
+
+    // Appends the meshlets in scratch to out, in the given order (NULL = as built).
+    static void appendMeshlets(const uint8_t* positionData,
+                               size_t positionStride,
+                               size_t numberElements,
+                               size_t meshlet_count,
+                               const uint32_t* order,
+                               const BuildScratch& scratch,
+                               PrimitiveMeshlets& out) {
+        for (size_t i = 0; i < meshlet_count; i++) {
+            const meshopt_Meshlet& src = scratch.mesoptsMeshlets[order ? order[i] : i];
+            Meshlet meshlet = {};
+            meshlet.vertexOffset = (uint32_t)(out.positions.size() / 3);
+            meshlet.vertexCount = src.vertex_count;
+            meshlet.triangleOffset = (uint32_t)(out.triangles.size() / 3);
+            meshlet.triangleCount = src.triangle_count;
+
+            const size_t positionStart = out.positions.size();
+            out.positions.resize(positionStart + src.vertex_count * 3);
+            gatherFloat3(
+                &out.positions[positionStart],
+                positionData,
+                positionStride,
+                numberElements,
+                &scratch.meshletVerts[src.vertex_offset],
+                src.vertex_count);
+            computeMeshletBounds(&out.positions[positionStart], src.vertex_count, meshlet);
+
+            // Only the cone is taken from meshopt, the sphere above doubles as the quantization frame.
+            const meshopt_Bounds cone = meshopt_computeMeshletBounds(
+                &scratch.meshletVerts[src.vertex_offset],
+                &scratch.meshletTries[src.triangle_offset],
+                src.triangle_count,
+                (const float*)positionData,
+                numberElements,
+                positionStride);
+            memcpy(meshlet.coneApex, cone.cone_apex, sizeof(meshlet.coneApex));
+            memcpy(meshlet.coneAxis, cone.cone_axis, sizeof(meshlet.coneAxis));
+            meshlet.coneCutoff = cone.cone_cutoff;
+            out.triangles.insert(
+                out.triangles.end(),
+                scratch.meshletTries.begin() + src.triangle_offset,
+                scratch.meshletTries.begin() + src.triangle_offset + src.triangle_count * 3);
+            out.meshlets.push_back(meshlet);
+        }
+    }
+
+    // Meshlets simplified together. Four halve to about two parents, so levels roughly halve too.
+    static constexpr size_t LOD_GROUP_SIZE = 4;
+    // A group whose simplification keeps more of its index count than this is regrouped next round.
+    static constexpr float LOD_MIN_REDUCTION = 0.85f;
+    // Relative to the group's extent, large enough that the triangle target is what stops meshopt;
+    // the error reached is recorded either way and only decides when the level is drawn.
+    static constexpr float LOD_MAX_ERROR = 1.0f;
+
+    // Grows sphere (xyz, radius) to the smallest sphere that also encloses other.
+    static void mergeSpheres(float sphere[4], const float other[4]) {
+        const float d[3] = { other[0] - sphere[0], other[1] - sphere[1], other[2] - sphere[2] };
+        const float distance = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+        if (distance + other[3] <= sphere[3]) {
+            return;
+        }
+        if (distance + sphere[3] <= other[3]) {
+            memcpy(sphere, other, sizeof(float) * 4);
+            return;
+        }
+        const float radius = (distance + sphere[3] + other[3]) * 0.5f;
+        const float t = (radius - sphere[3]) / distance;
+        for (int c = 0; c < 3; c++) {
+            sphere[c] += d[c] * t;
+        }
+        sphere[3] = radius;
+    }
+
+    // Appends the last meshletCount meshlets of out as LOD entries and as clusters of the next
+    // round, with their triangles mapped back to primitive vertices through vertexMap (NULL when
+    // the meshlets were built on the primitive's own vertices).
+    static void appendLodClusters(const PrimitiveMeshlets& out,
+                                  size_t meshletCount,
+                                  const uint32_t* order,
+                                  const uint32_t* vertexMap,
+                                  BuildScratch& scratch) {
+        const size_t firstMeshlet = out.meshlets.size() - meshletCount;
+        for (size_t i = 0; i < meshletCount; i++) {
+            const meshopt_Meshlet& src = scratch.mesoptsMeshlets[order ? order[i] : i];
+            LodCluster cluster = {};
+            cluster.meshlet = (uint32_t)(firstMeshlet + i);
+            cluster.indexOffset = (uint32_t)scratch.nextClusterIndices.size();
+            cluster.indexCount = src.triangle_count * 3;
+            for (uint32_t k = 0; k < cluster.indexCount; k++) {
+                const uint32_t vertex = scratch.meshletVerts[src.vertex_offset + scratch.meshletTries[src.triangle_offset + k]];
+                scratch.nextClusterIndices.push_back(vertexMap ? vertexMap[vertex] : vertex);
+            }
+            scratch.nextClusters.push_back(cluster);
+        }
+    }
+
+    // Merges a group of clusters, simplifies it to about half its triangles with the group border
+    // locked, so it still meets its neighbours whichever level they are drawn at, and appends the
+    // result as meshlets of the given level. Returns false, changing nothing, if the group stalls.
+    static bool simplifyGroup(const uint32_t* group,
+                              size_t groupSize,
+                              const float* positions,
+                              uint32_t level,
+                              const BuildSettings& settings,
+                              BuildScratch& scratch,
+                              PrimitiveMeshlets& out) {
+        // meshopt's cost grows with the vertex count it is given, so compact the group's vertices
+        // instead of simplifying against the whole primitive.
+        scratch.groupIndices.clear();
+        scratch.groupVertices.clear();
+        for (size_t i = 0; i < groupSize; i++) {
+            const LodCluster& cluster = scratch.clusters[group[i]];
+            for (uint32_t k = 0; k < cluster.indexCount; k++) {
+                const uint32_t vertex = scratch.clusterIndices[cluster.indexOffset + k];
+                if (scratch.vertexToGroup[vertex] == ~0u) {
+                    scratch.vertexToGroup[vertex] = (uint32_t)scratch.groupVertices.size();
+                    scratch.groupVertices.push_back(vertex);
+                }
+                scratch.groupIndices.push_back(scratch.vertexToGroup[vertex]);
+            }
+        }
+        const size_t vertexCount = scratch.groupVertices.size();
+        scratch.groupPositions.resize(vertexCount * 3);
+        for (size_t v = 0; v < vertexCount; v++) {
+            memcpy(&scratch.groupPositions[v * 3], positions + scratch.groupVertices[v] * 3, sizeof(float) * 3);
+            scratch.vertexToGroup[scratch.groupVertices[v]] = ~0u;
+        }
+
+        const size_t indexCount = scratch.groupIndices.size();
+        scratch.simplifiedIndices.resize(indexCount);
+        float error = 0.0f;
+        const size_t simplifiedCount = meshopt_simplify(scratch.simplifiedIndices.data(),
+                                                        scratch.groupIndices.data(),
+                                                        indexCount,
+                                                        scratch.groupPositions.data(),
+                                                        vertexCount,
+                                                        sizeof(float) * 3,
+                                                        indexCount / 6 * 3,
+                                                        LOD_MAX_ERROR,
+                                                        meshopt_SimplifyLockBorder,
+                                                        &error);
+        if (simplifiedCount == 0 || simplifiedCount > indexCount * LOD_MIN_REDUCTION) {
+            return false;
+        }
+        error *= meshopt_simplifyScale(scratch.groupPositions.data(), vertexCount, sizeof(float) * 3);
+
+        // The parents have to look coarser than every child from everywhere: their sphere encloses
+        // the children's and their error adds to the largest child error.
+        MeshletLod parent = {};
+        memcpy(parent.bounds, out.lods[scratch.clusters[group[0]].meshlet].bounds, sizeof(parent.bounds));
+        for (size_t i = 0; i < groupSize; i++) {
+            const MeshletLod& child = out.lods[scratch.clusters[group[i]].meshlet];
+            mergeSpheres(parent.bounds, child.bounds);
+            parent.error = fmaxf(parent.error, child.error);
+        }
+        parent.error += error;
+        parent.level = level;
+        memcpy(parent.parentBounds, parent.bounds, sizeof(parent.bounds));
+        parent.parentError = FLT_MAX;
+        for (size_t i = 0; i < groupSize; i++) {
+            MeshletLod& child = out.lods[scratch.clusters[group[i]].meshlet];
+            memcpy(child.parentBounds, parent.bounds, sizeof(parent.bounds));
+            child.parentError = parent.error;
+        }
+
+        const uint8_t* groupPositions = (const uint8_t*)scratch.groupPositions.data();
+        const size_t meshletCount = buildMeshoptMeshlets(
+            scratch.simplifiedIndices.data(), simplifiedCount, groupPositions, vertexCount, sizeof(float) * 3, settings, scratch);
+        appendMeshlets(groupPositions, sizeof(float) * 3, vertexCount, meshletCount, NULL, scratch, out);
+        out.lods.resize(out.meshlets.size(), parent);
+        appendLodClusters(out, meshletCount, NULL, scratch.groupVertices.data(), scratch);
+        return true;
+    }
+
+    // Builds the coarser levels on top of the meshletCount source meshlets just appended to out,
+    // which were built in the given order from the welded float3 positions.
+    static void buildLodHierarchy(const float* positions,
+                                  size_t vertexCount,
+                                  size_t meshletCount,
+                                  const uint32_t* order,
+                                  const BuildSettings& settings,
+                                  BuildScratch& scratch,
+                                  PrimitiveMeshlets& out) {
+        scratch.nextClusters.clear();
+        scratch.nextClusterIndices.clear();
+        appendLodClusters(out, meshletCount, order, NULL, scratch);
+        for (const Meshlet& meshlet : out.meshlets) {
+            MeshletLod lod = {};
+            memcpy(lod.bounds, meshlet.bounds, sizeof(lod.bounds));
+            memcpy(lod.parentBounds, meshlet.bounds, sizeof(lod.parentBounds));
+            lod.parentError = FLT_MAX;
+            out.lods.push_back(lod);
+        }
+
+        scratch.vertexToGroup.assign(vertexCount, ~0u);
+        for (uint32_t level = 1; scratch.nextClusters.size() > 1; level++) {
+            scratch.clusters.swap(scratch.nextClusters);
+            scratch.clusterIndices.swap(scratch.nextClusterIndices);
+            scratch.nextClusters.clear();
+            scratch.nextClusterIndices.clear();
+
+            // Neighbours on a space filling curve through the cluster spheres form a group. Unlike
+            // a partition of the cluster adjacency graph this doesn't guarantee that a group is
+            // connected, its simplification then stalls on the locked borders and its clusters
+            // are passed on to be grouped with other neighbours. Once no group makes progress the
+            // clusters left are roots.
+            const size_t clusterCount = scratch.clusters.size();
+            scratch.meshletCenters.resize(clusterCount * 3);
+            for (size_t i = 0; i < clusterCount; i++) {
+                memcpy(&scratch.meshletCenters[i * 3], out.lods[scratch.clusters[i].meshlet].bounds, sizeof(float) * 3);
+            }
+            const uint32_t* groupOrder = spatialOrder(scratch.meshletCenters.data(), clusterCount, scratch);
+            bool simplified = false;
+            for (size_t first = 0; first < clusterCount; first += LOD_GROUP_SIZE) {
+                const size_t groupSize = clusterCount - first < LOD_GROUP_SIZE ? clusterCount - first : LOD_GROUP_SIZE;
+                if (simplifyGroup(&groupOrder[first], groupSize, positions, level, settings, scratch, out)) {
+                    simplified = true;
+                    continue;
+                }
+                for (size_t i = first; i < first + groupSize; i++) {
+                    LodCluster cluster = scratch.clusters[groupOrder[i]];
+                    const auto indices = scratch.clusterIndices.begin() + cluster.indexOffset;
+                    cluster.indexOffset = (uint32_t)scratch.nextClusterIndices.size();
+                    scratch.nextClusterIndices.insert(scratch.nextClusterIndices.end(), indices, indices + cluster.indexCount);
+                    scratch.nextClusters.push_back(cluster);
+                }
+            }
+            if (!simplified) {
+                break;
+            }
+        }
+    }
+
+    static void buildPrimitive(
+        const PrimitiveSource& source, const BuildSettings& settings, BuildScratch& scratch, PrimitiveMeshlets& out) {
+        size_t numberIndecies = 0;
+        const uint32_t* indexData = primitiveIndices(source, scratch, numberIndecies);
+        if (!indexData) {
+            printf("skipping primitive: index past the last of its %zu vertices\n", source.positions.count);
+            return;
+        }
+        size_t numberElements = source.positions.count;
+        size_t positionStride = source.positions.stride;
+        const uint8_t* positionData = source.positions.data;
+        // Simplification needs welded vertices, or every seam would be a locked border
+        if (settings.optimize || settings.lodHierarchy) {
+            numberElements = optimizePrimitive(source.positions, indexData, numberIndecies, scratch, out.stats);
+            positionStride = sizeof(float) * 3;
+            positionData = (const uint8_t*)scratch.optimizedPositions.data();
+            indexData = scratch.optimizedIndices.data();
+        }
+
+        const size_t meshlet_count =
+            buildMeshoptMeshlets(indexData, numberIndecies, positionData, numberElements, positionStride, settings, scratch);
+        const uint32_t* order = settings.optimize ? sortMeshletsSpatially((const float*)positionData, meshlet_count, scratch) : NULL;
+        appendMeshlets(positionData, positionStride, numberElements, meshlet_count, order, scratch, out);
+        if (settings.lodHierarchy) {
+            buildLodHierarchy((const float*)positionData, numberElements, meshlet_count, order, settings, scratch, out);
+        }
+    }
+
+    // Runs job(workerIndex, itemIndex) for every item, handing items out through a shared
+    // counter so that workers that finish early keep pulling work from the remaining primitives.
+    template<typename Job>
+    static void parallelFor(uint32_t threadCount, size_t itemCount, const Job& job) {
+        std::atomic<size_t> nextItem = 0;
+        auto worker = [&](uint32_t workerIndex) {
+            for (size_t item = nextItem++; item < itemCount; item = nextItem++) {
+                job(workerIndex, item);
+            }
+        };
+
+        std::vector<std::thread> threads;
+        threads.reserve(threadCount - 1);
+        for (uint32_t i = 1; i < threadCount; i++) {
+            threads.emplace_back(worker, i);
+        }
+        worker(0);
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    }
+
+    uint32_t resolveThreadCount(uint32_t requested, size_t itemCount) {
+        uint32_t threadCount = requested;
+        if (threadCount == 0) {
+            threadCount = std::thread::hardware_concurrency();
+        }
+        if (threadCount > itemCount) {
+            threadCount = (uint32_t)itemCount;
+        }
+        return threadCount > 0 ? threadCount : 1;
+    }
+
+    uint32_t microIndexElementSize(MicroIndexFormat format) {
+        return format == MICRO_INDEX_FORMAT_U8 ? sizeof(uint8_t) : sizeof(uint32_t);
+    }
+
+    uint32_t microIndexElementsPerTriangle(MicroIndexFormat format) {
+        return format == MICRO_INDEX_FORMAT_PACKED ? 1 : 3;
+    }
+
+    void encodeMicroIndices(MicroIndexFormat format, const uint8_t* triangles, size_t triangleCount, void* dst) {
+        switch (format) {
+        case MICRO_INDEX_FORMAT_U32: {
+            uint32_t* indices = (uint32_t*)dst;
+            for (size_t i = 0; i < triangleCount * 3; i++) {
+                indices[i] = triangles[i];
+            }
+            break;
+        }
+        case MICRO_INDEX_FORMAT_U8:
+            memcpy(dst, triangles, triangleCount * 3);
+            break;
+        case MICRO_INDEX_FORMAT_PACKED: {
+            uint32_t* packed = (uint32_t*)dst;
+            for (size_t i = 0; i < triangleCount; i++) {
+                packed[i] = (uint32_t)triangles[i * 3 + 0] | ((uint32_t)triangles[i * 3 + 1] << 8) | ((uint32_t)triangles[i * 3 + 2] << 16);
+            }
+            break;
+        }
+        }
+    }
+
+    uint32_t decodeMicroIndex(MicroIndexFormat format, const void* src, size_t index) {
+        switch (format) {
+        case MICRO_INDEX_FORMAT_U32:
+            return ((const uint32_t*)src)[index];
+        case MICRO_INDEX_FORMAT_U8:
+            return ((const uint8_t*)src)[index];
+        case MICRO_INDEX_FORMAT_PACKED:
+            return (((const uint32_t*)src)[index / 3] >> ((index % 3) * 8)) & 0xff;
+        }
+        return 0;
+    }
+
+    static float clampUnit(float v) {
+        return fminf(fmaxf(v, -1.0f), 1.0f);
+    }
+
+    uint32_t positionElementSize(PositionFormat format) {
+        switch (format) {
+        case POSITION_FORMAT_SNORM16:
+            return sizeof(int16_t) * 3;
+        case POSITION_FORMAT_UNORM_11_11_10:
+            return sizeof(uint32_t);
+        default:
+            return sizeof(float) * 3;
+        }
+    }
+
+    void positionDecodeFrame(PositionFormat format, const float aabbMin[3], const float aabbMax[3], float offset[3], float scale[3]) {
+        for (int c = 0; c < 3; c++) {
+            switch (format) {
+            case POSITION_FORMAT_SNORM16:
+                offset[c] = (aabbMin[c] + aabbMax[c]) * 0.5f;
+                scale[c] = (aabbMax[c] - aabbMin[c]) * 0.5f;
+                break;
+            case POSITION_FORMAT_UNORM_11_11_10:
+                offset[c] = aabbMin[c];
+                scale[c] = aabbMax[c] - aabbMin[c];
+                break;
+            default:
+                offset[c] = 0.0f;
+                scale[c] = 1.0f;
+                break;
+            }
+        }
+    }
+
+    void encodePositions(
+        PositionFormat format, const float* positions, size_t count, const float aabbMin[3], const float aabbMax[3], void* dst) {
+        float offset[3];
+        float scale[3];
+        positionDecodeFrame(format, aabbMin, aabbMax, offset, scale);
+        // Flat axes decode to the offset whatever is stored
+        const float invScale[3] = { scale[0] > 0.0f ? 1.0f / scale[0] : 0.0f,
+                                    scale[1] > 0.0f ? 1.0f / scale[1] : 0.0f,
+                                    scale[2] > 0.0f ? 1.0f / scale[2] : 0.0f };
+        switch (format) {
+        case POSITION_FORMAT_FLOAT3:
+            memcpy(dst, positions, count * sizeof(float) * 3);
+            break;
+        case POSITION_FORMAT_SNORM16: {
+            int16_t* quantized = (int16_t*)dst;
+            for (size_t i = 0; i < count * 3; i++) {
+                const int c = (int)(i % 3);
+                quantized[i] = (int16_t)lrintf(clampUnit((positions[i] - offset[c]) * invScale[c]) * 32767.0f);
+            }
+            break;
+        }
+        case POSITION_FORMAT_UNORM_11_11_10: {
+            static const float maxValue[3] = { 2047.0f, 2047.0f, 1023.0f };
+            static const uint32_t shift[3] = { 0, 11, 22 };
+            uint32_t* packed = (uint32_t*)dst;
+            for (size_t i = 0; i < count; i++) {
+                uint32_t value = 0;
+                for (int c = 0; c < 3; c++) {
+                    const float unorm = fminf(fmaxf((positions[i * 3 + c] - offset[c]) * invScale[c], 0.0f), 1.0f);
+                    value |= (uint32_t)lrintf(unorm * maxValue[c]) << shift[c];
+                }
+                packed[i] = value;
+            }
+            break;
+        }
+        }
+    }
+
+    void decodePosition(
+        PositionFormat format, const void* src, size_t index, const float aabbMin[3], const float aabbMax[3], float position[3]) {
+        float offset[3];
+        float scale[3];
+        positionDecodeFrame(format, aabbMin, aabbMax, offset, scale);
+        float stored[3];
+        switch (format) {
+        case POSITION_FORMAT_FLOAT3:
+            memcpy(stored, (const float*)src + index * 3, sizeof(float) * 3);
+            break;
+        case POSITION_FORMAT_SNORM16: {
+            const int16_t* quantized = (const int16_t*)src + index * 3;
+            for (int c = 0; c < 3; c++) {
+                stored[c] = (float)quantized[c] / 32767.0f;
+            }
+            break;
+        }
+        case POSITION_FORMAT_UNORM_11_11_10: {
+            const uint32_t packed = ((const uint32_t*)src)[index];
+            stored[0] = (float)(packed & 0x7ff) / 2047.0f;
+            stored[1] = (float)((packed >> 11) & 0x7ff) / 2047.0f;
+            stored[2] = (float)(packed >> 22) / 1023.0f;
+            break;
+        }
+        }
+        // Same order of operations as the shader's toWorld * float4(stored, 1)
+        for (int c = 0; c < 3; c++) {
+            position[c] = stored[c] * scale[c] + offset[c];
+        }
+    }
+
+    std::vector<QuantizationError> measureQuantizationError(PositionFormat format, const MeshletData& data) {
+        uint32_t meshCount = 0;
+        for (size_t p = 0; p < data.primitiveCount; p++) {
+            meshCount = data.primitives[p].meshIndex + 1 > meshCount ? data.primitives[p].meshIndex + 1 : meshCount;
+        }
+        std::vector<QuantizationError> errors(meshCount);
+        std::vector<double> errorSums(meshCount);
+        std::vector<size_t> vertexCounts(meshCount);
+        std::vector<uint8_t> encoded;
+        for (size_t p = 0; p < data.primitiveCount; p++) {
+            const Primitive& primitive = data.primitives[p];
+            QuantizationError& error = errors[primitive.meshIndex];
+            for (uint32_t i = 0; i < primitive.meshletCount; i++) {
+                const Meshlet& meshlet = data.meshlets[primitive.meshletOffset + i];
+                const float* positions = &data.positions[meshlet.vertexOffset * 3];
+                encoded.resize(meshlet.vertexCount * positionElementSize(format));
+                encodePositions(format, positions, meshlet.vertexCount, meshlet.aabbMin, meshlet.aabbMax, encoded.data());
+                for (uint32_t v = 0; v < meshlet.vertexCount; v++) {
+                    float decoded[3];
+                    decodePosition(format, encoded.data(), v, meshlet.aabbMin, meshlet.aabbMax, decoded);
+                    const float dx = decoded[0] - positions[v * 3 + 0];
+                    const float dy = decoded[1] - positions[v * 3 + 1];
+                    const float dz = decoded[2] - positions[v * 3 + 2];
+                    const float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+                    error.maxError = fmaxf(error.maxError, distance);
+                    errorSums[primitive.meshIndex] += distance;
+                }
+                vertexCounts[primitive.meshIndex] += meshlet.vertexCount;
+            }
+        }
+        for (uint32_t m = 0; m < meshCount; m++) {
+            errors[m].meanError = vertexCounts[m] ? (float)(errorSums[m] / vertexCounts[m]) : 0.0f;
+        }
+        return errors;
+    }
+
+    void buildSharedVertexLayout(const MeshletData& data, SharedVertexLayout& layout) {
+        const size_t primitiveCount = data.primitiveCount > 0 ? data.primitiveCount : 1;
+        layout.positions.clear();
+        layout.meshletVertices.resize(data.vertexCount);
+        layout.primitiveVertexOffset.resize(primitiveCount);
+        layout.primitiveVertexCount.resize(primitiveCount);
+
+        // Meshlets of a primitive are packed back to back, so its meshlet vertices are one range
+        std::vector<float> welded;
+        for (size_t p = 0; p < primitiveCount; p++) {
+            const size_t firstMeshlet = data.primitiveCount > 0 ? data.primitives[p].meshletOffset : 0;
+            const size_t meshletCount = data.primitiveCount > 0 ? data.primitives[p].meshletCount : data.meshletCount;
+            const size_t firstVertex = meshletCount > 0 ? data.meshlets[firstMeshlet].vertexOffset : 0;
+            size_t vertexCount = 0;
+            for (size_t m = firstMeshlet; m < firstMeshlet + meshletCount; m++) {
+                vertexCount += data.meshlets[m].vertexCount;
+            }
+
+            // No indices: every meshlet vertex is its own entry, remap ends up as the table
+            const float* positions = &data.positions[firstVertex * 3];
+            uint32_t* remap = &layout.meshletVertices[firstVertex];
+            const size_t uniqueCount = meshopt_generateVertexRemap(remap, NULL, vertexCount, positions, vertexCount, sizeof(float) * 3);
+            welded.resize(uniqueCount * 3);
+            meshopt_remapVertexBuffer(welded.data(), positions, vertexCount, sizeof(float) * 3, remap);
+
+            layout.primitiveVertexOffset[p] = (uint32_t)layout.vertexCount();
+            layout.primitiveVertexCount[p] = (uint32_t)uniqueCount;
+            layout.positions.insert(layout.positions.end(), welded.begin(), welded.end());
+        }
+    }
+
+    void buildBoundsTable(const MeshletData& data, MeshletBoundsTable& table) {
+        const size_t paddedCount = (data.meshletCount + BOUNDS_TABLE_ALIGNMENT - 1) / BOUNDS_TABLE_ALIGNMENT * BOUNDS_TABLE_ALIGNMENT;
+        std::vector<float>* arrays[] = { &table.centerX,   &table.centerY,   &table.centerZ,   &table.radius,    &table.aabbMinX,
+                                         &table.aabbMinY,  &table.aabbMinZ,  &table.aabbMaxX,  &table.aabbMaxY,  &table.aabbMaxZ,
+                                         &table.coneApexX, &table.coneApexY, &table.coneApexZ, &table.coneAxisX, &table.coneAxisY,
+                                         &table.coneAxisZ, &table.coneCutoff };
+        for (std::vector<float>* array : arrays) {
+            array->assign(paddedCount, 0.0f);
+        }
+        // Padding never passes a backface test either.
+        std::fill(table.coneCutoff.begin() + data.meshletCount, table.coneCutoff.end(), 1.0f);
+        table.count = data.meshletCount;
+
+        for (size_t i = 0; i < data.meshletCount; i++) {
+            const Meshlet& meshlet = data.meshlets[i];
+            table.centerX[i] = meshlet.bounds[0];
+            table.centerY[i] = meshlet.bounds[1];
+            table.centerZ[i] = meshlet.bounds[2];
+            table.radius[i] = meshlet.bounds[3];
+            table.aabbMinX[i] = meshlet.aabbMin[0];
+            table.aabbMinY[i] = meshlet.aabbMin[1];
+            table.aabbMinZ[i] = meshlet.aabbMin[2];
+            table.aabbMaxX[i] = meshlet.aabbMax[0];
+            table.aabbMaxY[i] = meshlet.aabbMax[1];
+            table.aabbMaxZ[i] = meshlet.aabbMax[2];
+            table.coneApexX[i] = meshlet.coneApex[0];
+            table.coneApexY[i] = meshlet.coneApex[1];
+            table.coneApexZ[i] = meshlet.coneApex[2];
+            table.coneAxisX[i] = meshlet.coneAxis[0];
+            table.coneAxisY[i] = meshlet.coneAxis[1];
+            table.coneAxisZ[i] = meshlet.coneAxis[2];
+            table.coneCutoff[i] = meshlet.coneCutoff;
+        }
+
+        std::vector<float>* lodArrays[] = { &table.lodCenterX,   &table.lodCenterY,    &table.lodCenterZ,    &table.lodRadius,
+                                            &table.lodError,     &table.parentCenterX, &table.parentCenterY, &table.parentCenterZ,
+                                            &table.parentRadius, &table.parentError };
+        for (std::vector<float>* array : lodArrays) {
+            array->assign(data.lods ? paddedCount : 0, 0.0f);
+        }
+        for (size_t i = 0; data.lods && i < data.meshletCount; i++) {
+            const MeshletLod& lod = data.lods[i];
+            table.lodCenterX[i] = lod.bounds[0];
+            table.lodCenterY[i] = lod.bounds[1];
+            table.lodCenterZ[i] = lod.bounds[2];
+            table.lodRadius[i] = lod.bounds[3];
+            table.lodError[i] = lod.error;
+            table.parentCenterX[i] = lod.parentBounds[0];
+            table.parentCenterY[i] = lod.parentBounds[1];
+            table.parentCenterZ[i] = lod.parentBounds[2];
+            table.parentRadius[i] = lod.parentBounds[3];
+            table.parentError[i] = lod.parentError;
+        }
+    }
+
+    bool loadGLTF(const char* path, tinygltf::Model& model) {
+        tinygltf::TinyGLTF loader;
+        std::string err;
+        std::string warn;
+        if (!loader.LoadASCIIFromFile(&model, &err, &warn, path)) {
+            printf("failed to load GLTF: %s", path);
+            if (!warn.empty()) {
+                printf("Warn: %s\n", warn.c_str());
+            }
+
+            if (!err.empty()) {
+                printf("Err: %s\n", err.c_str());
+            }
+            return false;
+        }
+        return true;
+    }
+
+    // Builds primCount primitives on the settings' workers into primMeshlets. flushItem(primIndex)
+    // is called for every primitive in primitive order, one call at a time, as soon as it and all
+    // earlier primitives are built, so a flush that consumes and frees the primitive keeps only
+    // the ones in flight resident. Workers don't start a primitive more than maxPending ahead of
+    // the flush, which bounds how many finished ones pile up behind a slow earlier primitive.
+    template<typename BuildItem, typename FlushItem>
+    static void buildPrimitives(size_t primCount,
+                                const BuildSettings& settings,
+                                size_t maxPending,
+                                std::vector<PrimitiveMeshlets>& primMeshlets,
+                                const BuildItem& buildItem,
+                                const FlushItem& flushItem) {
+        const uint32_t threadCount = resolveThreadCount(settings.threadCount, primCount);
+        std::vector<BuildScratch> scratch(threadCount);
+        primMeshlets.resize(primCount);
+        std::vector<uint8_t> built(primCount);
+        std::mutex flushMutex;
+        std::condition_variable flushed;
+        size_t nextFlush = 0;
+        bool flushing = false;
+        parallelFor(threadCount, primCount, [&](uint32_t workerIndex, size_t primIndex) {
+            // Items are handed out in order, so the primitive at nextFlush is always claimed and never waits here.
+            if (maxPending < primCount) {
+                std::unique_lock<std::mutex> lock(flushMutex);
+                flushed.wait(lock, [&] { return primIndex - nextFlush < maxPending; });
+            }
+            buildItem(primIndex, scratch[workerIndex], primMeshlets[primIndex]);
+
+            // Whoever completes the next primitive in order flushes the ready run; workers that
+            // finish while a flush is running leave theirs to it.
+            std::unique_lock<std::mutex> lock(flushMutex);
+            built[primIndex] = 1;
+            if (flushing) {
+                return;
+            }
+            flushing = true;
+            while (nextFlush < primCount && built[nextFlush]) {
+                const size_t flushIndex = nextFlush++;
+                lock.unlock();
+                flushItem(flushIndex);
+                flushed.notify_all();
+                lock.lock();
+            }
+            flushing = false;
+        });
+    }
+
+    static void addOptimizeStats(const OptimizeStats& src, OptimizeStats& dst) {
+        dst.triangleCount += src.triangleCount;
+        dst.sourceVertexCount += src.sourceVertexCount;
+        dst.uniqueVertexCount += src.uniqueVertexCount;
+        dst.transformedBefore += src.transformedBefore;
+        dst.transformedAfter += src.transformedAfter;
+    }
+
+    // Appends the built primitives to result in primitive order.
+    static void packPrimitives(std::vector<PrimitiveMeshlets>& primMeshlets, const uint32_t* primMeshIndex, BuildResult& result) {
+        const size_t primCount = primMeshlets.size();
+        // Prefix sum in primitive order so the packed output doesn't depend on scheduling.
+        const size_t baseVertex = result.vertexCount();
+        const size_t baseTriangle = result.triangleCount();
+        const size_t baseMeshlet = result.meshlets.size();
+        size_t vertexCount = 0;
+        size_t triangleCount = 0;
+        size_t meshletCount = 0;
+        bool hasLods = false;
+        result.primitives.reserve(result.primitives.size() + primCount);
+        for (size_t primIndex = 0; primIndex < primCount; primIndex++) {
+            const PrimitiveMeshlets& prim = primMeshlets[primIndex];
+            Primitive primitive = {};
+            primitive.meshIndex = primMeshIndex[primIndex];
+            primitive.meshletOffset = (uint32_t)(baseMeshlet + meshletCount);
+            primitive.meshletCount = (uint32_t)prim.meshlets.size();
+            primitive.vertexOffset = (uint32_t)(baseVertex + vertexCount);
+            primitive.triangleOffset = (uint32_t)(baseTriangle + triangleCount);
+            result.primitives.push_back(primitive);
+
+            vertexCount += prim.positions.size() / 3;
+            triangleCount += prim.triangles.size() / 3;
+            meshletCount += prim.meshlets.size();
+            hasLods = hasLods || !prim.lods.empty();
+            addOptimizeStats(prim.stats, result.optimizeStats);
+        }
+        // Appending in primitive order into reserved (untouched) capacity and freeing each
+        // primitive's copy right after keeps the peak near one copy of the output, resizing up
+        // front would fault in the whole result while every primitive's copy is still held.
+        result.positions.reserve((baseVertex + vertexCount) * 3);
+        result.triangles.reserve((baseTriangle + triangleCount) * 3);
+        result.meshlets.reserve(baseMeshlet + meshletCount);
+        if (hasLods) {
+            result.lods.reserve(baseMeshlet + meshletCount);
+        }
+        const Primitive* primitives = &result.primitives[result.primitives.size() - primCount];
+        for (size_t primIndex = 0; primIndex < primCount; primIndex++) {
+            PrimitiveMeshlets& src = primMeshlets[primIndex];
+            const Primitive& dst = primitives[primIndex];
+            result.positions.insert(result.positions.end(), src.positions.begin(), src.positions.end());
+            result.triangles.insert(result.triangles.end(), src.triangles.begin(), src.triangles.end());
+            for (Meshlet meshlet : src.meshlets) {
+                meshlet.vertexOffset += dst.vertexOffset;
+                meshlet.triangleOffset += dst.triangleOffset;
+                result.meshlets.push_back(meshlet);
+            }
+            result.lods.insert(result.lods.end(), src.lods.begin(), src.lods.end());
+            src = {};
+        }
+    }
+
+    bool build(const tinygltf::Model& model, const BuildSettings& settings, BuildResult& result) {
+        std::vector<const tinygltf::Primitive*> prims;
+        std::vector<uint32_t> primMeshIndex;
+        for (size_t meshIndex = 0; meshIndex < model.meshes.size(); meshIndex++) {
+            for (auto& prim : model.meshes[meshIndex].primitives) {
+                prims.push_back(&prim);
+                primMeshIndex.push_back((uint32_t)meshIndex);
+            }
+        }
+        if (prims.empty()) {
+            return true;
+        }
+
+        auto buildItem = [&](size_t primIndex, BuildScratch& scratch, PrimitiveMeshlets& out) {
+            PrimitiveSource source = {};
+            if (resolvePrimitive(model, *prims[primIndex], primMeshIndex[primIndex], source)) {
+                buildPrimitive(source, settings, scratch, out);
+            }
+        };
+        std::vector<PrimitiveMeshlets> primMeshlets;
+        buildPrimitives(prims.size(), settings, SIZE_MAX, primMeshlets, buildItem, [](size_t) {});
+        packPrimitives(primMeshlets, primMeshIndex.data(), result);
+        return true;
+    }
+
+    // Every worker touches only the primitive it is building and hands the source pages back
+    // afterwards, so resident source data stays around one primitive per worker.
+    static void buildStreamedPrimitive(
+        const GLTFStream::Model& model, size_t primIndex, const BuildSettings& settings, BuildScratch& scratch, PrimitiveMeshlets& out) {
+        const GLTFStream::Primitive& prim = model.primitives[primIndex];
+        PrimitiveSource source = {};
+        if (resolvePrimitive(model, prim, source)) {
+            buildPrimitive(source, settings, scratch, out);
+            GLTFStream::releaseAccessor(model, prim.position);
+            GLTFStream::releaseAccessor(model, prim.indices);
+        }
+    }
+
+    bool build(const GLTFStream::Model& model, const BuildSettings& settings, BuildResult& result) {
+        if (model.primitives.empty()) {
+            return true;
+        }
+
+        std::vector<uint32_t> primMeshIndex(model.primitives.size());
+        for (size_t i = 0; i < model.primitives.size(); i++) {
+            primMeshIndex[i] = model.primitives[i].meshIndex;
+        }
+        auto buildItem = [&](size_t primIndex, BuildScratch& scratch, PrimitiveMeshlets& out) {
+            buildStreamedPrimitive(model, primIndex, settings, scratch, out);
+        };
+        std::vector<PrimitiveMeshlets> primMeshlets;
+        buildPrimitives(model.primitives.size(), settings, SIZE_MAX, primMeshlets, buildItem, [](size_t) {});
+        packPrimitives(primMeshlets, primMeshIndex.data(), result);
+        return true;
+    }
+
+    bool build(
+        const GLTFStream::Model& model, const BuildSettings& settings, PrimitiveSinkFn sink, void* pUserData, OptimizeStats* pStats) {
+        if (pStats) {
+            *pStats = {};
+        }
+        auto buildItem = [&](size_t primIndex, BuildScratch& scratch, PrimitiveMeshlets& out) {
+            buildStreamedPrimitive(model, primIndex, settings, scratch, out);
+        };
+        std::vector<PrimitiveMeshlets> primMeshlets;
+        auto flushItem = [&](size_t primIndex) {
+            PrimitiveMeshlets& prim = primMeshlets[primIndex];
+            Primitive primitive = {};
+            primitive.meshletCount = (uint32_t)prim.meshlets.size();
+            primitive.meshIndex = model.primitives[primIndex].meshIndex;
+            const MeshletData data = { prim.positions.data(), prim.positions.size() / 3, prim.triangles.data(), prim.triangles.size() / 3,
+                                       prim.meshlets.data(),  prim.meshlets.size(),      &primitive,           1,
+                                       prim.lods.empty() ? NULL : prim.lods.data() };
+            sink(pUserData, data);
+            if (pStats) {
+                addOptimizeStats(prim.stats, *pStats);
+            }
+            prim = {};
+        };
+        // Two primitives per worker keep the workers busy while one waits for the flush
+        const size_t maxPending = (size_t)resolveThreadCount(settings.threadCount, model.primitives.size()) * 2;
+        buildPrimitives(model.primitives.size(), settings, maxPending, primMeshlets, buildItem, flushItem);
+        return true;
+    }
+} // namespace MeshletBuilder
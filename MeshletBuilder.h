@@ -0,0 +1,223 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace tinygltf {
+    class Model;
+}
+namespace GLTFStream {
+    struct Model;
+}
+
+// CPU side of the meshlet bake: glTF primitives in, packed meshlet arrays out.
+// Nothing in here touches the renderer so the bake can be run and timed on a
+// headless machine; the viewer only maps and uploads the result (see GeometrySet.h).
+namespace MeshletBuilder {
+    // GPU storage of the meshlet-local micro-indices. Only U32 can be bound as a regular
+    // index buffer; the compact formats are decoded in the vertex shader (see resources.h.fsl).
+    enum MicroIndexFormat : uint32_t {
+        MICRO_INDEX_FORMAT_U32 = 0,    // one uint32 per index
+        MICRO_INDEX_FORMAT_U8 = 1,     // one byte per index, tightly packed
+        MICRO_INDEX_FORMAT_PACKED = 2, // one uint32 per triangle, 3 x u8 in the low 24 bits
+    };
+
+    // GPU storage of meshlet vertex positions. The quantized formats store each axis relative to
+    // the meshlet's AABB (Meshlet::aabbMin/aabbMax), see positionDecodeFrame.
+    enum PositionFormat : uint32_t {
+        POSITION_FORMAT_FLOAT3 = 0,         // 12 bytes
+        POSITION_FORMAT_SNORM16 = 1,        // 6 bytes, 3 x snorm16, vertices straddle 32 bit words
+        POSITION_FORMAT_UNORM_11_11_10 = 2, // 4 bytes
+    };
+
+    struct BuildSettings {
+        size_t maxVertices = 64;
+        size_t maxTriangles = 124;
+        float coneWeight = 0.25f; // favours meshlets with tight normal cones, see Meshlet::coneCutoff
+        uint32_t threadCount = 0; // workers used to build primitives in parallel, 0 = one per hardware thread
+        // Welds duplicate positions and reorders each primitive for the post-transform cache and
+        // vertex fetch before meshlets are built, then sorts its meshlets spatially. Fewer, fuller
+        // meshlets whose neighbours are close in memory, at the cost of a slower bake.
+        bool optimize = false;
+        // Also builds coarser levels of every primitive: groups of neighbouring meshlets are merged,
+        // simplified to half their triangles with the group border locked and split into parent
+        // meshlets, until a single meshlet is left or simplification stalls. All levels are stored
+        // as regular meshlets of the primitive, see MeshletLod for picking the ones to draw.
+        bool lodHierarchy = false;
+    };
+
+    // Totals of the optimize stage over all primitives, all zero unless optimize or lodHierarchy
+    // is on (the hierarchy is built from the welded, optimized primitive). Transformed vertices
+    // come from a simulated 16 entry FIFO cache; ACMR = transformed / triangles.
+    struct OptimizeStats {
+        uint64_t triangleCount;
+        uint64_t sourceVertexCount; // accessor counts
+        uint64_t uniqueVertexCount; // referenced vertices left after welding
+        uint64_t transformedBefore;
+        uint64_t transformedAfter;
+    };
+
+    struct Meshlet {
+        uint32_t vertexOffset;   // first float3 in BuildResult::positions
+        uint32_t vertexCount;
+        uint32_t triangleOffset; // first triangle in BuildResult::triangles (3 bytes each)
+        uint32_t triangleCount;
+        float bounds[4];         // sphere around the meshlet's AABB center: xyz, radius
+        float aabbMin[3];
+        float aabbMax[3];
+        // Backface cone: the meshlet is invisible if dot(normalize(apex - eye), axis) >= cutoff.
+        // cutoff is 1 when the triangle normals are too spread out for the test to ever pass.
+        float coneApex[3];
+        float coneAxis[3];
+        float coneCutoff;
+    };
+
+    // Place of a meshlet in the LOD hierarchy (a DAG: each group of meshlets is simplified into a
+    // set of parent meshlets). Errors are object space distances, bounds are the spheres they are
+    // measured from. All meshlets of a group share their parent values, all meshlets simplified
+    // from it share the same values as their own, and errors and spheres only grow towards the
+    // roots. So a cut through the hierarchy is drawn by keeping exactly the meshlets whose own
+    // error is small enough on screen and whose parent's isn't (see MeshletCulling::CullParams).
+    struct MeshletLod {
+        float bounds[4];       // xyz, radius; the meshlet's own sphere for the source level
+        float error;           // 0 for the source level
+        float parentBounds[4];
+        float parentError;     // FLT_MAX for roots, which are drawn whenever nothing finer is
+        uint32_t level;        // 0 = source triangles
+    };
+
+    struct Primitive {
+        uint32_t meshletOffset; // first meshlet in BuildResult::meshlets
+        uint32_t meshletCount;
+        uint32_t vertexOffset;
+        uint32_t triangleOffset;
+        uint32_t meshIndex;     // glTF mesh the primitive belongs to
+    };
+
+    // Structure-of-arrays copy of the per-meshlet culling data, one float per meshlet in every
+    // array, so culling loops can test several meshlets per SIMD register. Arrays are padded to
+    // a multiple of BOUNDS_TABLE_ALIGNMENT with empty spheres; only the first `count` are meshlets.
+    static constexpr size_t BOUNDS_TABLE_ALIGNMENT = 8;
+    struct MeshletBoundsTable {
+        size_t count = 0;
+        std::vector<float> centerX, centerY, centerZ, radius;
+        std::vector<float> aabbMinX, aabbMinY, aabbMinZ;
+        std::vector<float> aabbMaxX, aabbMaxY, aabbMaxZ;
+        std::vector<float> coneApexX, coneApexY, coneApexZ;
+        std::vector<float> coneAxisX, coneAxisY, coneAxisZ, coneCutoff;
+        // MeshletLod, empty without a hierarchy
+        std::vector<float> lodCenterX, lodCenterY, lodCenterZ, lodRadius, lodError;
+        std::vector<float> parentCenterX, parentCenterY, parentCenterZ, parentRadius, parentError;
+    };
+
+    // Alternative GPU layout of baked meshlets in which vertices shared by neighbouring meshlets
+    // are stored once: each primitive's distinct positions, plus a table mapping every meshlet
+    // vertex to one of them. The table is indexed like MeshletData::positions, so a meshlet's
+    // entries start at Meshlet::vertexOffset. Positions stay float3, the quantized formats are
+    // relative to a single meshlet's bounds and can't be shared.
+    struct SharedVertexLayout {
+        std::vector<float> positions;                // float3, primitives back to back
+        std::vector<uint32_t> meshletVertices;       // relative to the primitive's first position
+        std::vector<uint32_t> primitiveVertexOffset; // first float3 in positions, per MeshletData primitive
+        std::vector<uint32_t> primitiveVertexCount;
+
+        size_t vertexCount() const {
+            return positions.size() / 3;
+        }
+        // GPU bytes of the positions and the table, compare with vertexCount * positionElementSize
+        // of MeshletData for the duplicated layout.
+        uint64_t byteSize() const {
+            return positions.size() * sizeof(float) + meshletVertices.size() * sizeof(uint32_t);
+        }
+    };
+
+    struct QuantizationError {
+        float maxError;  // object space distance between source and decoded position
+        float meanError;
+    };
+
+    // Non-owning view of baked meshlets. Either points into a BuildResult or
+    // straight into a mapped cache file (see MeshletCache.h).
+    struct MeshletData {
+        const float* positions;
+        size_t vertexCount;
+        const uint8_t* triangles;
+        size_t triangleCount;
+        const Meshlet* meshlets;
+        size_t meshletCount;
+        const Primitive* primitives;
+        size_t primitiveCount;
+        const MeshletLod* lods; // one per meshlet, NULL without BuildSettings::lodHierarchy
+    };
+
+    struct BuildResult {
+        std::vector<float> positions;   // float3 per vertex, each meshlet's vertices stored contiguously
+        std::vector<uint8_t> triangles; // meshlet-local micro-indices, 3 per triangle
+        std::vector<Meshlet> meshlets;
+        std::vector<Primitive> primitives; // in glTF mesh/primitive order, independent of thread count
+        std::vector<MeshletLod> lods;      // indexed like meshlets, empty without a hierarchy
+        OptimizeStats optimizeStats = {};
+
+        size_t vertexCount() const {
+            return positions.size() / 3;
+        }
+        size_t triangleCount() const {
+            return triangles.size() / 3;
+        }
+        MeshletData view() const {
+            return { positions.data(), vertexCount(), triangles.data(),  triangleCount(),
+                     meshlets.data(),  meshlets.size(), primitives.data(), primitives.size(),
+                     lods.empty() ? NULL : lods.data() };
+        }
+    };
+
+    // Element = unit the index allocator hands out for the format (index, byte or triangle).
+    uint32_t microIndexElementSize(MicroIndexFormat format);
+    uint32_t microIndexElementsPerTriangle(MicroIndexFormat format);
+    // Writes triangleCount * microIndexElementsPerTriangle elements to dst.
+    void encodeMicroIndices(MicroIndexFormat format, const uint8_t* triangles, size_t triangleCount, void* dst);
+    // CPU reference for the shader side decodeMicroIndex: returns micro-index number `index` of an encoded stream.
+    uint32_t decodeMicroIndex(MicroIndexFormat format, const void* src, size_t index);
+
+    uint32_t positionElementSize(PositionFormat format);
+    // Per axis position = stored * scale + offset, where stored is in [-1, 1] for SNORM16 (AABB
+    // center and half extent) and [0, 1] for UNORM_11_11_10 (AABB min and extent); identity for
+    // FLOAT3. The renderer folds it into the meshlet's toWorld.
+    void positionDecodeFrame(PositionFormat format, const float aabbMin[3], const float aabbMax[3], float offset[3], float scale[3]);
+    // Writes count positions to dst, quantized relative to the AABB (ignored for FLOAT3).
+    void encodePositions(
+        PositionFormat format, const float* positions, size_t count, const float aabbMin[3], const float aabbMax[3], void* dst);
+    // CPU reference for the shader side loadPosition followed by the decode frame.
+    void decodePosition(
+        PositionFormat format, const void* src, size_t index, const float aabbMin[3], const float aabbMax[3], float position[3]);
+    // Round trips every meshlet vertex through format, one entry per glTF mesh (indexed by Primitive::meshIndex).
+    std::vector<QuantizationError> measureQuantizationError(PositionFormat format, const MeshletData& data);
+
+    // Welds the bit-identical meshlet vertices of every primitive of data into layout. Without
+    // primitives, data is treated as a single one.
+    void buildSharedVertexLayout(const MeshletData& data, SharedVertexLayout& layout);
+
+    // Splits the bounds of every meshlet in data into table, indexed like data.meshlets.
+    void buildBoundsTable(const MeshletData& data, MeshletBoundsTable& table);
+
+    bool loadGLTF(const char* path, tinygltf::Model& model);
+    uint32_t resolveThreadCount(uint32_t requested, size_t itemCount);
+    bool build(const tinygltf::Model& model, const BuildSettings& settings, BuildResult& result);
+    // Same output from a model opened with GLTFStream::open (.gltf or .glb), without ever holding
+    // its buffers in memory: each worker reads one primitive from the mapped files at a time.
+    bool build(const GLTFStream::Model& model, const BuildSettings& settings, BuildResult& result);
+
+    // Receives the primitives of a streaming build, one call at a time but from any worker thread.
+    // primitive holds a single primitive with offsets relative to it and is only valid during the call.
+    typedef void (*PrimitiveSinkFn)(void* pUserData, const MeshletData& primitive);
+    // Same meshlets as the build above, but nothing is packed: each primitive is handed to sink, in
+    // primitive order, as soon as it and all earlier ones are built, and freed right after. With
+    // MeshletCache::appendCache as the sink, peak memory stays near the largest primitive (two per
+    // worker at most) instead of the whole baked scene. pStats receives the totals of the optimize stage.
+    bool build(const GLTFStream::Model& model,
+               const BuildSettings& settings,
+               PrimitiveSinkFn sink,
+               void* pUserData,
+               OptimizeStats* pStats = NULL);
+} // namespace MeshletBuilder
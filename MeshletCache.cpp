@@ -0,0 +1,373 @@
+#include "MeshletCache.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace MeshletCache {
+    static constexpr uint64_t SECTION_ALIGNMENT = 16;
+
+    static uint64_t alignSection(uint64_t offset) {
+        return (offset + SECTION_ALIGNMENT - 1) & ~(SECTION_ALIGNMENT - 1);
+    }
+
+    uint64_t hashFile(const char* path, uint64_t hash) {
+        FILE* file = fopen(path, "rb");
+        if (!file) {
+            return 0;
+        }
+        uint8_t chunk[64 * 1024];
+        size_t read = 0;
+        while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+            for (size_t i = 0; i < read; i++) {
+                hash ^= chunk[i];
+                hash *= 0x100000001b3ull;
+            }
+        }
+        fclose(file);
+        return hash;
+    }
+
+    // Temporary files of a cache being written, all removed or renamed by endCache.
+    static void tempPath(const char* path, int spool, char* tmpPath, size_t size) {
+        if (spool < 0) {
+            snprintf(tmpPath, size, "%s.tmp", path);
+        } else {
+            snprintf(tmpPath, size, "%s.tmp%d", path, spool);
+        }
+    }
+
+    static bool writePadding(FILE* file, uint64_t& offset) {
+        static const uint8_t padding[SECTION_ALIGNMENT] = {};
+        const size_t size = (size_t)(alignSection(offset) - offset);
+        offset += size;
+        return fwrite(padding, 1, size, file) == size;
+    }
+
+    // Appends a spool to the cache file at offset, which is aligned first.
+    static bool appendSpool(FILE* file, FILE* spool, uint64_t& offset, uint64_t size) {
+        if (!writePadding(file, offset) || fseek(spool, 0, SEEK_SET) != 0) {
+            return false;
+        }
+        uint8_t chunk[64 * 1024];
+        for (uint64_t copied = 0; copied < size;) {
+            const size_t count = (size_t)(size - copied < sizeof(chunk) ? size - copied : sizeof(chunk));
+            if (fread(chunk, 1, count, spool) != count || fwrite(chunk, 1, count, file) != count) {
+                return false;
+            }
+            copied += count;
+        }
+        offset += size;
+        return true;
+    }
+
+    bool beginCache(const char* path, uint64_t sourceHash, const MeshletBuilder::BuildSettings& settings, CacheWriter& writer) {
+        writer = {};
+        CacheHeader& header = writer.header;
+        header.magic = CACHE_MAGIC;
+        header.version = CACHE_VERSION;
+        header.sourceHash = sourceHash;
+        header.maxVertices = (uint32_t)settings.maxVertices;
+        header.maxTriangles = (uint32_t)settings.maxTriangles;
+        header.coneWeight = settings.coneWeight;
+        header.optimize = settings.optimize;
+        header.lodHierarchy = settings.lodHierarchy;
+        header.positionsOffset = alignSection(sizeof(CacheHeader));
+
+        // Written to a temporary and renamed so a crashed bake never leaves a valid-looking partial cache.
+        char tmpPath[1024];
+        tempPath(path, -1, tmpPath, sizeof(tmpPath));
+        writer.pFile = fopen(tmpPath, "wb");
+        for (int spool = 0; spool < CacheWriter::SPOOL_COUNT && writer.pFile; spool++) {
+            tempPath(path, spool, tmpPath, sizeof(tmpPath));
+            writer.pSpools[spool] = fopen(tmpPath, "w+b");
+            writer.failed = writer.failed || !writer.pSpools[spool];
+        }
+        // Placeholder, rewritten with the counts and offsets by endCache
+        uint64_t offset = sizeof(header);
+        writer.failed = writer.failed || !writer.pFile || fwrite(&header, sizeof(header), 1, (FILE*)writer.pFile) != 1 ||
+                        !writePadding((FILE*)writer.pFile, offset);
+        if (writer.failed) {
+            endCache(path, writer);
+            return false;
+        }
+        return true;
+    }
+
+    void appendCache(CacheWriter& writer, const MeshletBuilder::MeshletData& chunk) {
+        if (writer.failed) {
+            return;
+        }
+        FILE* spools[CacheWriter::SPOOL_COUNT];
+        for (int spool = 0; spool < CacheWriter::SPOOL_COUNT; spool++) {
+            spools[spool] = (FILE*)writer.pSpools[spool];
+        }
+        const uint32_t baseVertex = (uint32_t)writer.vertexCount;
+        const uint32_t baseTriangle = (uint32_t)writer.triangleCount;
+        const uint32_t baseMeshlet = (uint32_t)writer.meshletCount;
+        bool success = fwrite(chunk.positions, sizeof(float) * 3, chunk.vertexCount, (FILE*)writer.pFile) == chunk.vertexCount &&
+                       fwrite(chunk.triangles, 3, chunk.triangleCount, spools[CacheWriter::SPOOL_TRIANGLES]) == chunk.triangleCount;
+        // Offsets are rebased in small batches, the chunk itself is read-only
+        MeshletBuilder::Meshlet meshlets[256];
+        for (size_t first = 0; success && first < chunk.meshletCount; first += 256) {
+            const size_t count = chunk.meshletCount - first < 256 ? chunk.meshletCount - first : 256;
+            for (size_t i = 0; i < count; i++) {
+                meshlets[i] = chunk.meshlets[first + i];
+                meshlets[i].vertexOffset += baseVertex;
+                meshlets[i].triangleOffset += baseTriangle;
+            }
+            success = fwrite(meshlets, sizeof(meshlets[0]), count, spools[CacheWriter::SPOOL_MESHLETS]) == count;
+        }
+        for (size_t i = 0; success && i < chunk.primitiveCount; i++) {
+            MeshletBuilder::Primitive primitive = chunk.primitives[i];
+            primitive.meshletOffset += baseMeshlet;
+            primitive.vertexOffset += baseVertex;
+            primitive.triangleOffset += baseTriangle;
+            success = fwrite(&primitive, sizeof(primitive), 1, spools[CacheWriter::SPOOL_PRIMITIVES]) == 1;
+        }
+        if (success && chunk.lods) {
+            success = fwrite(chunk.lods, sizeof(MeshletBuilder::MeshletLod), chunk.meshletCount, spools[CacheWriter::SPOOL_LODS]) ==
+                      chunk.meshletCount;
+            writer.lodCount += chunk.meshletCount;
+        }
+        writer.vertexCount += chunk.vertexCount;
+        writer.triangleCount += chunk.triangleCount;
+        writer.meshletCount += chunk.meshletCount;
+        writer.primitiveCount += chunk.primitiveCount;
+        // Header counts and in-file offsets are 32 bit
+        writer.failed = !success || writer.vertexCount > UINT32_MAX || writer.triangleCount > UINT32_MAX ||
+                        writer.meshletCount > UINT32_MAX || writer.primitiveCount > UINT32_MAX;
+    }
+
+    bool endCache(const char* path, CacheWriter& writer) {
+        FILE* file = (FILE*)writer.pFile;
+        FILE* spools[CacheWriter::SPOOL_COUNT];
+        for (int spool = 0; spool < CacheWriter::SPOOL_COUNT; spool++) {
+            spools[spool] = (FILE*)writer.pSpools[spool];
+        }
+
+        // Every chunk carries LODs or none does
+        bool success = !writer.failed && file && (writer.lodCount == 0 || writer.lodCount == writer.meshletCount);
+        if (success) {
+            CacheHeader& header = writer.header;
+            header.vertexCount = (uint32_t)writer.vertexCount;
+            header.triangleCount = (uint32_t)writer.triangleCount;
+            header.meshletCount = (uint32_t)writer.meshletCount;
+            header.primitiveCount = (uint32_t)writer.primitiveCount;
+            header.lodCount = (uint32_t)writer.lodCount;
+            uint64_t offset = header.positionsOffset + writer.vertexCount * sizeof(float) * 3;
+            header.trianglesOffset = alignSection(offset);
+            success = appendSpool(file, spools[CacheWriter::SPOOL_TRIANGLES], offset, writer.triangleCount * 3);
+            header.meshletsOffset = alignSection(offset);
+            success = success &&
+                      appendSpool(file, spools[CacheWriter::SPOOL_MESHLETS], offset, writer.meshletCount * sizeof(MeshletBuilder::Meshlet));
+            header.primitivesOffset = alignSection(offset);
+            success = success && appendSpool(file,
+                                             spools[CacheWriter::SPOOL_PRIMITIVES],
+                                             offset,
+                                             writer.primitiveCount * sizeof(MeshletBuilder::Primitive));
+            header.lodsOffset = alignSection(offset);
+            success = success &&
+                      appendSpool(file, spools[CacheWriter::SPOOL_LODS], offset, writer.lodCount * sizeof(MeshletBuilder::MeshletLod));
+            success = success && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+        }
+
+        char tmpPath[1024];
+        for (int spool = 0; spool < CacheWriter::SPOOL_COUNT; spool++) {
+            if (spools[spool]) {
+                fclose(spools[spool]);
+                tempPath(path, spool, tmpPath, sizeof(tmpPath));
+                remove(tmpPath);
+            }
+        }
+        tempPath(path, -1, tmpPath, sizeof(tmpPath));
+        if (file) {
+            success = (fclose(file) == 0) && success;
+        }
+        writer = {};
+        if (!success) {
+            remove(tmpPath);
+            return false;
+        }
+        remove(path);
+        return rename(tmpPath, path) == 0;
+    }
+
+    bool writeCache(
+        const char* path, uint64_t sourceHash, const MeshletBuilder::BuildSettings& settings, const MeshletBuilder::MeshletData& data) {
+        CacheWriter writer;
+        if (!beginCache(path, sourceHash, settings, writer)) {
+            return false;
+        }
+        appendCache(writer, data);
+        return endCache(path, writer);
+    }
+
+    bool mapFile(const char* path, MappedFile& file) {
+#ifdef _WIN32
+        HANDLE hFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (hFile == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        LARGE_INTEGER fileSize = {};
+        if (!GetFileSizeEx(hFile, &fileSize) || fileSize.QuadPart == 0) {
+            CloseHandle(hFile);
+            return false;
+        }
+        HANDLE hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (!hMapping) {
+            CloseHandle(hFile);
+            return false;
+        }
+        void* pMapping = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+        if (!pMapping) {
+            CloseHandle(hMapping);
+            CloseHandle(hFile);
+            return false;
+        }
+        file.hFile = hFile;
+        file.hMapping = hMapping;
+        file.pMapping = pMapping;
+        file.mappingSize = (size_t)fileSize.QuadPart;
+#else
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st = {};
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            close(fd);
+            return false;
+        }
+        void* pMapping = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        // The mapping keeps its own reference to the file.
+        close(fd);
+        if (pMapping == MAP_FAILED) {
+            return false;
+        }
+        file.pMapping = pMapping;
+        file.mappingSize = (size_t)st.st_size;
+#endif
+        return true;
+    }
+
+    void unmapFile(MappedFile& file) {
+        if (file.pMapping) {
+#ifdef _WIN32
+            UnmapViewOfFile(file.pMapping);
+            CloseHandle((HANDLE)file.hMapping);
+            CloseHandle((HANDLE)file.hFile);
+#else
+            munmap(file.pMapping, file.mappingSize);
+#endif
+        }
+        file = {};
+    }
+
+    void releaseMappedRange(const MappedFile& file, const void* data, size_t size) {
+        // Whole pages only, clamped to the mapping. The mapping is never written, so dropping a
+        // page shared with a neighboring range is harmless, it is read again on the next touch.
+#ifdef _WIN32
+        SYSTEM_INFO systemInfo = {};
+        GetSystemInfo(&systemInfo);
+        const uintptr_t pageSize = systemInfo.dwPageSize;
+#else
+        const uintptr_t pageSize = (uintptr_t)sysconf(_SC_PAGESIZE);
+#endif
+        const uintptr_t mappingStart = (uintptr_t)file.pMapping;
+        const uintptr_t mappingEnd = mappingStart + file.mappingSize;
+        uintptr_t start = (uintptr_t)data & ~(pageSize - 1);
+        uintptr_t end = ((uintptr_t)data + size + pageSize - 1) & ~(pageSize - 1);
+        start = start > mappingStart ? start : mappingStart;
+        end = end < mappingEnd ? end : mappingEnd;
+        if (!file.pMapping || start >= end) {
+            return;
+        }
+#ifdef _WIN32
+        // Unlocking pages that were never locked removes them from the working set.
+        VirtualUnlock((void*)start, end - start);
+#else
+        madvise((void*)start, end - start, MADV_DONTNEED);
+#endif
+    }
+
+    static bool sectionInRange(const MappedCache& cache, uint64_t offset, uint64_t size) {
+        return offset <= cache.file.mappingSize && size <= cache.file.mappingSize - offset;
+    }
+
+    // The header only vouches for the section sizes. Every range a record points at is checked too,
+    // so a damaged cache is a miss rather than reads past the positions and micro-indices.
+    static bool recordsInRange(
+        const CacheHeader& header, const MeshletBuilder::MeshletData& data, const MeshletBuilder::BuildSettings& settings) {
+        for (size_t i = 0; i < data.primitiveCount; i++) {
+            const MeshletBuilder::Primitive& primitive = data.primitives[i];
+            if (primitive.meshletOffset > header.meshletCount || primitive.meshletCount > header.meshletCount - primitive.meshletOffset ||
+                primitive.vertexOffset > header.vertexCount || primitive.triangleOffset > header.triangleCount) {
+                return false;
+            }
+        }
+        for (size_t i = 0; i < data.meshletCount; i++) {
+            const MeshletBuilder::Meshlet& meshlet = data.meshlets[i];
+            if (meshlet.vertexCount > settings.maxVertices || meshlet.triangleCount > settings.maxTriangles ||
+                meshlet.vertexOffset > header.vertexCount || meshlet.vertexCount > header.vertexCount - meshlet.vertexOffset ||
+                meshlet.triangleOffset > header.triangleCount || meshlet.triangleCount > header.triangleCount - meshlet.triangleOffset) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool openCache(const char* path, uint64_t sourceHash, const MeshletBuilder::BuildSettings& settings, MappedCache& cache) {
+        cache = {};
+        if (!mapFile(path, cache.file)) {
+            return false;
+        }
+
+        const CacheHeader* header = (const CacheHeader*)cache.file.pMapping;
+        bool valid = cache.file.mappingSize >= sizeof(CacheHeader) && header->magic == CACHE_MAGIC && header->version == CACHE_VERSION &&
+                     header->sourceHash == sourceHash && header->maxVertices == settings.maxVertices &&
+                     header->maxTriangles == settings.maxTriangles && header->coneWeight == settings.coneWeight &&
+                     header->optimize == (uint32_t)settings.optimize && header->lodHierarchy == (uint32_t)settings.lodHierarchy;
+        valid = valid &&
+                sectionInRange(cache, header->primitivesOffset, (uint64_t)header->primitiveCount * sizeof(MeshletBuilder::Primitive)) &&
+                sectionInRange(cache, header->meshletsOffset, (uint64_t)header->meshletCount * sizeof(MeshletBuilder::Meshlet)) &&
+                sectionInRange(cache, header->positionsOffset, (uint64_t)header->vertexCount * sizeof(float) * 3) &&
+                sectionInRange(cache, header->trianglesOffset, (uint64_t)header->triangleCount * 3) &&
+                (header->lodCount == 0 || header->lodCount == header->meshletCount) &&
+                sectionInRange(cache, header->lodsOffset, (uint64_t)header->lodCount * sizeof(MeshletBuilder::MeshletLod));
+        if (!valid) {
+            closeCache(cache);
+            return false;
+        }
+
+        const uint8_t* base = (const uint8_t*)cache.file.pMapping;
+        cache.data.primitives = (const MeshletBuilder::Primitive*)(base + header->primitivesOffset);
+        cache.data.primitiveCount = header->primitiveCount;
+        cache.data.meshlets = (const MeshletBuilder::Meshlet*)(base + header->meshletsOffset);
+        cache.data.meshletCount = header->meshletCount;
+        cache.data.positions = (const float*)(base + header->positionsOffset);
+        cache.data.vertexCount = header->vertexCount;
+        cache.data.triangles = base + header->trianglesOffset;
+        cache.data.triangleCount = header->triangleCount;
+        cache.data.lods = header->lodCount ? (const MeshletBuilder::MeshletLod*)(base + header->lodsOffset) : NULL;
+        if (!recordsInRange(*header, cache.data, settings)) {
+            closeCache(cache);
+            return false;
+        }
+        return true;
+    }
+
+    void closeCache(MappedCache& cache) {
+        unmapFile(cache.file);
+        cache = {};
+    }
+} // namespace MeshletCache
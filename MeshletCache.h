@@ -0,0 +1,104 @@
+#pragma once
+
+#include "MeshletBuilder.h"
+
+// Baked meshlet cache. A cache file is only valid for the exact source file
+// contents (the .gltf/.glb and its external buffers, see GLTFStream::hashSource)
+// and build settings it was produced from; anything else is a miss and the
+// caller falls back to a full glTF load + build.
+//
+// Layout (all sections 16 byte aligned, little endian, located through the header's offsets):
+//   CacheHeader
+//   float3[vertexCount]      packed positions
+//   uint8[triangleCount * 3] micro-indices
+//   Meshlet[meshletCount]
+//   Primitive[primitiveCount]
+//   MeshletLod[lodCount]     lodCount is meshletCount with a LOD hierarchy, 0 otherwise
+namespace MeshletCache {
+    static constexpr uint32_t CACHE_MAGIC = 0x544C534D; // "MSLT"
+    static constexpr uint32_t CACHE_VERSION = 4;
+
+    struct CacheHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t sourceHash;
+        uint32_t maxVertices;
+        uint32_t maxTriangles;
+        float coneWeight;
+        uint32_t primitiveCount;
+        uint32_t meshletCount;
+        uint32_t vertexCount;
+        uint32_t triangleCount;
+        uint32_t optimize;     // BuildSettings::optimize
+        uint32_t lodHierarchy; // BuildSettings::lodHierarchy
+        uint32_t lodCount;
+        uint64_t primitivesOffset;
+        uint64_t meshletsOffset;
+        uint64_t positionsOffset;
+        uint64_t trianglesOffset;
+        uint64_t lodsOffset;
+    };
+
+    // Read-only mapping of a whole file, also used by the streaming glTF reader (GLTFStream.h).
+    struct MappedFile {
+        void* pMapping = nullptr;
+        size_t mappingSize = 0;
+#ifdef _WIN32
+        void* hFile = nullptr;
+        void* hMapping = nullptr;
+#endif
+    };
+
+    struct MappedCache {
+        MappedFile file;
+        MeshletBuilder::MeshletData data = {};
+    };
+
+    bool mapFile(const char* path, MappedFile& file);
+    void unmapFile(MappedFile& file);
+    // Drops the pages of [data, data + size) from the process working set. They stay in the OS
+    // file cache and are faulted back in if touched again, so this only lowers resident memory.
+    void releaseMappedRange(const MappedFile& file, const void* data, size_t size);
+
+    static constexpr uint64_t HASH_SEED = 0xcbf29ce484222325ull; // FNV-1a offset basis
+
+    // FNV-1a over the file contents, continuing from hash so several files can be chained.
+    // 0 if the file can't be read.
+    uint64_t hashFile(const char* path, uint64_t hash = HASH_SEED);
+
+    bool writeCache(
+        const char* path, uint64_t sourceHash, const MeshletBuilder::BuildSettings& settings, const MeshletBuilder::MeshletData& data);
+
+    // Writes a cache a few primitives at a time, so the baked scene never has to be in memory as a
+    // whole (see the streaming MeshletBuilder::build). Positions go straight into the file; the
+    // other sections are spooled to temporary files next to it and appended by endCache, which
+    // then completes the header. Like writeCache, the file only appears under path on success.
+    struct CacheWriter {
+        enum Spool { SPOOL_TRIANGLES, SPOOL_MESHLETS, SPOOL_PRIMITIVES, SPOOL_LODS, SPOOL_COUNT };
+
+        void* pFile = nullptr;                // FILE*
+        void* pSpools[SPOOL_COUNT] = {};      // FILE*
+        uint64_t vertexCount = 0;
+        uint64_t triangleCount = 0;
+        uint64_t meshletCount = 0;
+        uint64_t primitiveCount = 0;
+        uint64_t lodCount = 0;
+        CacheHeader header = {};
+        bool failed = false;
+    };
+
+    bool beginCache(const char* path, uint64_t sourceHash, const MeshletBuilder::BuildSettings& settings, CacheWriter& writer);
+    // Appends the primitives of chunk, whose offsets are relative to the chunk, after everything
+    // appended so far. Errors are reported by endCache.
+    void appendCache(CacheWriter& writer, const MeshletBuilder::MeshletData& chunk);
+    // Completes the cache and moves it to path. False, with nothing left behind, if any write
+    // failed; set writer.failed first to give up on a bake and just clean up.
+    bool endCache(const char* path, CacheWriter& writer);
+
+    // Maps the cache read-only and points cache.data at the mapping, no copies are made.
+    // Returns false (with nothing mapped) if the file is missing, truncated, from another
+    // version, was built from a different source/settings or has a primitive or meshlet whose
+    // ranges fall outside the stored arrays.
+    bool openCache(const char* path, uint64_t sourceHash, const MeshletBuilder::BuildSettings& settings, MappedCache& cache);
+    void closeCache(MappedCache& cache);
+} // namespace MeshletCache
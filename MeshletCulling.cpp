@@ -0,0 +1,475 @@
+#include "MeshletCulling.h"
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MESHLET_CULLING_SSE
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define MESHLET_CULLING_AVX2
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define MESHLET_CULLING_TARGET_AVX2
+#else
+#define MESHLET_CULLING_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace MeshletCulling {
+    static void normalizePlane(float plane[4]) {
+        const float length = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+        const float scale = length > 0.0f ? 1.0f / length : 0.0f;
+        for (int c = 0; c < 4; c++) {
+            plane[c] *= scale;
+        }
+    }
+
+    void makeCullParams(const float viewProj[16], const float cameraPosition[3], bool backfaceCulling, CullParams& params) {
+        // Row r of the column-major matrix.
+        auto row = [&](int r, int c) {
+            return viewProj[c * 4 + r];
+        };
+        for (int c = 0; c < 4; c++) {
+            params.planes[0][c] = row(3, c) + row(0, c); // left:   -w <= x
+            params.planes[1][c] = row(3, c) - row(0, c); // right:   x <= w
+            params.planes[2][c] = row(3, c) + row(1, c); // bottom: -w <= y
+            params.planes[3][c] = row(3, c) - row(1, c); // top:     y <= w
+            params.planes[4][c] = row(2, c);             // z = 0:   0 <= z
+            params.planes[5][c] = row(3, c) - row(2, c); // z = w:   z <= w
+        }
+        for (int p = 0; p < 6; p++) {
+            normalizePlane(params.planes[p]);
+        }
+        params.cameraPosition[0] = cameraPosition[0];
+        params.cameraPosition[1] = cameraPosition[1];
+        params.cameraPosition[2] = cameraPosition[2];
+        params.backfaceCulling = backfaceCulling;
+        params.lodSelection = false;
+        params.lodScale = 0.0f;
+        params.lodNear = 0.0f;
+    }
+
+    void setLodSelection(float projectionScale, float pixelError, float zNear, CullParams& params) {
+        params.lodSelection = pixelError > 0.0f;
+        params.lodScale = pixelError > 0.0f ? projectionScale / pixelError : 0.0f;
+        params.lodNear = zNear;
+    }
+
+    static bool supportsAVX2() {
+#if defined(MESHLET_CULLING_AVX2) && defined(_MSC_VER) && !defined(__clang__)
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7) {
+            return false;
+        }
+        __cpuid(info, 1);
+        const bool osxsave = (info[2] & (1 << 27)) != 0;
+        const bool avx = (info[2] & (1 << 28)) != 0;
+        if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) {
+            return false;
+        }
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#elif defined(MESHLET_CULLING_AVX2)
+        return __builtin_cpu_supports("avx2");
+#else
+        return false;
+#endif
+    }
+
+    CullPath bestCullPath() {
+        static const CullPath path = supportsAVX2() ? CULL_PATH_AVX2 :
+#ifdef MESHLET_CULLING_SSE
+                                                    CULL_PATH_SSE;
+#else
+                                                    CULL_PATH_SCALAR;
+#endif
+        return path;
+    }
+
+    const char* cullPathName(CullPath path) {
+        switch (path) {
+        case CULL_PATH_SSE:
+            return "SSE";
+        case CULL_PATH_AVX2:
+            return "AVX2";
+        default:
+            return "scalar";
+        }
+    }
+
+    // Reference implementation. The SIMD paths evaluate the same expressions in the same order
+    // so their results are bit-identical.
+    static size_t cullScalar(
+        const CullParams& params, const MeshletBuilder::MeshletBoundsTable& table, size_t first, size_t last, uint32_t* pVisible) {
+        const bool lodSelection = params.lodSelection && !table.lodError.empty();
+        size_t visibleCount = 0;
+        for (size_t i = first; i < last; i++) {
+            const float x = table.centerX[i];
+            const float y = table.centerY[i];
+            const float z = table.centerZ[i];
+            const float negRadius = -table.radius[i];
+            bool visible = true;
+            for (int p = 0; p < 6; p++) {
+                const float* plane = params.planes[p];
+                const float distance = plane[0] * x + plane[1] * y + plane[2] * z + plane[3];
+                visible = visible && distance >= negRadius;
+            }
+            if (lodSelection) {
+                const float dx = table.lodCenterX[i] - params.cameraPosition[0];
+                const float dy = table.lodCenterY[i] - params.cameraPosition[1];
+                const float dz = table.lodCenterZ[i] - params.cameraPosition[2];
+                const float distance = fmaxf(sqrtf(dx * dx + dy * dy + dz * dz) - table.lodRadius[i], params.lodNear);
+                const float parentX = table.parentCenterX[i] - params.cameraPosition[0];
+                const float parentY = table.parentCenterY[i] - params.cameraPosition[1];
+                const float parentZ = table.parentCenterZ[i] - params.cameraPosition[2];
+                const float parentDistance =
+                    fmaxf(sqrtf(parentX * parentX + parentY * parentY + parentZ * parentZ) - table.parentRadius[i], params.lodNear);
+                visible = visible && table.lodError[i] * params.lodScale <= distance &&
+                          !(table.parentError[i] * params.lodScale <= parentDistance);
+            }
+            if (params.backfaceCulling) {
+                const float dx = table.coneApexX[i] - params.cameraPosition[0];
+                const float dy = table.coneApexY[i] - params.cameraPosition[1];
+                const float dz = table.coneApexZ[i] - params.cameraPosition[2];
+                const float cosine = dx * table.coneAxisX[i] + dy * table.coneAxisY[i] + dz * table.coneAxisZ[i];
+                const float length = sqrtf(dx * dx + dy * dy + dz * dz);
+                visible = visible && !(cosine >= table.coneCutoff[i] * length);
+            }
+            pVisible[visibleCount] = (uint32_t)i;
+            visibleCount += visible;
+        }
+        return visibleCount;
+    }
+
+    // Appends base + bit for every set bit of mask.
+    static size_t compactMask(uint32_t mask, size_t base, uint32_t* pVisible) {
+        size_t visibleCount = 0;
+        while (mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+            unsigned long bit;
+            _BitScanForward(&bit, mask);
+#else
+            const uint32_t bit = (uint32_t)__builtin_ctz(mask);
+#endif
+            pVisible[visibleCount++] = (uint32_t)(base + bit);
+            mask &= mask - 1;
+        }
+        return visibleCount;
+    }
+
+    // Lanes of the block starting at i that are still inside [i, last).
+    static uint32_t tailMask(size_t i, size_t last, uint32_t width) {
+        return last - i >= width ? (1u << width) - 1 : (1u << (last - i)) - 1;
+    }
+
+#ifdef MESHLET_CULLING_SSE
+    static size_t cullSSE(
+        const CullParams& params, const MeshletBuilder::MeshletBoundsTable& table, size_t first, size_t last, uint32_t* pVisible) {
+        __m128 planes[6][4];
+        for (int p = 0; p < 6; p++) {
+            for (int c = 0; c < 4; c++) {
+                planes[p][c] = _mm_set1_ps(params.planes[p][c]);
+            }
+        }
+        const __m128 cameraX = _mm_set1_ps(params.cameraPosition[0]);
+        const __m128 cameraY = _mm_set1_ps(params.cameraPosition[1]);
+        const __m128 cameraZ = _mm_set1_ps(params.cameraPosition[2]);
+        const __m128 zero = _mm_setzero_ps();
+        const bool lodSelection = params.lodSelection && !table.lodError.empty();
+        const __m128 lodScale = _mm_set1_ps(params.lodScale);
+        const __m128 lodNear = _mm_set1_ps(params.lodNear);
+
+        size_t visibleCount = 0;
+        for (size_t i = first; i < last; i += 4) {
+            const __m128 x = _mm_loadu_ps(&table.centerX[i]);
+            const __m128 y = _mm_loadu_ps(&table.centerY[i]);
+            const __m128 z = _mm_loadu_ps(&table.centerZ[i]);
+            const __m128 negRadius = _mm_sub_ps(zero, _mm_loadu_ps(&table.radius[i]));
+            __m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (int p = 0; p < 6; p++) {
+                __m128 distance = _mm_add_ps(_mm_mul_ps(planes[p][0], x), _mm_mul_ps(planes[p][1], y));
+                distance = _mm_add_ps(_mm_add_ps(distance, _mm_mul_ps(planes[p][2], z)), planes[p][3]);
+                visible = _mm_and_ps(visible, _mm_cmpge_ps(distance, negRadius));
+            }
+            if (lodSelection && _mm_movemask_ps(visible) != 0) {
+                const __m128 dx = _mm_sub_ps(_mm_loadu_ps(&table.lodCenterX[i]), cameraX);
+                const __m128 dy = _mm_sub_ps(_mm_loadu_ps(&table.lodCenterY[i]), cameraY);
+                const __m128 dz = _mm_sub_ps(_mm_loadu_ps(&table.lodCenterZ[i]), cameraZ);
+                const __m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+                const __m128 distance = _mm_max_ps(_mm_sub_ps(_mm_sqrt_ps(lengthSq), _mm_loadu_ps(&table.lodRadius[i])), lodNear);
+                const __m128 parentX = _mm_sub_ps(_mm_loadu_ps(&table.parentCenterX[i]), cameraX);
+                const __m128 parentY = _mm_sub_ps(_mm_loadu_ps(&table.parentCenterY[i]), cameraY);
+                const __m128 parentZ = _mm_sub_ps(_mm_loadu_ps(&table.parentCenterZ[i]), cameraZ);
+                const __m128 parentLengthSq =
+                    _mm_add_ps(_mm_add_ps(_mm_mul_ps(parentX, parentX), _mm_mul_ps(parentY, parentY)), _mm_mul_ps(parentZ, parentZ));
+                const __m128 parentDistance =
+                    _mm_max_ps(_mm_sub_ps(_mm_sqrt_ps(parentLengthSq), _mm_loadu_ps(&table.parentRadius[i])), lodNear);
+                const __m128 error = _mm_mul_ps(_mm_loadu_ps(&table.lodError[i]), lodScale);
+                const __m128 parentError = _mm_mul_ps(_mm_loadu_ps(&table.parentError[i]), lodScale);
+                visible = _mm_and_ps(visible, _mm_cmple_ps(error, distance));
+                visible = _mm_andnot_ps(_mm_cmple_ps(parentError, parentDistance), visible);
+            }
+            // Most meshlets fail the frustum test, skip the cone for blocks that are already empty.
+            if (params.backfaceCulling && _mm_movemask_ps(visible) != 0) {
+                const __m128 dx = _mm_sub_ps(_mm_loadu_ps(&table.coneApexX[i]), cameraX);
+                const __m128 dy = _mm_sub_ps(_mm_loadu_ps(&table.coneApexY[i]), cameraY);
+                const __m128 dz = _mm_sub_ps(_mm_loadu_ps(&table.coneApexZ[i]), cameraZ);
+                const __m128 cosineX = _mm_mul_ps(dx, _mm_loadu_ps(&table.coneAxisX[i]));
+                const __m128 cosineY = _mm_mul_ps(dy, _mm_loadu_ps(&table.coneAxisY[i]));
+                const __m128 cosineZ = _mm_mul_ps(dz, _mm_loadu_ps(&table.coneAxisZ[i]));
+                const __m128 cosine = _mm_add_ps(_mm_add_ps(cosineX, cosineY), cosineZ);
+                const __m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+                const __m128 threshold = _mm_mul_ps(_mm_loadu_ps(&table.coneCutoff[i]), _mm_sqrt_ps(lengthSq));
+                visible = _mm_andnot_ps(_mm_cmpge_ps(cosine, threshold), visible);
+            }
+            const uint32_t mask = (uint32_t)_mm_movemask_ps(visible) & tailMask(i, last, 4);
+            visibleCount += compactMask(mask, i, pVisible + visibleCount);
+        }
+        return visibleCount;
+    }
+#endif
+
+#ifdef MESHLET_CULLING_AVX2
+    MESHLET_CULLING_TARGET_AVX2
+    static size_t cullAVX2(
+        const CullParams& params, const MeshletBuilder::MeshletBoundsTable& table, size_t first, size_t last, uint32_t* pVisible) {
+        __m256 planes[6][4];
+        for (int p = 0; p < 6; p++) {
+            for (int c = 0; c < 4; c++) {
+                planes[p][c] = _mm256_set1_ps(params.planes[p][c]);
+            }
+        }
+        const __m256 cameraX = _mm256_set1_ps(params.cameraPosition[0]);
+        const __m256 cameraY = _mm256_set1_ps(params.cameraPosition[1]);
+        const __m256 cameraZ = _mm256_set1_ps(params.cameraPosition[2]);
+        const __m256 zero = _mm256_setzero_ps();
+        const bool lodSelection = params.lodSelection && !table.lodError.empty();
+        const __m256 lodScale = _mm256_set1_ps(params.lodScale);
+        const __m256 lodNear = _mm256_set1_ps(params.lodNear);
+
+        size_t visibleCount = 0;
+        for (size_t i = first; i < last; i += 8) {
+            const __m256 x = _mm256_loadu_ps(&table.centerX[i]);
+            const __m256 y = _mm256_loadu_ps(&table.centerY[i]);
+            const __m256 z = _mm256_loadu_ps(&table.centerZ[i]);
+            const __m256 negRadius = _mm256_sub_ps(zero, _mm256_loadu_ps(&table.radius[i]));
+            __m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (int p = 0; p < 6; p++) {
+                __m256 distance = _mm256_add_ps(_mm256_mul_ps(planes[p][0], x), _mm256_mul_ps(planes[p][1], y));
+                distance = _mm256_add_ps(_mm256_add_ps(distance, _mm256_mul_ps(planes[p][2], z)), planes[p][3]);
+                visible = _mm256_and_ps(visible, _mm256_cmp_ps(distance, negRadius, _CMP_GE_OQ));
+            }
+            if (lodSelection && _mm256_movemask_ps(visible) != 0) {
+                const __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(&table.lodCenterX[i]), cameraX);
+                const __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(&table.lodCenterY[i]), cameraY);
+                const __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(&table.lodCenterZ[i]), cameraZ);
+                const __m256 lengthSq =
+                    _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+                const __m256 distance =
+                    _mm256_max_ps(_mm256_sub_ps(_mm256_sqrt_ps(lengthSq), _mm256_loadu_ps(&table.lodRadius[i])), lodNear);
+                const __m256 parentX = _mm256_sub_ps(_mm256_loadu_ps(&table.parentCenterX[i]), cameraX);
+                const __m256 parentY = _mm256_sub_ps(_mm256_loadu_ps(&table.parentCenterY[i]), cameraY);
+                const __m256 parentZ = _mm256_sub_ps(_mm256_loadu_ps(&table.parentCenterZ[i]), cameraZ);
+                const __m256 parentLengthSq = _mm256_add_ps(
+                    _mm256_add_ps(_mm256_mul_ps(parentX, parentX), _mm256_mul_ps(parentY, parentY)), _mm256_mul_ps(parentZ, parentZ));
+                const __m256 parentDistance =
+                    _mm256_max_ps(_mm256_sub_ps(_mm256_sqrt_ps(parentLengthSq), _mm256_loadu_ps(&table.parentRadius[i])), lodNear);
+                const __m256 error = _mm256_mul_ps(_mm256_loadu_ps(&table.lodError[i]), lodScale);
+                const __m256 parentError = _mm256_mul_ps(_mm256_loadu_ps(&table.parentError[i]), lodScale);
+                visible = _mm256_and_ps(visible, _mm256_cmp_ps(error, distance, _CMP_LE_OQ));
+                visible = _mm256_andnot_ps(_mm256_cmp_ps(parentError, parentDistance, _CMP_LE_OQ), visible);
+            }
+            if (params.backfaceCulling && _mm256_movemask_ps(visible) != 0) {
+                const __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(&table.coneApexX[i]), cameraX);
+                const __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(&table.coneApexY[i]), cameraY);
+                const __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(&table.coneApexZ[i]), cameraZ);
+                const __m256 cosineX = _mm256_mul_ps(dx, _mm256_loadu_ps(&table.coneAxisX[i]));
+                const __m256 cosineY = _mm256_mul_ps(dy, _mm256_loadu_ps(&table.coneAxisY[i]));
+                const __m256 cosineZ = _mm256_mul_ps(dz, _mm256_loadu_ps(&table.coneAxisZ[i]));
+                const __m256 cosine = _mm256_add_ps(_mm256_add_ps(cosineX, cosineY), cosineZ);
+                const __m256 lengthSq =
+                    _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+                const __m256 threshold = _mm256_mul_ps(_mm256_loadu_ps(&table.coneCutoff[i]), _mm256_sqrt_ps(lengthSq));
+                visible = _mm256_andnot_ps(_mm256_cmp_ps(cosine, threshold, _CMP_GE_OQ), visible);
+            }
+            const uint32_t mask = (uint32_t)_mm256_movemask_ps(visible) & tailMask(i, last, 8);
+            visibleCount += compactMask(mask, i, pVisible + visibleCount);
+        }
+        return visibleCount;
+    }
+#endif
+
+    size_t cullMeshlets(
+        CullPath path,
+        const CullParams& params,
+        const MeshletBuilder::MeshletBoundsTable& table,
+        size_t first,
+        size_t last,
+        uint32_t* pVisible) {
+        // The SIMD loops read whole blocks, the table padding keeps the last one in bounds.
+        assert(first % MeshletBuilder::BOUNDS_TABLE_ALIGNMENT == 0);
+        assert(last <= table.count);
+        switch (path) {
+#ifdef MESHLET_CULLING_AVX2
+        case CULL_PATH_AVX2:
+            if (bestCullPath() == CULL_PATH_AVX2) {
+                return cullAVX2(params, table, first, last, pVisible);
+            }
+            [[fallthrough]];
+#endif
+#ifdef MESHLET_CULLING_SSE
+        case CULL_PATH_SSE:
+            return cullSSE(params, table, first, last, pVisible);
+#endif
+        default:
+            return cullScalar(params, table, first, last, pVisible);
+        }
+    }
+
+    void emitVisibleIndices(void* pUserData, const uint32_t* pVisible, size_t count, size_t dstOffset) {
+        memcpy((uint32_t*)pUserData + dstOffset, pVisible, count * sizeof(uint32_t));
+    }
+
+    struct CullWorkers {
+        std::vector<std::thread> threads;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable done;
+        uint64_t generation = 0; // bumped once per run, workers wait for it to change
+        uint32_t pending = 0;    // background workers still inside the current job
+        bool exit = false;
+        void (*job)(CullWorkers* pWorkers, uint32_t workerIndex) = nullptr;
+
+        // Current cull, only valid while a job is running.
+        CullPath path = CULL_PATH_SCALAR;
+        const CullParams* pParams = nullptr;
+        const MeshletBuilder::MeshletBoundsTable* pTable = nullptr;
+        CullEmitFn emit = nullptr;
+        void* pUserData = nullptr;
+        std::atomic<size_t> nextChunk = 0;
+        std::atomic<size_t> outputCount = 0;
+        std::vector<std::vector<uint32_t>> visible; // per worker, capacity kept across frames
+    };
+
+    static void workerMain(CullWorkers* pWorkers, uint32_t workerIndex) {
+        uint64_t seenGeneration = 0;
+        std::unique_lock<std::mutex> lock(pWorkers->mutex);
+        for (;;) {
+            pWorkers->wake.wait(lock, [&] {
+                return pWorkers->exit || pWorkers->generation != seenGeneration;
+            });
+            if (pWorkers->exit) {
+                return;
+            }
+            seenGeneration = pWorkers->generation;
+            lock.unlock();
+            pWorkers->job(pWorkers, workerIndex);
+            lock.lock();
+            if (--pWorkers->pending == 0) {
+                pWorkers->done.notify_one();
+            }
+        }
+    }
+
+    // Runs job on every worker, the caller included, and returns once all of them are done.
+    static void runOnWorkers(CullWorkers* pWorkers, void (*job)(CullWorkers* pWorkers, uint32_t workerIndex)) {
+        {
+            std::lock_guard<std::mutex> lock(pWorkers->mutex);
+            pWorkers->job = job;
+            pWorkers->pending = (uint32_t)pWorkers->threads.size();
+            pWorkers->generation++;
+        }
+        pWorkers->wake.notify_all();
+        job(pWorkers, 0);
+        std::unique_lock<std::mutex> lock(pWorkers->mutex);
+        pWorkers->done.wait(lock, [&] {
+            return pWorkers->pending == 0;
+        });
+    }
+
+    CullWorkers* createCullWorkers(uint32_t threadCount) {
+        if (threadCount == 0) {
+            threadCount = std::thread::hardware_concurrency();
+        }
+        if (threadCount == 0) {
+            threadCount = 1;
+        }
+        CullWorkers* pWorkers = new CullWorkers();
+        pWorkers->visible.resize(threadCount);
+        pWorkers->threads.reserve(threadCount - 1);
+        for (uint32_t i = 1; i < threadCount; i++) {
+            pWorkers->threads.emplace_back(workerMain, pWorkers, i);
+        }
+        return pWorkers;
+    }
+
+    void destroyCullWorkers(CullWorkers* pWorkers) {
+        if (!pWorkers) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(pWorkers->mutex);
+            pWorkers->exit = true;
+        }
+        pWorkers->wake.notify_all();
+        for (std::thread& thread : pWorkers->threads) {
+            thread.join();
+        }
+        delete pWorkers;
+    }
+
+    uint32_t cullWorkerCount(const CullWorkers* pWorkers) {
+        return (uint32_t)pWorkers->visible.size();
+    }
+
+    static void cullJob(CullWorkers* pWorkers, uint32_t workerIndex) {
+        const MeshletBuilder::MeshletBoundsTable& table = *pWorkers->pTable;
+        std::vector<uint32_t>& visible = pWorkers->visible[workerIndex];
+        size_t visibleCount = 0;
+        for (size_t chunk = pWorkers->nextChunk++; chunk * CULL_CHUNK_SIZE < table.count; chunk = pWorkers->nextChunk++) {
+            const size_t first = chunk * CULL_CHUNK_SIZE;
+            const size_t last = first + CULL_CHUNK_SIZE < table.count ? first + CULL_CHUNK_SIZE : table.count;
+            if (visible.size() < visibleCount + (last - first)) {
+                visible.resize(visibleCount + (last - first));
+            }
+            visibleCount += cullMeshlets(pWorkers->path, *pWorkers->pParams, table, first, last, visible.data() + visibleCount);
+        }
+        if (visibleCount == 0) {
+            return;
+        }
+        // Lock-free merge: one atomic add per worker per frame reserves its slice of the output.
+        const size_t dstOffset = pWorkers->outputCount.fetch_add(visibleCount);
+        pWorkers->emit(pWorkers->pUserData, visible.data(), visibleCount, dstOffset);
+    }
+
+    size_t cullMeshletsParallel(
+        CullWorkers* pWorkers,
+        CullPath path,
+        const CullParams& params,
+        const MeshletBuilder::MeshletBoundsTable& table,
+        CullEmitFn emit,
+        void* pUserData) {
+        static_assert(CULL_CHUNK_SIZE % MeshletBuilder::BOUNDS_TABLE_ALIGNMENT == 0, "chunks must start on a SIMD block");
+        pWorkers->path = path;
+        pWorkers->pParams = &params;
+        pWorkers->pTable = &table;
+        pWorkers->emit = emit;
+        pWorkers->pUserData = pUserData;
+        pWorkers->nextChunk = 0;
+        pWorkers->outputCount = 0;
+        runOnWorkers(pWorkers, cullJob);
+        return pWorkers->outputCount;
+    }
+} // namespace MeshletCulling
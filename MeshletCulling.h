@@ -0,0 +1,80 @@
+#pragma once
+
+#include "MeshletBuilder.h"
+
+// CPU meshlet culling against a MeshletBuilder::MeshletBoundsTable. Like the builder this
+// has no renderer dependency, so every path can be checked against the scalar reference and
+// timed from MeshletBake.
+namespace MeshletCulling {
+    enum CullPath : uint32_t {
+        CULL_PATH_SCALAR = 0,
+        CULL_PATH_SSE = 1,  // 4 meshlets per iteration
+        CULL_PATH_AVX2 = 2, // 8 meshlets per iteration
+        CULL_PATH_COUNT,
+    };
+
+    struct CullParams {
+        // Normalized planes, a point p is inside when dot(plane.xyz, p) + plane.w >= 0.
+        float planes[6][4];
+        float cameraPosition[3];
+        bool backfaceCulling;
+        // Picks the cut through a LOD hierarchy (see MeshletBuilder::MeshletLod): a meshlet is
+        // kept if error * lodScale <= max(distance to its sphere, lodNear) and the same doesn't hold
+        // for its parent. Ignored for tables without a hierarchy.
+        bool lodSelection;
+        float lodScale;
+        float lodNear;
+    };
+
+    // viewProj is column-major with clip = viewProj * float4(p, 1) and clip depth in [0, w],
+    // which covers both regular and reversed Z. LOD selection starts off.
+    void makeCullParams(const float viewProj[16], const float cameraPosition[3], bool backfaceCulling, CullParams& params);
+    // Turns on LOD selection at pixelError pixels of screen space error. projectionScale is the
+    // number of pixels one object space unit covers at distance 1, viewport size / (2 tan(fov / 2))
+    // along either axis; distances are clamped to zNear.
+    void setLodSelection(float projectionScale, float pixelError, float zNear, CullParams& params);
+
+    // Fastest path supported by the compiler and the CPU we are running on.
+    CullPath bestCullPath();
+    const char* cullPathName(CullPath path);
+
+    // Writes the indices of the meshlets in [first, last) that pass the frustum (bounding sphere),
+    // LOD and backface cone tests to pVisible, in ascending order, and returns how many were written.
+    // first must be a multiple of MeshletBuilder::BOUNDS_TABLE_ALIGNMENT and pVisible must have
+    // room for last - first indices. Every path produces exactly the scalar result.
+    size_t cullMeshlets(
+        CullPath path,
+        const CullParams& params,
+        const MeshletBuilder::MeshletBoundsTable& table,
+        size_t first,
+        size_t last,
+        uint32_t* pVisible);
+
+    // Meshlets per unit of work handed to a culling worker, a multiple of BOUNDS_TABLE_ALIGNMENT.
+    static constexpr size_t CULL_CHUNK_SIZE = 8192;
+
+    // Receives count visible meshlet indices that belong at [dstOffset, dstOffset + count) of the
+    // merged output. Called concurrently from several workers, always with disjoint ranges.
+    typedef void (*CullEmitFn)(void* pUserData, const uint32_t* pVisible, size_t count, size_t dstOffset);
+    // CullEmitFn that copies the indices into the uint32_t array pointed to by pUserData.
+    void emitVisibleIndices(void* pUserData, const uint32_t* pVisible, size_t count, size_t dstOffset);
+
+    // Persistent worker pool plus the per-worker visible lists, created once and reused every frame.
+    struct CullWorkers;
+    // threadCount 0 = one worker per hardware thread. The calling thread always acts as worker 0.
+    CullWorkers* createCullWorkers(uint32_t threadCount);
+    void destroyCullWorkers(CullWorkers* pWorkers);
+    uint32_t cullWorkerCount(const CullWorkers* pWorkers);
+
+    // Culls every meshlet in table on all workers. Chunks of CULL_CHUNK_SIZE meshlets are pulled
+    // from a shared counter and culled into the worker's own list; each worker then reserves its
+    // output range with a single atomic add and passes its list to emit. Returns the total visible
+    // count. The set of meshlets matches cullMeshlets, their order depends on scheduling.
+    size_t cullMeshletsParallel(
+        CullWorkers* pWorkers,
+        CullPath path,
+        const CullParams& params,
+        const MeshletBuilder::MeshletBoundsTable& table,
+        CullEmitFn emit,
+        void* pUserData);
+} // namespace MeshletCulling
@@ -0,0 +1,34 @@
+#include "MeshletDrawArgs.h"
+
+#include <assert.h>
+
+namespace MeshletDrawArgs {
+    void emitDrawIndexedArgs(void* pUserData, const uint32_t* pVisible, size_t count, size_t dstOffset) {
+        const EmitTarget* pTarget = (const EmitTarget*)pUserData;
+        DrawIndexedArgs* pArgs = (DrawIndexedArgs*)pTarget->pArgs + dstOffset;
+        for (size_t i = 0; i < count; i++) {
+            const MeshletDrawRange& range = pTarget->pRanges[pVisible[i]];
+            DrawIndexedArgs args;
+            args.indexCount = range.indexCount;
+            args.instanceCount = 1;
+            args.firstIndex = range.firstIndex;
+            args.vertexOffset = range.baseVertex;
+            args.firstInstance = pVisible[i];
+            pArgs[i] = args;
+        }
+    }
+
+    void emitDrawArgs(void* pUserData, const uint32_t* pVisible, size_t count, size_t dstOffset) {
+        const EmitTarget* pTarget = (const EmitTarget*)pUserData;
+        DrawArgs* pArgs = (DrawArgs*)pTarget->pArgs + dstOffset;
+        for (size_t i = 0; i < count; i++) {
+            assert(pVisible[i] < MAX_PULLED_MESHLETS);
+            DrawArgs args;
+            args.vertexCount = pTarget->pRanges[pVisible[i]].indexCount;
+            args.instanceCount = 1;
+            args.firstVertex = pVisible[i] << MESHLET_VERTEX_ID_SHIFT;
+            args.firstInstance = 0;
+            pArgs[i] = args;
+        }
+    }
+} // namespace MeshletDrawArgs
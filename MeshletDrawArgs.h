@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Indirect draw argument generation for visible meshlets. GPU-free like the culling it plugs
+// into: the emitters are MeshletCulling::CullEmitFn callbacks that write straight into a
+// (mapped) argument buffer, so the per-meshlet CPU cost is one struct store.
+namespace MeshletDrawArgs {
+    // Non-indexed meshlet draws pack the meshlet into the vertex id, which unlike the instance id
+    // includes the draw's first vertex on every API: SV_VertexID = meshlet << SHIFT | corner.
+    // 3 * 124 corners fit in 9 bits. Must match resources.h.fsl.
+    static constexpr uint32_t MESHLET_VERTEX_ID_SHIFT = 9;
+    static constexpr uint32_t MAX_MESHLET_CORNERS = 1u << MESHLET_VERTEX_ID_SHIFT;
+    // The meshlet gets the remaining bits, so non-indexed draws can't reach meshlets past this.
+    static constexpr uint64_t MAX_PULLED_MESHLETS = 1ull << (32 - MESHLET_VERTEX_ID_SHIFT);
+
+    // Same layout as the renderer's IndirectDrawIndexArguments.
+    struct DrawIndexedArgs {
+        uint32_t indexCount;
+        uint32_t instanceCount;
+        uint32_t firstIndex;
+        int32_t vertexOffset;
+        uint32_t firstInstance;
+    };
+
+    // Same layout as the renderer's IndirectDrawArguments.
+    struct DrawArgs {
+        uint32_t vertexCount;
+        uint32_t instanceCount;
+        uint32_t firstVertex;
+        uint32_t firstInstance;
+    };
+
+    // Where a meshlet's geometry lives in the GPU buffers, taken from its MeshletSlot.
+    struct MeshletDrawRange {
+        uint32_t firstIndex;  // in micro-index elements of the index buffer
+        uint32_t indexCount;  // 3 * triangle count
+        int32_t baseVertex;   // first vertex in the position buffer
+    };
+
+    // pUserData of the emitters below.
+    struct EmitTarget {
+        const MeshletDrawRange* pRanges; // indexed by meshlet
+        void* pArgs;                     // DrawIndexedArgs or DrawArgs array with room for every meshlet
+    };
+
+    // One indexed draw per visible meshlet, for index buffers holding 32 bit micro-indices.
+    void emitDrawIndexedArgs(void* pUserData, const uint32_t* pVisible, size_t count, size_t dstOffset);
+    // One non-indexed draw per visible meshlet for the vertex pulling shaders, which fetch and
+    // decode the micro-indices themselves. Meshlet ids must be below MAX_PULLED_MESHLETS.
+    void emitDrawArgs(void* pUserData, const uint32_t* pVisible, size_t count, size_t dstOffset);
+} // namespace MeshletDrawArgs
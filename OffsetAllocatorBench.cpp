@@ -0,0 +1,592 @@
+// Headless OffsetAllocator benchmarks and stress tests.
+//
+//   OffsetAllocatorBench [--threads <n>] [--ops <n>] [--latency] [--policies] [--replay <trace>]
+//                        [--record <trace>] [--csv <file>]
+//
+// Checks that concurrent allocations never overlap, then compares allocation throughput of a
+// single mutex-guarded Allocator with ConcurrentAllocator from 1 to <threads> threads.
+// --latency instead times single-threaded allocate and free on a well filled allocator and
+// reports the metadata footprint, at 128K and 1M max allocations.
+// --policies replays a synthetic meshlet streaming trace with every AllocationPolicy and compares
+// per-call latency percentiles, failed allocations, node peaks and the largest free region over
+// time. --replay does the same with a trace recorded by OffsetAllocator::TraceRecorder, e.g. with
+// the Meshlet viewer's --record-allocations. --record writes the synthetic trace to a file and
+// --csv writes the free region samples of either.
+
+#include "concurrentOffsetAllocator.h"
+#include "offsetAllocator.h"
+#include "offsetAllocatorTrace.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+static constexpr uint32_t ALLOCATOR_SIZE = 64 * 1024 * 1024;
+static constexpr uint32_t ALLOCATOR_MAX_ALLOCS = 1024 * 1024;
+static constexpr uint32_t LIVE_ALLOCATIONS_PER_THREAD = 1024;
+
+static double elapsedMs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static uint32_t nextRandom(uint32_t& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// Meshlet-like sizes: mostly up to 256 elements, with occasional larger primitives.
+static uint32_t randomSize(uint32_t& state) {
+    const uint32_t r = nextRandom(state);
+    return (r & 0xff) < 218 ? 1 + (r >> 8) % 256 : 257 + (r >> 8) % 3840;
+}
+
+// Mutex around a plain Allocator, the baseline the concurrent front end has to beat.
+struct LockedAllocator {
+    OffsetAllocator::Allocator allocator{ ALLOCATOR_SIZE, ALLOCATOR_MAX_ALLOCS };
+    std::mutex mutex;
+
+    OffsetAllocator::Allocation allocate(uint32_t size) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return allocator.allocate(size);
+    }
+    void free(OffsetAllocator::Allocation allocation) {
+        std::lock_guard<std::mutex> lock(mutex);
+        allocator.free(allocation);
+    }
+};
+
+struct Live {
+    OffsetAllocator::Allocation allocation;
+    uint32_t size;
+    uint32_t tag;
+};
+
+// Random allocate/free mix keeping up to LIVE_ALLOCATIONS_PER_THREAD ranges alive. With pMemory
+// set every range is filled with a per-allocation tag and checked before it is freed, so two
+// threads handed overlapping ranges show up as a mismatch. Returns the number of failed checks.
+template <typename AllocateFn, typename FreeFn>
+static uint32_t runWorkload(uint32_t threadIndex, uint32_t opCount, uint32_t* pMemory, AllocateFn allocate, FreeFn free) {
+    uint32_t state = 0x9e3779b9u * (threadIndex + 1);
+    std::vector<Live> live;
+    live.reserve(LIVE_ALLOCATIONS_PER_THREAD);
+    uint32_t errors = 0;
+    uint32_t nextTag = threadIndex << 24;
+
+    auto release = [&](size_t i) {
+        const Live& entry = live[i];
+        if (pMemory) {
+            for (uint32_t j = 0; j < entry.size; j++) {
+                errors += pMemory[entry.allocation.offset + j] != entry.tag;
+            }
+        }
+        free(entry.allocation);
+        live[i] = live.back();
+        live.pop_back();
+    };
+
+    for (uint32_t op = 0; op < opCount; op++) {
+        const uint32_t r = nextRandom(state);
+        if (live.empty() || (live.size() < LIVE_ALLOCATIONS_PER_THREAD && (r & 1))) {
+            const uint32_t size = randomSize(state);
+            const OffsetAllocator::Allocation allocation = allocate(size);
+            if (allocation.offset == OffsetAllocator::Allocation::NO_SPACE) {
+                errors++;
+                continue;
+            }
+            const Live entry = { allocation, size, ++nextTag };
+            if (pMemory) {
+                for (uint32_t j = 0; j < size; j++) {
+                    pMemory[allocation.offset + j] = entry.tag;
+                }
+            }
+            live.push_back(entry);
+        } else {
+            release((r >> 1) % live.size());
+        }
+    }
+    while (!live.empty()) {
+        release(live.size() - 1);
+    }
+    return errors;
+}
+
+// Runs fn(threadIndex) on threadCount threads released together, returns the wall time in ms.
+template <typename Fn>
+static double runThreads(uint32_t threadCount, Fn fn) {
+    std::atomic<bool> go{ false };
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < threadCount; t++) {
+        threads.emplace_back([&, t]() {
+            while (!go.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            fn(t);
+        });
+    }
+    const auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    return elapsedMs(start);
+}
+
+static bool stressConcurrent(uint32_t threadCount, uint32_t opCount) {
+    OffsetAllocator::ConcurrentAllocator allocator(ALLOCATOR_SIZE, ALLOCATOR_MAX_ALLOCS);
+    std::vector<uint32_t> memory(ALLOCATOR_SIZE);
+    std::atomic<uint32_t> errors{ 0 };
+    runThreads(threadCount, [&](uint32_t t) {
+        OffsetAllocator::ConcurrentAllocator::ThreadCache* pCache = allocator.createThreadCache();
+        errors += runWorkload(
+            t,
+            opCount,
+            memory.data(),
+            [&](uint32_t size) { return allocator.allocate(pCache, size); },
+            [&](OffsetAllocator::Allocation allocation) { allocator.free(pCache, allocation); });
+        allocator.destroyThreadCache(pCache);
+    });
+
+    // Every range went back, so the allocator must be one free block again.
+    const OffsetAllocator::StorageReport report = allocator.storageReport();
+    const bool ok = errors == 0 && report.totalFreeSpace == ALLOCATOR_SIZE;
+    printf("  stress %u threads x %u ops: %s (%u errors, %u free)\n", threadCount, opCount, ok ? "ok" : "FAILED", errors.load(),
+           report.totalFreeSpace);
+    return ok;
+}
+
+// Allocator with a third of its nodes live (free nodes between them take up to another third),
+// then batches of allocations and of frees at random
+// positions, which keeps the neighbor merges and bin list unlinks of free() busy.
+static void benchLatency(uint32_t maxAllocs, uint32_t opCount) {
+    if (maxAllocs > OffsetAllocator::MAX_NODE_COUNT) {
+        printf("  %8u    needs 32 bit node indices\n", maxAllocs);
+        return;
+    }
+    static constexpr uint32_t BATCH_SIZE = 1024;
+    OffsetAllocator::Allocator allocator(OffsetAllocator::Allocator::MAX_SIZE, maxAllocs);
+    std::vector<OffsetAllocator::Allocation> live;
+    live.reserve(maxAllocs);
+    uint32_t state = 0x2545f491u;
+    while (live.size() < maxAllocs / 3) {
+        live.push_back(allocator.allocate(randomSize(state)));
+    }
+
+    double allocateMs = 0.0;
+    double freeMs = 0.0;
+    uint32_t sizes[BATCH_SIZE];
+    for (uint32_t done = 0; done < opCount; done += BATCH_SIZE) {
+        for (uint32_t i = 0; i < BATCH_SIZE; i++) {
+            sizes[i] = randomSize(state);
+        }
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < BATCH_SIZE; i++) {
+            live.push_back(allocator.allocate(sizes[i]));
+        }
+        allocateMs += elapsedMs(start);
+
+        // Pick the victims first so the timed loop is only the frees
+        OffsetAllocator::Allocation victims[BATCH_SIZE];
+        for (uint32_t i = 0; i < BATCH_SIZE; i++) {
+            const size_t index = nextRandom(state) % live.size();
+            victims[i] = live[index];
+            live[index] = live.back();
+            live.pop_back();
+        }
+        start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < BATCH_SIZE; i++) {
+            allocator.free(victims[i]);
+        }
+        freeMs += elapsedMs(start);
+    }
+
+    // Reset drops every live allocation at once, cost should not depend on maxAllocs
+    static constexpr uint32_t RESET_COUNT = 64;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < RESET_COUNT; i++) {
+        allocator.reset();
+        allocator.allocate(randomSize(state));
+    }
+    const double resetMs = elapsedMs(start);
+
+    const double ops = (double)((opCount + BATCH_SIZE - 1) / BATCH_SIZE * BATCH_SIZE);
+    printf("  %8u    %12.1f    %8.1f    %9.1f    %13.2f\n", maxAllocs, allocateMs * 1e6 / ops, freeMs * 1e6 / ops,
+           resetMs * 1e6 / RESET_COUNT, allocator.metadataSize() / (1024.0 * 1024.0));
+}
+
+// Streaming load on an index pool: groups of meshlets (3 elements per triangle, mostly full
+// 124 triangle meshlets) are loaded with one allocateBatch each, like uploadMeshlets does per
+// primitive, and random groups are unloaded while the live size is above liveTarget elements.
+// A frame ends after every group. The pool has 10% slack over liveTarget.
+static void makeStreamingTrace(
+    uint32_t opCount, uint32_t liveTarget, OffsetAllocator::TraceHeader& header, std::vector<OffsetAllocator::TraceOp>& trace) {
+    std::vector<std::vector<uint32_t>> groups;
+    std::vector<uint32_t> sizes;
+    uint32_t state = 0x9e3779b9u;
+    uint32_t liveSize = 0;
+    trace.clear();
+    while (trace.size() < opCount) {
+        if (liveSize > liveTarget && !groups.empty()) {
+            const size_t index = nextRandom(state) % groups.size();
+            for (uint32_t id : groups[index]) {
+                trace.push_back({ OffsetAllocator::TRACE_FREE, id, 0 });
+                liveSize -= sizes[id];
+            }
+            groups[index] = std::move(groups.back());
+            groups.pop_back();
+        } else {
+            std::vector<uint32_t> group(8 + nextRandom(state) % 249);
+            trace.push_back({ OffsetAllocator::TRACE_BATCH, 0, (uint32_t)group.size() });
+            for (uint32_t& id : group) {
+                const uint32_t r = nextRandom(state);
+                const uint32_t triangles = (r & 0xff) < 180 ? 124 : 1 + (r >> 8) % 124;
+                id = (uint32_t)sizes.size();
+                sizes.push_back(triangles * 3);
+                trace.push_back({ OffsetAllocator::TRACE_ALLOCATE, id, triangles * 3 });
+                liveSize += triangles * 3;
+            }
+            groups.push_back(std::move(group));
+        }
+        trace.push_back({ OffsetAllocator::TRACE_FRAME, 0, 0 });
+    }
+
+    header = {};
+    header.magic = OffsetAllocator::TraceHeader::MAGIC;
+    header.version = OffsetAllocator::TraceHeader::VERSION;
+    header.size = liveTarget + liveTarget / 10;
+    header.maxAllocs = 128 * 1024;
+    header.policy = OffsetAllocator::POLICY_GOOD_FIT;
+    header.opCount = (uint32_t)trace.size();
+    header.idCount = (uint32_t)sizes.size();
+}
+
+struct ReplaySample {
+    uint32_t op;
+    uint32_t largestFreeRegion;
+    uint32_t totalFreeSpace;
+};
+
+struct ReplayResult {
+    std::vector<uint32_t> allocateNs; // per allocate call
+    std::vector<uint32_t> batchNs;    // per allocateBatch call
+    std::vector<uint32_t> freeNs;
+    uint32_t failed;                  // allocate and allocateBatch calls that failed
+    uint32_t failedWithSpace;         // of those, failures with enough total free space
+    uint32_t peakNodeCount;
+    std::vector<ReplaySample> samples; // at every frame end, or every 256 ops without frames
+};
+
+template <typename Fn>
+static uint32_t timeNs(Fn fn) {
+    const auto start = std::chrono::steady_clock::now();
+    fn();
+    return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Replays ops on a fresh allocator with the given policy. With pRecorder set the calls are
+// recorded again, which turns a synthetic trace into a file.
+static ReplayResult replayTrace(const OffsetAllocator::TraceHeader& header, const OffsetAllocator::TraceOp* ops,
+                                OffsetAllocator::AllocationPolicy policy, OffsetAllocator::TraceRecorder* pRecorder) {
+    static constexpr uint32_t SAMPLE_INTERVAL = 256;
+    OffsetAllocator::Allocator allocator(header.size, header.maxAllocs, policy);
+    std::vector<OffsetAllocator::Allocation> allocations(header.idCount);
+    std::vector<uint32_t> recordedIds(pRecorder ? header.idCount : 0); // trace id -> id in the new recording
+    std::vector<uint32_t> batchSizes;
+    std::vector<OffsetAllocator::Allocation> batchAllocations;
+    ReplayResult result = {};
+    bool hasFrames = false;
+    for (uint32_t i = 0; i < header.opCount && !hasFrames; i++) {
+        hasFrames = ops[i].type == OffsetAllocator::TRACE_FRAME;
+    }
+
+    for (uint32_t i = 0; i < header.opCount; i++) {
+        const OffsetAllocator::TraceOp& op = ops[i];
+        switch (op.type) {
+        case OffsetAllocator::TRACE_ALLOCATE: {
+            OffsetAllocator::Allocation& allocation = allocations[op.id];
+            result.allocateNs.push_back(timeNs([&] { allocation = allocator.allocate(op.size); }));
+            if (allocation.offset == OffsetAllocator::Allocation::NO_SPACE) {
+                result.failed++;
+                result.failedWithSpace += allocator.storageReport().totalFreeSpace >= op.size;
+            }
+            if (pRecorder) {
+                recordedIds[op.id] = pRecorder->allocate(allocation, op.size);
+            }
+            break;
+        }
+        case OffsetAllocator::TRACE_BATCH: {
+            // The pieces follow as TRACE_ALLOCATE ops
+            uint32_t count = 0;
+            uint64_t totalSize = 0;
+            batchSizes.clear();
+            while (count < op.size && i + 1 + count < header.opCount && ops[i + 1 + count].type == OffsetAllocator::TRACE_ALLOCATE) {
+                batchSizes.push_back(ops[i + 1 + count].size);
+                totalSize += ops[i + 1 + count].size;
+                count++;
+            }
+            batchAllocations.resize(count);
+            bool allocated = false;
+            result.batchNs.push_back(
+                timeNs([&] { allocated = allocator.allocateBatch(batchSizes.data(), count, batchAllocations.data()); }));
+            if (!allocated) {
+                result.failed++;
+                result.failedWithSpace += allocator.storageReport().totalFreeSpace >= totalSize;
+            }
+            for (uint32_t j = 0; j < count; j++) {
+                allocations[ops[i + 1 + j].id] = batchAllocations[j];
+            }
+            if (pRecorder) {
+                const uint32_t firstId = pRecorder->allocateBatch(batchAllocations.data(), batchSizes.data(), count);
+                for (uint32_t j = 0; j < count; j++) {
+                    recordedIds[ops[i + 1 + j].id] = firstId + j;
+                }
+            }
+            i += count;
+            break;
+        }
+        case OffsetAllocator::TRACE_FREE: {
+            // Frees whatever this replay got for the id, which may differ from the recording
+            OffsetAllocator::Allocation& allocation = allocations[op.id];
+            const bool allocated = allocation.offset != OffsetAllocator::Allocation::NO_SPACE;
+            if (pRecorder) {
+                if (allocated) {
+                    pRecorder->free(allocation);
+                } else {
+                    pRecorder->freeId(recordedIds[op.id]);
+                }
+            }
+            if (!allocated) {
+                break;
+            }
+            result.freeNs.push_back(timeNs([&] { allocator.free(allocation); }));
+            allocation = {};
+            break;
+        }
+        case OffsetAllocator::TRACE_GROW:
+            allocator.grow(op.size);
+            if (pRecorder) {
+                pRecorder->grow(op.size);
+            }
+            break;
+        case OffsetAllocator::TRACE_FRAME:
+            if (pRecorder) {
+                pRecorder->frame();
+            }
+            break;
+        case OffsetAllocator::TRACE_RETRY:
+            // The repeated call reuses the failed one's ids. Where the first attempt succeeded in
+            // this replay it is not issued, so the ids keep their first allocation.
+            if (op.size > 0 && allocations[op.id].offset != OffsetAllocator::Allocation::NO_SPACE) {
+                if (i + 1 < header.opCount && ops[i + 1].type == OffsetAllocator::TRACE_BATCH) {
+                    i++;
+                    for (uint32_t count = 0; count < ops[i].size && i + 1 < header.opCount &&
+                                             ops[i + 1].type == OffsetAllocator::TRACE_ALLOCATE;
+                         count++) {
+                        i++;
+                    }
+                } else if (i + 1 < header.opCount && ops[i + 1].type == OffsetAllocator::TRACE_ALLOCATE) {
+                    i++;
+                }
+            } else if (pRecorder) {
+                pRecorder->retry();
+            }
+            break;
+        }
+
+        if (hasFrames ? op.type == OffsetAllocator::TRACE_FRAME : i % SAMPLE_INTERVAL == SAMPLE_INTERVAL - 1) {
+            const OffsetAllocator::StorageReport report = allocator.storageReport();
+            result.samples.push_back({ i, report.largestFreeRegion, report.totalFreeSpace });
+        }
+    }
+    result.peakNodeCount = allocator.stats().peakNodeCount;
+    return result;
+}
+
+static void printPercentiles(const char* pName, std::vector<uint32_t>& values) {
+    if (values.empty()) {
+        return;
+    }
+    std::sort(values.begin(), values.end());
+    auto percentile = [&](double p) { return values[(size_t)(p * (double)(values.size() - 1))]; };
+    printf("    %-12s p50 %6u    p90 %6u    p99 %6u    p99.9 %7u    max %8u    (%zu calls)\n", pName, percentile(0.5), percentile(0.9),
+           percentile(0.99), percentile(0.999), values.back(), values.size());
+}
+
+// Replays the trace with every policy and prints timings (ns, including the clock reads),
+// failures, node and metadata peaks and the largest free region over time. With pCsvFile set the
+// samples are written there too.
+static void compareReplays(const OffsetAllocator::TraceHeader& header, const OffsetAllocator::TraceOp* ops, FILE* pCsvFile) {
+    static const char* policyNames[] = { "good fit", "best fit", "lowest address" };
+    if (pCsvFile) {
+        fprintf(pCsvFile, "policy,op,largestFreeRegion,totalFreeSpace,fragmentation\n");
+    }
+    for (uint32_t policy = 0; policy < sizeof(policyNames) / sizeof(policyNames[0]); policy++) {
+        ReplayResult result = replayTrace(header, ops, (OffsetAllocator::AllocationPolicy)policy, NULL);
+        printf("  %s%s\n", policyNames[policy], policy == header.policy ? " (recorded)" : "");
+        printPercentiles("allocate ns", result.allocateNs);
+        printPercentiles("batch ns", result.batchNs);
+        printPercentiles("free ns", result.freeNs);
+
+        const uint32_t metadataSize = result.peakNodeCount * OffsetAllocator::Allocator::memoryRequirement(1);
+        printf("    failed %u (%u with enough free space), peak nodes %u (%.1f KB node storage touched)\n", result.failed,
+               result.failedWithSpace, result.peakNodeCount, metadataSize / 1024.0);
+
+        uint32_t minLargest = header.size;
+        double meanLargest = 0.0;
+        double meanFragmentation = 0.0;
+        for (const ReplaySample& sample : result.samples) {
+            const OffsetAllocator::StorageReport report = { sample.totalFreeSpace, sample.largestFreeRegion };
+            minLargest = sample.largestFreeRegion < minLargest ? sample.largestFreeRegion : minLargest;
+            meanLargest += sample.largestFreeRegion;
+            meanFragmentation += report.fragmentation();
+            if (pCsvFile) {
+                fprintf(pCsvFile, "%s,%u,%u,%u,%.4f\n", policyNames[policy], sample.op, sample.largestFreeRegion, sample.totalFreeSpace,
+                        report.fragmentation());
+            }
+        }
+        if (!result.samples.empty()) {
+            const size_t sampleCount = result.samples.size();
+            printf("    largest free region min %u, mean %.0f, final %u; fragmentation mean %.3f (%zu samples)\n", minLargest,
+                   meanLargest / sampleCount, result.samples.back().largestFreeRegion, meanFragmentation / sampleCount, sampleCount);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    uint32_t maxThreads = std::thread::hardware_concurrency();
+    uint32_t opCount = 1000000;
+    bool latency = false;
+    bool policies = false;
+    const char* pReplayPath = NULL;
+    const char* pRecordPath = NULL;
+    const char* pCsvPath = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            maxThreads = (uint32_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--ops") == 0 && i + 1 < argc) {
+            opCount = (uint32_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--latency") == 0) {
+            latency = true;
+        } else if (strcmp(argv[i], "--policies") == 0) {
+            policies = true;
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            pReplayPath = argv[++i];
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            pRecordPath = argv[++i];
+        } else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc) {
+            pCsvPath = argv[++i];
+        } else {
+            printf("usage: %s [--threads <n>] [--ops <n>] [--latency] [--policies] [--replay <trace>] [--record <trace>] [--csv <file>]\n",
+                   argv[0]);
+            return 1;
+        }
+    }
+    maxThreads = maxThreads > 0 ? maxThreads : 1;
+
+    if (latency) {
+        printf("Latency, %u ops, %zu bit node indices\n", opCount, sizeof(OffsetAllocator::NodeIndex) * 8);
+        printf("  maxAllocs    allocate ns    free ns    reset ns    metadata MB\n");
+        benchLatency(128 * 1024, opCount);
+        benchLatency(1024 * 1024, opCount);
+        if (OffsetAllocator::MAX_NODE_COUNT < 128 * 1024) {
+            benchLatency(OffsetAllocator::MAX_NODE_COUNT, opCount);
+        }
+        return 0;
+    }
+
+    if (policies || pReplayPath || pRecordPath) {
+        OffsetAllocator::TraceHeader header;
+        std::vector<OffsetAllocator::TraceOp> synthetic;
+        OffsetAllocator::TraceOp* pOps = NULL;
+        if (pReplayPath) {
+            if (!OffsetAllocator::loadTrace(pReplayPath, header, pOps)) {
+                printf("Failed to load trace %s\n", pReplayPath);
+                return 1;
+            }
+            printf("Allocation trace %s, %u ops, %u allocations, size %u\n", pReplayPath, header.opCount, header.idCount, header.size);
+        } else {
+            // Live size swings around 1M elements plus one group
+            makeStreamingTrace(opCount, 1024 * 1024, header, synthetic);
+            pOps = synthetic.data();
+            printf("Synthetic streaming trace, %u ops, %u allocations, size %u\n", header.opCount, header.idCount, header.size);
+        }
+
+        if (pRecordPath) {
+            OffsetAllocator::TraceRecorder recorder;
+            if (!recorder.open(pRecordPath, header.size, header.maxAllocs, (OffsetAllocator::AllocationPolicy)header.policy)) {
+                printf("Failed to open %s\n", pRecordPath);
+                return 1;
+            }
+            replayTrace(header, pOps, (OffsetAllocator::AllocationPolicy)header.policy, &recorder);
+            printf("Recorded to %s\n", pRecordPath);
+        }
+
+        FILE* pCsvFile = pCsvPath ? fopen(pCsvPath, "w") : NULL;
+        if (pCsvPath && !pCsvFile) {
+            printf("Failed to open %s\n", pCsvPath);
+        }
+        if (policies || pReplayPath) {
+            compareReplays(header, pOps, pCsvFile);
+        }
+        if (pCsvFile) {
+            fclose(pCsvFile);
+        }
+        if (pOps != synthetic.data()) {
+            delete[] pOps;
+        }
+        return 0;
+    }
+
+    printf("Concurrent stress test\n");
+    bool ok = true;
+    for (uint32_t threads = 1; threads <= maxThreads; threads *= 2) {
+        ok &= stressConcurrent(threads, opCount / 4);
+    }
+    if (maxThreads & (maxThreads - 1)) {
+        ok &= stressConcurrent(maxThreads, opCount / 4);
+    }
+
+    printf("Throughput, %u ops per thread (allocate + free)\n", opCount);
+    printf("  threads    locked Mops/s    concurrent Mops/s\n");
+    for (uint32_t threads = 1; threads <= maxThreads; threads++) {
+        LockedAllocator locked;
+        std::atomic<uint32_t> errors{ 0 };
+        const double lockedMs = runThreads(threads, [&](uint32_t t) {
+            errors += runWorkload(
+                t,
+                opCount,
+                NULL,
+                [&](uint32_t size) { return locked.allocate(size); },
+                [&](OffsetAllocator::Allocation allocation) { locked.free(allocation); });
+        });
+
+        OffsetAllocator::ConcurrentAllocator concurrent(ALLOCATOR_SIZE, ALLOCATOR_MAX_ALLOCS);
+        const double concurrentMs = runThreads(threads, [&](uint32_t t) {
+            OffsetAllocator::ConcurrentAllocator::ThreadCache* pCache = concurrent.createThreadCache();
+            errors += runWorkload(
+                t,
+                opCount,
+                NULL,
+                [&](uint32_t size) { return concurrent.allocate(pCache, size); },
+                [&](OffsetAllocator::Allocation allocation) { concurrent.free(pCache, allocation); });
+            concurrent.destroyThreadCache(pCache);
+        });
+
+        const double totalOps = (double)threads * opCount;
+        printf("  %7u    %13.2f    %17.2f\n", threads, totalOps / lockedMs / 1000.0, totalOps / concurrentMs / 1000.0);
+        if (errors) {
+            printf("  %u allocations failed\n", errors.load());
+            ok = false;
+        }
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,163 @@
+// Thread-safe front end for OffsetAllocator::Allocator
+
+#include "concurrentOffsetAllocator.h"
+
+#ifdef DEBUG
+#include <assert.h>
+#define ASSERT(x) assert(x)
+#else
+#define ASSERT(x)
+#endif
+
+#include <cstring>
+
+namespace OffsetAllocator
+{
+    static_assert(ConcurrentAllocator::NUM_SIZE_CLASSES == 49, "size classes must cover MAX_CACHED_SIZE");
+
+    struct ConcurrentAllocator::ThreadCache
+    {
+        struct Magazine
+        {
+            // Stack, the lowest offset on top. Holds up to two refills before flushing one back.
+            Allocation ranges[MAGAZINE_SIZE * 2];
+            uint32 count = 0;
+        };
+
+        Magazine magazines[NUM_SIZE_CLASSES];
+    };
+
+    ConcurrentAllocator::ConcurrentAllocator(uint32 size, uint32 maxAllocs) :
+        m_allocator(size, maxAllocs)
+    {
+    }
+
+    ConcurrentAllocator::~ConcurrentAllocator()
+    {
+    }
+
+    ConcurrentAllocator::ThreadCache* ConcurrentAllocator::createThreadCache()
+    {
+        return new ThreadCache();
+    }
+
+    void ConcurrentAllocator::destroyThreadCache(ThreadCache* cache)
+    {
+        if (!cache) return;
+        flush(cache);
+        delete cache;
+    }
+
+    void ConcurrentAllocator::flush(ThreadCache* cache)
+    {
+        if (!cache) return;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (uint32 i = 0; i < NUM_SIZE_CLASSES; i++)
+        {
+            ThreadCache::Magazine& magazine = cache->magazines[i];
+            for (uint32 j = 0; j < magazine.count; j++)
+                m_allocator.free(magazine.ranges[j]);
+            magazine.count = 0;
+        }
+    }
+
+    Allocation ConcurrentAllocator::allocateLocked(uint32 size)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_allocator.allocate(size);
+    }
+
+    bool ConcurrentAllocator::refill(ThreadCache* cache, uint32 sizeClass)
+    {
+        ThreadCache::Magazine& magazine = cache->magazines[sizeClass];
+        ASSERT(magazine.count == 0);
+
+        // Carve in ascending offset order, stack them so the lowest offset pops first
+        uint32 classSize = SmallFloat::floatToUint(sizeClass);
+        Allocation carved[MAGAZINE_SIZE];
+        uint32 carvedCount = 0;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            while (carvedCount < MAGAZINE_SIZE)
+            {
+                Allocation allocation = m_allocator.allocate(classSize);
+                if (allocation.offset == Allocation::NO_SPACE) break;
+                carved[carvedCount++] = allocation;
+            }
+        }
+
+        for (uint32 i = 0; i < carvedCount; i++)
+            magazine.ranges[i] = carved[carvedCount - i - 1];
+        magazine.count = carvedCount;
+        return carvedCount > 0;
+    }
+
+    Allocation ConcurrentAllocator::allocate(ThreadCache* cache, uint32 size)
+    {
+        if (size == 0 || size > MAX_CACHED_SIZE)
+        {
+            return allocateLocked(size);
+        }
+
+        uint32 sizeClass = SmallFloat::uintToFloatRoundUp(size);
+        ASSERT(sizeClass < NUM_SIZE_CLASSES);
+        if (!cache)
+        {
+            // Still class sized, so the range can later be freed into any cache
+            return allocateLocked(SmallFloat::floatToUint(sizeClass));
+        }
+
+        ThreadCache::Magazine& magazine = cache->magazines[sizeClass];
+        if (magazine.count == 0 && !refill(cache, sizeClass))
+        {
+            // Out of space: Our own other size classes may hold enough, give them back and retry once
+            flush(cache);
+            if (!refill(cache, sizeClass))
+            {
+                return {};
+            }
+        }
+        return magazine.ranges[--magazine.count];
+    }
+
+    void ConcurrentAllocator::free(ThreadCache* cache, Allocation allocation)
+    {
+        ASSERT(allocation.metadata != NO_NODE);
+
+        // The node of a live allocation is only written by whoever frees it, reading its size is safe
+        uint32 size = m_allocator.allocationSize(allocation);
+        if (!cache || size == 0 || size > MAX_CACHED_SIZE)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_allocator.free(allocation);
+            return;
+        }
+
+        uint32 sizeClass = SmallFloat::uintToFloatRoundUp(size);
+        ThreadCache::Magazine& magazine = cache->magazines[sizeClass];
+        if (magazine.count == MAGAZINE_SIZE * 2)
+        {
+            // Full: Hand the bottom half (oldest, highest offsets) back in one locked batch
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                for (uint32 i = 0; i < MAGAZINE_SIZE; i++)
+                    m_allocator.free(magazine.ranges[i]);
+            }
+            memmove(magazine.ranges, magazine.ranges + MAGAZINE_SIZE, sizeof(Allocation) * MAGAZINE_SIZE);
+            magazine.count = MAGAZINE_SIZE;
+        }
+        magazine.ranges[magazine.count++] = allocation;
+    }
+
+    uint32 ConcurrentAllocator::allocationSize(Allocation allocation) const
+    {
+        return m_allocator.allocationSize(allocation);
+    }
+
+    StorageReport ConcurrentAllocator::storageReport()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_allocator.storageReport();
+    }
+}
@@ -0,0 +1,54 @@
+// Thread-safe front end for OffsetAllocator::Allocator
+#pragma once
+
+#include "offsetAllocator.h"
+
+#include <mutex>
+
+namespace OffsetAllocator
+{
+    // Small allocations are served from per-thread magazines: stacks of ranges of one size class,
+    // carved out of the shared allocator in a single locked batch and recycled locally on free.
+    // Everything else takes the lock and goes to the shared allocator directly, so the lock is
+    // only contended on refills, flushes and large allocations.
+    //
+    // Small sizes are rounded up to their size class (the allocator's bin size, at most 12.5%
+    // overhead). Ranges cached by one thread can't be used by another, so the shared allocator
+    // can report NO_SPACE while other threads still hold free ranges; flush() hands them back.
+    class ConcurrentAllocator
+    {
+    public:
+        static constexpr uint32 MAX_CACHED_SIZE = 256; // largest size served from magazines
+        static constexpr uint32 MAGAZINE_SIZE = 32;    // ranges moved per refill or flush
+        static constexpr uint32 NUM_SIZE_CLASSES = 49; // SmallFloat::uintToFloatRoundUp(MAX_CACHED_SIZE) + 1
+
+        struct ThreadCache;
+
+        ConcurrentAllocator(uint32 size, uint32 maxAllocs = 128 * 1024);
+        ConcurrentAllocator(const ConcurrentAllocator &other) = delete;
+        ~ConcurrentAllocator();
+
+        void operator=(const ConcurrentAllocator &other) = delete;
+
+        // A cache belongs to one thread at a time. Destroying it returns its ranges.
+        ThreadCache* createThreadCache();
+        void destroyThreadCache(ThreadCache* cache);
+        void flush(ThreadCache* cache);
+
+        // cache may be null, then every call takes the lock. An allocation may be freed through
+        // any thread's cache.
+        Allocation allocate(ThreadCache* cache, uint32 size);
+        void free(ThreadCache* cache, Allocation allocation);
+
+        uint32 allocationSize(Allocation allocation) const;
+        // Ranges sitting in thread caches count as used
+        StorageReport storageReport();
+
+    private:
+        Allocation allocateLocked(uint32 size);
+        bool refill(ThreadCache* cache, uint32 sizeClass);
+
+        Allocator m_allocator;
+        std::mutex m_mutex;
+    };
+}
@@ -134,16 +134,33 @@ namespace OffsetAllocator
     }
 
     // Allocator...
-    Allocator::Allocator(uint32 size, uint32 maxAllocs) :
+    Allocator::Allocator(uint32 size, uint32 maxAllocs, AllocationPolicy policy) :
         m_size(size),
         m_maxAllocs(maxAllocs),
+        m_policy(policy),
         m_nodes(nullptr),
-        m_freeNodes(nullptr)
+        m_binLinks(nullptr),
+        m_freeNodes(nullptr),
+        m_ownsMemory(true)
     {
-        if (sizeof(NodeIndex) == 2)
-        {
-            ASSERT(maxAllocs <= 65536);
-        }
+        ASSERT(size <= MAX_SIZE);
+        ASSERT(maxAllocs <= MAX_NODE_COUNT);
+        if (m_maxAllocs > MAX_NODE_COUNT) m_maxAllocs = MAX_NODE_COUNT;
+        setMemory(new uint8[memoryRequirement(m_maxAllocs)]);
+        reset();
+    }
+
+    Allocator::Allocator(uint32 size, uint32 maxAllocs, void* memory, AllocationPolicy policy) :
+        m_size(size),
+        m_maxAllocs(maxAllocs),
+        m_policy(policy),
+        m_ownsMemory(false)
+    {
+        ASSERT(size <= MAX_SIZE);
+        ASSERT(maxAllocs <= MAX_NODE_COUNT);
+        ASSERT(memory != nullptr);
+        if (m_maxAllocs > MAX_NODE_COUNT) m_maxAllocs = MAX_NODE_COUNT;
+        setMemory(memory);
         reset();
     }
 
@@ -151,87 +168,172 @@ namespace OffsetAllocator
         m_size(other.m_size),
         m_maxAllocs(other.m_maxAllocs),
         m_freeStorage(other.m_freeStorage),
+        m_policy(other.m_policy),
         m_usedBinsTop(other.m_usedBinsTop),
         m_nodes(other.m_nodes),
+        m_binLinks(other.m_binLinks),
         m_freeNodes(other.m_freeNodes),
-        m_freeOffset(other.m_freeOffset)
+        m_freeCount(other.m_freeCount),
+        m_nextUnusedNode(other.m_nextUnusedNode),
+        m_ownsMemory(other.m_ownsMemory),
+        m_firstNode(other.m_firstNode),
+        m_lastNode(other.m_lastNode),
+        m_defragNode(other.m_defragNode),
+        m_allocationCount(other.m_allocationCount),
+        m_peakAllocationCount(other.m_peakAllocationCount),
+        m_peakUsedSize(other.m_peakUsedSize),
+        m_peakNodeCount(other.m_peakNodeCount),
+        m_failedAllocations(other.m_failedAllocations)
     {
         memcpy(m_usedBins, other.m_usedBins, sizeof(uint8) * NUM_TOP_BINS);
         memcpy(m_binIndices, other.m_binIndices, sizeof(NodeIndex) * NUM_LEAF_BINS);
+        memcpy(m_binCounts, other.m_binCounts, sizeof(uint32) * NUM_LEAF_BINS);
 
         other.m_nodes = nullptr;
+        other.m_binLinks = nullptr;
         other.m_freeNodes = nullptr;
-        other.m_freeOffset = 0;
+        other.m_freeCount = 0;
+        other.m_nextUnusedNode = 0;
+        other.m_ownsMemory = false;
         other.m_maxAllocs = 0;
         other.m_usedBinsTop = 0;
     }
 
     void Allocator::operator=(Allocator &&other) {
+        if (m_ownsMemory) delete[] (uint8*)m_nodes;
+
         m_size = other.m_size;
         m_maxAllocs = other.m_maxAllocs;
         m_freeStorage = other.m_freeStorage;
+        m_policy = other.m_policy;
         m_usedBinsTop = other.m_usedBinsTop;
         m_nodes = other.m_nodes;
+        m_binLinks = other.m_binLinks;
         m_freeNodes = other.m_freeNodes;
-        m_freeOffset = other.m_freeOffset;
+        m_freeCount = other.m_freeCount;
+        m_nextUnusedNode = other.m_nextUnusedNode;
+        m_ownsMemory = other.m_ownsMemory;
+        m_firstNode = other.m_firstNode;
+        m_lastNode = other.m_lastNode;
+        m_defragNode = other.m_defragNode;
+        m_allocationCount = other.m_allocationCount;
+        m_peakAllocationCount = other.m_peakAllocationCount;
+        m_peakUsedSize = other.m_peakUsedSize;
+        m_peakNodeCount = other.m_peakNodeCount;
+        m_failedAllocations = other.m_failedAllocations;
 
         memcpy(m_usedBins, other.m_usedBins, sizeof(uint8) * NUM_TOP_BINS);
         memcpy(m_binIndices, other.m_binIndices, sizeof(NodeIndex) * NUM_LEAF_BINS);
+        memcpy(m_binCounts, other.m_binCounts, sizeof(uint32) * NUM_LEAF_BINS);
 
         other.m_nodes = nullptr;
+        other.m_binLinks = nullptr;
         other.m_freeNodes = nullptr;
-        other.m_freeOffset = 0;
+        other.m_freeCount = 0;
+        other.m_nextUnusedNode = 0;
+        other.m_ownsMemory = false;
         other.m_maxAllocs = 0;
         other.m_usedBinsTop = 0;
     }
 
+    uint32 Allocator::memoryRequirement(uint32 maxAllocs)
+    {
+        return maxAllocs * (uint32)(sizeof(Node) + sizeof(BinLinks) + sizeof(NodeIndex));
+    }
+
+    void Allocator::setMemory(void* memory)
+    {
+        // One block: nodes, bin links, freelist. All element sizes are multiples of the NodeIndex size.
+        m_nodes = (Node*)memory;
+        m_binLinks = (BinLinks*)(m_nodes + m_maxAllocs);
+        m_freeNodes = (NodeIndex*)(m_binLinks + m_maxAllocs);
+    }
+
     void Allocator::reset()
     {
         m_freeStorage = 0;
         m_usedBinsTop = 0;
-        m_freeOffset = m_maxAllocs - 1;
 
         for (uint32 i = 0 ; i < NUM_TOP_BINS; i++)
             m_usedBins[i] = 0;
 
         for (uint32 i = 0 ; i < NUM_LEAF_BINS; i++)
-            m_binIndices[i] = Node::unused;
-
-        if (m_nodes) delete[] m_nodes;
-        if (m_freeNodes) delete[] m_freeNodes;
-
-        m_nodes = new Node[m_maxAllocs];
-        m_freeNodes = new NodeIndex[m_maxAllocs];
-
-        // Freelist is a stack. Nodes in inverse order so that [0] pops first.
-        for (uint32 i = 0; i < m_maxAllocs; i++)
         {
-            m_freeNodes[i] = m_maxAllocs - i - 1;
+            m_binIndices[i] = Node::unused;
+            m_binCounts[i] = 0;
         }
 
+        m_allocationCount = 0;
+        m_peakAllocationCount = 0;
+        m_peakUsedSize = 0;
+        m_peakNodeCount = 0;
+        m_failedAllocations = 0;
+
+        // Freelist starts empty, nodes are written when handed out. Until the first recycle
+        // popFreeNode bumps m_nextUnusedNode, handing out nodes in the order [0], [1], ...
+        m_freeCount = 0;
+        m_nextUnusedNode = 0;
+        m_firstNode = Node::unused;
+        m_lastNode = Node::unused;
+        m_defragNode = Node::unused;
+        if (m_maxAllocs == 0) return;
+
         // Start state: Whole storage as one big node
         // Algorithm will split remainders and push them back as smaller nodes
-        insertNodeIntoBin(m_size, 0);
+        m_firstNode = insertNodeIntoBin(m_size, 0);
+        m_lastNode = m_firstNode;
     }
 
     Allocator::~Allocator()
     {
-        delete[] m_nodes;
-        delete[] m_freeNodes;
+        if (m_ownsMemory) delete[] (uint8*)m_nodes;
     }
 
-    Allocation Allocator::allocate(uint32 size)
+    uint32 Allocator::popFreeNode()
     {
-        // Out of allocations?
-        if (m_freeOffset == 0)
+        ASSERT(freeNodeCount() > 0);
+        if (m_freeCount > 0)
         {
-            return {.offset = Allocation::NO_SPACE, .metadata = Allocation::NO_SPACE};
+#ifdef DEBUG_VERBOSE
+            printf("Getting node %u from freelist[%u]\n", m_freeNodes[m_freeCount - 1], m_freeCount - 1);
+#endif
+            return m_freeNodes[--m_freeCount];
         }
+#ifdef DEBUG_VERBOSE
+        printf("Getting unused node %u\n", m_nextUnusedNode);
+#endif
+        return m_nextUnusedNode++;
+    }
 
-        // Round up to bin index to ensure that alloc >= bin
-        // Gives us min bin index that fits the size
-        uint32 minBinIndex = SmallFloat::uintToFloatRoundUp(size);
+    void Allocator::pushFreeNode(uint32 nodeIndex)
+    {
+#ifdef DEBUG_VERBOSE
+        printf("Putting node %u into freelist[%u]\n", nodeIndex, m_freeCount);
+#endif
+        m_freeNodes[m_freeCount++] = nodeIndex;
+        if (m_defragNode == nodeIndex) m_defragNode = Node::unused;
+    }
+
+    Allocation Allocator::allocate(uint32 size)
+    {
+        Allocation allocation = allocateNode(size);
+        if (allocation.offset == Allocation::NO_SPACE) m_failedAllocations++;
+        else addAllocations(1);
+        return allocation;
+    }
+
+    void Allocator::addAllocations(uint32 count)
+    {
+        m_allocationCount += count;
+        uint32 usedSize = m_size - m_freeStorage;
+        uint32 nodeCount = m_nextUnusedNode - m_freeCount;
+        if (m_allocationCount > m_peakAllocationCount) m_peakAllocationCount = m_allocationCount;
+        if (usedSize > m_peakUsedSize) m_peakUsedSize = usedSize;
+        if (nodeCount > m_peakNodeCount) m_peakNodeCount = nodeCount;
+    }
 
+    uint32 Allocator::findFreeBin(uint32 minBinIndex) const
+    {
         uint32 minTopBinIndex = minBinIndex >> TOP_BINS_INDEX_SHIFT;
         uint32 minLeafBinIndex = minBinIndex & LEAF_BINS_INDEX_MASK;
 
@@ -250,44 +352,98 @@ namespace OffsetAllocator
             topBinIndex = findLowestSetBitAfter(m_usedBinsTop, minTopBinIndex + 1);
 
             // Out of space?
-            if (topBinIndex == Allocation::NO_SPACE)
-            {
-                return {.offset = Allocation::NO_SPACE, .metadata = Allocation::NO_SPACE};
-            }
+            if (topBinIndex == Allocation::NO_SPACE) return Allocation::NO_SPACE;
 
             // All leaf bins here fit the alloc, since the top bin was rounded up. Start leaf search from bit 0.
             // NOTE: This search can't fail since at least one leaf bit was set because the top bit was set.
             leafBinIndex = tzcnt_nonzero(m_usedBins[topBinIndex]);
         }
 
-        uint32 binIndex = (topBinIndex << TOP_BINS_INDEX_SHIFT) | leafBinIndex;
+        return (topBinIndex << TOP_BINS_INDEX_SHIFT) | leafBinIndex;
+    }
 
-        // Pop the top node of the bin. Bin top = node.next.
-        uint32 nodeIndex = m_binIndices[binIndex];
-        Node& node = m_nodes[nodeIndex];
-        uint32 nodeTotalSize = node.dataSize;
-        node.dataSize = size;
-        node.used = true;
-        m_binIndices[binIndex] = node.binListNext;
-        if (node.binListNext != Node::unused) m_nodes[node.binListNext].binListPrev = Node::unused;
-        m_freeStorage -= nodeTotalSize;
-#ifdef DEBUG_VERBOSE
-        printf("Free storage: %u (-%u) (allocate)\n", m_freeStorage, nodeTotalSize);
-#endif
+    uint32 Allocator::findFitNode(uint32 size, uint32& binIndex) const
+    {
+        // The bin of the rounded down size holds nodes from below size up, some of them may fit.
+        // Any fitting node there is smaller than every node of the bins above.
+        uint32 lowBinIndex = SmallFloat::uintToFloatRoundDown(size);
+        uint32 nodeIndex = Node::unused;
+        uint32 nodeBinIndex = Allocation::NO_SPACE;
+        if (lowBinIndex != binIndex)
+        {
+            nodeIndex = searchBin(lowBinIndex, size);
+            if (nodeIndex != Node::unused) nodeBinIndex = lowBinIndex;
+        }
 
-        // Bin empty?
-        if (m_binIndices[binIndex] == Node::unused)
+        if (binIndex != Allocation::NO_SPACE && (nodeIndex == Node::unused || m_policy == POLICY_LOWEST_ADDRESS))
         {
-            // Remove a leaf bin mask bit
-            m_usedBins[topBinIndex] &= ~(1 << leafBinIndex);
+            uint32 candidate = searchBin(binIndex, size);
+            if (nodeIndex == Node::unused || m_nodes[candidate].dataOffset < m_nodes[nodeIndex].dataOffset)
+            {
+                nodeIndex = candidate;
+                nodeBinIndex = binIndex;
+            }
+        }
 
-            // All leaf bins empty?
-            if (m_usedBins[topBinIndex] == 0)
+        binIndex = nodeBinIndex;
+        return nodeIndex;
+    }
+
+    uint32 Allocator::searchBin(uint32 binIndex, uint32 size) const
+    {
+        // Walks the whole list: smallest fitting node for best fit, lowest offset otherwise
+        uint32 bestIndex = Node::unused;
+        for (uint32 nodeIndex = m_binIndices[binIndex]; nodeIndex != Node::unused; nodeIndex = m_binLinks[nodeIndex].binListNext)
+        {
+            const Node& node = m_nodes[nodeIndex];
+            if (node.dataSize() < size) continue;
+            if (bestIndex == Node::unused)
+            {
+                bestIndex = nodeIndex;
+            }
+            else if (m_policy == POLICY_BEST_FIT)
             {
-                // Remove a top bin mask bit
-                m_usedBinsTop &= ~(1 << topBinIndex);
+                if (node.dataSize() < m_nodes[bestIndex].dataSize()) bestIndex = nodeIndex;
             }
+            else if (node.dataOffset < m_nodes[bestIndex].dataOffset)
+            {
+                bestIndex = nodeIndex;
+            }
+            if (m_policy == POLICY_BEST_FIT && m_nodes[bestIndex].dataSize() == size) break;
         }
+        return bestIndex;
+    }
+
+    Allocation Allocator::allocateNode(uint32 size)
+    {
+        // Out of allocations? Splitting off the remainder needs a node
+        if (freeNodeCount() == 0)
+        {
+            return {.offset = Allocation::NO_SPACE, .metadata = NO_NODE};
+        }
+
+        // Round up to bin index to ensure that alloc >= bin
+        // Gives us min bin index that fits the size
+        uint32 binIndex = findFreeBin(SmallFloat::uintToFloatRoundUp(size));
+        uint32 nodeIndex = binIndex != Allocation::NO_SPACE ? m_binIndices[binIndex] : (uint32)Node::unused;
+
+        // Good fit takes the bin's top node. The other policies search the bin and the one below.
+        if (m_policy != POLICY_GOOD_FIT) nodeIndex = findFitNode(size, binIndex);
+
+        // Out of space?
+        if (nodeIndex == Node::unused)
+        {
+            return {.offset = Allocation::NO_SPACE, .metadata = NO_NODE};
+        }
+
+        Node& node = m_nodes[nodeIndex];
+        uint32 nodeTotalSize = node.dataSize();
+        unlinkNodeFromBin(nodeIndex, binIndex);
+        node.dataSizeUsed = size | Node::USED_BIT;
+        m_freeStorage -= nodeTotalSize;
+#ifdef DEBUG_VERBOSE
+        printf("Free storage: %u (-%u) (allocate)\n", m_freeStorage, nodeTotalSize);
+#endif
 
         // Push back reminder N elements to a lower bin
         uint32 reminderSize = nodeTotalSize - size;
@@ -300,33 +456,36 @@ namespace OffsetAllocator
             if (node.neighborNext != Node::unused) m_nodes[node.neighborNext].neighborPrev = newNodeIndex;
             m_nodes[newNodeIndex].neighborPrev = nodeIndex;
             m_nodes[newNodeIndex].neighborNext = node.neighborNext;
+            if (node.neighborNext == Node::unused) m_lastNode = newNodeIndex;
             node.neighborNext = newNodeIndex;
         }
 
-        return {.offset = node.dataOffset, .metadata = nodeIndex};
+        return {.offset = node.dataOffset, .metadata = (NodeIndex)nodeIndex};
     }
 
     void Allocator::free(Allocation allocation)
     {
-        ASSERT(allocation.metadata != Allocation::NO_SPACE);
+        ASSERT(allocation.metadata != NO_NODE);
         if (!m_nodes) return;
 
         uint32 nodeIndex = allocation.metadata;
         Node& node = m_nodes[nodeIndex];
 
         // Double delete check
-        ASSERT(node.used == true);
+        ASSERT(node.used());
+
+        m_allocationCount--;
 
         // Merge with neighbors...
         uint32 offset = node.dataOffset;
-        uint32 size = node.dataSize;
+        uint32 size = node.dataSize();
 
-        if ((node.neighborPrev != Node::unused) && (m_nodes[node.neighborPrev].used == false))
+        if ((node.neighborPrev != Node::unused) && !m_nodes[node.neighborPrev].used())
         {
             // Previous (contiguous) free node: Change offset to previous node offset. Sum sizes
             Node& prevNode = m_nodes[node.neighborPrev];
             offset = prevNode.dataOffset;
-            size += prevNode.dataSize;
+            size += prevNode.dataSize();
 
             // Remove node from the bin linked list and put it in the freelist
             removeNodeFromBin(node.neighborPrev);
@@ -335,11 +494,11 @@ namespace OffsetAllocator
             node.neighborPrev = prevNode.neighborPrev;
         }
 
-        if ((node.neighborNext != Node::unused) && (m_nodes[node.neighborNext].used == false))
+        if ((node.neighborNext != Node::unused) && !m_nodes[node.neighborNext].used())
         {
             // Next (contiguous) free node: Offset remains the same. Sum sizes.
             Node& nextNode = m_nodes[node.neighborNext];
-            size += nextNode.dataSize;
+            size += nextNode.dataSize();
 
             // Remove node from the bin linked list and put it in the freelist
             removeNodeFromBin(node.neighborNext);
@@ -352,10 +511,7 @@ namespace OffsetAllocator
         uint32 neighborPrev = node.neighborPrev;
 
         // Insert the removed node to freelist
-#ifdef DEBUG_VERBOSE
-        printf("Putting node %u into freelist[%u] (free)\n", nodeIndex, m_freeOffset + 1);
-#endif
-        m_freeNodes[++m_freeOffset] = nodeIndex;
+        pushFreeNode(nodeIndex);
 
         // Insert the (combined) free node to bin
         uint32 combinedNodeIndex = insertNodeIntoBin(size, offset);
@@ -371,6 +527,123 @@ namespace OffsetAllocator
             m_nodes[combinedNodeIndex].neighborPrev = neighborPrev;
             m_nodes[neighborPrev].neighborNext = combinedNodeIndex;
         }
+        if (neighborNext == Node::unused) m_lastNode = combinedNodeIndex;
+        if (neighborPrev == Node::unused) m_firstNode = combinedNodeIndex;
+    }
+
+    bool Allocator::allocateBatch(const uint32* sizes, uint32 count, Allocation* out, bool allOrNothing)
+    {
+        if (count == 0) return true;
+
+        uint32 totalSize = 0;
+        bool fitsOneNode = freeNodeCount() >= count; // allocate() may take one node, the pieces count - 1
+        for (uint32 i = 0; i < count && fitsOneNode; i++)
+        {
+            fitsOneNode = sizes[i] <= MAX_SIZE - totalSize;
+            totalSize += sizes[i];
+        }
+
+        Allocation whole = fitsOneNode ? allocateNode(totalSize) : Allocation{};
+        if (whole.offset != Allocation::NO_SPACE)
+        {
+            // Shrink the node to the first piece and chain the others after it, all used.
+            // They never enter a bin, so no bin lookups beyond the one above.
+            uint32 nodeIndex = whole.metadata;
+            uint32 neighborNext = m_nodes[nodeIndex].neighborNext;
+            uint32 offset = whole.offset;
+            m_nodes[nodeIndex].dataSizeUsed = sizes[0] | Node::USED_BIT;
+            out[0] = {.offset = offset, .metadata = (NodeIndex)nodeIndex};
+            offset += sizes[0];
+
+            for (uint32 i = 1; i < count; i++)
+            {
+                uint32 pieceIndex = popFreeNode();
+                m_nodes[pieceIndex] = {.dataOffset = offset, .dataSizeUsed = sizes[i] | Node::USED_BIT,
+                                       .neighborPrev = (NodeIndex)nodeIndex};
+                m_nodes[nodeIndex].neighborNext = pieceIndex;
+                out[i] = {.offset = offset, .metadata = (NodeIndex)pieceIndex};
+                offset += sizes[i];
+                nodeIndex = pieceIndex;
+            }
+
+            m_nodes[nodeIndex].neighborNext = neighborNext;
+            if (neighborNext != Node::unused) m_nodes[neighborNext].neighborPrev = nodeIndex;
+            else m_lastNode = nodeIndex;
+            addAllocations(count);
+            return true;
+        }
+
+        // No node fits the batch: Piece by piece
+        bool allAllocated = true;
+        for (uint32 i = 0; i < count; i++)
+        {
+            out[i] = allocate(sizes[i]);
+            if (out[i].offset != Allocation::NO_SPACE) continue;
+
+            allAllocated = false;
+            if (allOrNothing)
+            {
+                // Free in reverse so every node merges back the way it was split
+                for (uint32 j = i; j > 0; j--)
+                {
+                    free(out[j - 1]);
+                    out[j - 1] = {};
+                }
+                for (uint32 j = i + 1; j < count; j++) out[j] = {};
+                return false;
+            }
+        }
+        return allAllocated;
+    }
+
+    void Allocator::freeBatch(const Allocation* allocations, uint32 count)
+    {
+        for (uint32 i = 0; i < count; i++)
+        {
+            if (allocations[i].metadata != NO_NODE) free(allocations[i]);
+        }
+    }
+
+    bool Allocator::grow(uint32 newSize)
+    {
+        if (m_maxAllocs == 0 || newSize <= m_size || newSize > MAX_SIZE) return false;
+
+        uint32 extraSize = newSize - m_size;
+        Node& lastNode = m_nodes[m_lastNode];
+        if (!lastNode.used())
+        {
+            // Free tail: Take it out of its bin and reinsert it with the combined size.
+            // Its node goes back to the freelist first, so the insert can't run out of nodes.
+            uint32 offset = lastNode.dataOffset;
+            uint32 size = lastNode.dataSize() + extraSize;
+            uint32 neighborPrev = lastNode.neighborPrev;
+            removeNodeFromBin(m_lastNode);
+
+            uint32 nodeIndex = insertNodeIntoBin(size, offset);
+            if (neighborPrev != Node::unused)
+            {
+                m_nodes[nodeIndex].neighborPrev = neighborPrev;
+                m_nodes[neighborPrev].neighborNext = nodeIndex;
+            }
+            else
+            {
+                m_firstNode = nodeIndex;
+            }
+            m_lastNode = nodeIndex;
+        }
+        else
+        {
+            // Used tail: The new space becomes a free node after it
+            if (freeNodeCount() == 0) return false;
+
+            uint32 nodeIndex = insertNodeIntoBin(extraSize, m_size);
+            m_nodes[nodeIndex].neighborPrev = m_lastNode;
+            lastNode.neighborNext = nodeIndex;
+            m_lastNode = nodeIndex;
+        }
+
+        m_size = newSize;
+        return true;
     }
 
     uint32 Allocator::insertNodeIntoBin(uint32 size, uint32 dataOffset)
@@ -391,13 +664,12 @@ namespace OffsetAllocator
 
         // Take a freelist node and insert on top of the bin linked list (next = old top)
         uint32 topNodeIndex = m_binIndices[binIndex];
-        uint32 nodeIndex = m_freeNodes[m_freeOffset--];
-#ifdef DEBUG_VERBOSE
-        printf("Getting node %u from freelist[%u]\n", nodeIndex, m_freeOffset + 1);
-#endif
-        m_nodes[nodeIndex] = {.dataOffset = dataOffset, .dataSize = size, .binListNext = topNodeIndex};
-        if (topNodeIndex != Node::unused) m_nodes[topNodeIndex].binListPrev = nodeIndex;
+        uint32 nodeIndex = popFreeNode();
+        m_nodes[nodeIndex] = {.dataOffset = dataOffset, .dataSizeUsed = size};
+        m_binLinks[nodeIndex] = {.binListNext = (NodeIndex)topNodeIndex};
+        if (topNodeIndex != Node::unused) m_binLinks[topNodeIndex].binListPrev = nodeIndex;
         m_binIndices[binIndex] = nodeIndex;
+        m_binCounts[binIndex]++;
 
         m_freeStorage += size;
 #ifdef DEBUG_VERBOSE
@@ -407,28 +679,25 @@ namespace OffsetAllocator
         return nodeIndex;
     }
 
-    void Allocator::removeNodeFromBin(uint32 nodeIndex)
+    void Allocator::unlinkNodeFromBin(uint32 nodeIndex, uint32 binIndex)
     {
-        Node &node = m_nodes[nodeIndex];
+        BinLinks &links = m_binLinks[nodeIndex];
+        m_binCounts[binIndex]--;
 
-        if (node.binListPrev != Node::unused)
+        if (links.binListPrev != Node::unused)
         {
             // Easy case: We have previous node. Just remove this node from the middle of the list.
-            m_nodes[node.binListPrev].binListNext = node.binListNext;
-            if (node.binListNext != Node::unused) m_nodes[node.binListNext].binListPrev = node.binListPrev;
+            m_binLinks[links.binListPrev].binListNext = links.binListNext;
+            if (links.binListNext != Node::unused) m_binLinks[links.binListNext].binListPrev = links.binListPrev;
         }
         else
         {
-            // Hard case: We are the first node in a bin. Find the bin.
-
-            // Round down to bin index to ensure that bin >= alloc
-            uint32 binIndex = SmallFloat::uintToFloatRoundDown(node.dataSize);
-
+            // Hard case: We are the first node in a bin. Update the bin.
             uint32 topBinIndex = binIndex >> TOP_BINS_INDEX_SHIFT;
             uint32 leafBinIndex = binIndex & LEAF_BINS_INDEX_MASK;
 
-            m_binIndices[binIndex] = node.binListNext;
-            if (node.binListNext != Node::unused) m_nodes[node.binListNext].binListPrev = Node::unused;
+            m_binIndices[binIndex] = links.binListNext;
+            if (links.binListNext != Node::unused) m_binLinks[links.binListNext].binListPrev = Node::unused;
 
             // Bin empty?
             if (m_binIndices[binIndex] == Node::unused)
@@ -444,25 +713,123 @@ namespace OffsetAllocator
                 }
             }
         }
+    }
+
+    void Allocator::removeNodeFromBin(uint32 nodeIndex)
+    {
+        Node &node = m_nodes[nodeIndex];
+
+        // Round down to bin index to ensure that bin >= alloc
+        unlinkNodeFromBin(nodeIndex, SmallFloat::uintToFloatRoundDown(node.dataSize()));
 
         // Insert the node to freelist
-#ifdef DEBUG_VERBOSE
-        printf("Putting node %u into freelist[%u] (removeNodeFromBin)\n", nodeIndex, m_freeOffset + 1);
-#endif
-        m_freeNodes[++m_freeOffset] = nodeIndex;
+        pushFreeNode(nodeIndex);
 
-        m_freeStorage -= node.dataSize;
+        m_freeStorage -= node.dataSize();
 #ifdef DEBUG_VERBOSE
-        printf("Free storage: %u (-%u) (removeNodeFromBin)\n", m_freeStorage, node.dataSize);
+        printf("Free storage: %u (-%u) (removeNodeFromBin)\n", m_freeStorage, node.dataSize());
 #endif
     }
 
+    uint32 Allocator::defragment(Move* moves, uint32 maxMoves, uint32 maxSize)
+    {
+        if (m_maxAllocs == 0) return 0;
+
+        // All free space in the tail node? Nothing to compact.
+        uint32 tailFreeSize = m_nodes[m_lastNode].used() ? 0 : m_nodes[m_lastNode].dataSize();
+        if (m_freeStorage == tailFreeSize)
+        {
+            m_defragNode = Node::unused;
+            return 0;
+        }
+
+        uint32 moveCount = 0;
+        uint32 movedSize = 0;
+        uint32 nodeIndex = m_defragNode != Node::unused ? m_defragNode : m_firstNode;
+        while (nodeIndex != Node::unused && moveCount < maxMoves)
+        {
+            Node& node = m_nodes[nodeIndex];
+            if (node.used())
+            {
+                nodeIndex = node.neighborNext;
+                continue;
+            }
+
+            // Free nodes are always merged, so the next node of a free node is used
+            uint32 nextIndex = node.neighborNext;
+            if (nextIndex == Node::unused)
+            {
+                // Reached the free tail: Pass done. The next call starts over to pick up new holes.
+                nodeIndex = Node::unused;
+                break;
+            }
+            ASSERT(m_nodes[nextIndex].used());
+
+            uint32 size = m_nodes[nextIndex].dataSize();
+            if (moveCount > 0 && size > maxSize - movedSize) break;
+
+            moves[moveCount++] = {.srcOffset = m_nodes[nextIndex].dataOffset, .dstOffset = node.dataOffset, .size = size,
+                                  .metadata = (NodeIndex)nextIndex};
+            // Saturate: The first move may exceed the budget on its own
+            movedSize = size > maxSize - movedSize ? maxSize : movedSize + size;
+            nodeIndex = slideNextNodeDown(nodeIndex);
+        }
+
+        m_defragNode = nodeIndex;
+        return moveCount;
+    }
+
+    uint32 Allocator::slideNextNodeDown(uint32 freeNodeIndex)
+    {
+        Node& freeNode = m_nodes[freeNodeIndex];
+        uint32 usedNodeIndex = freeNode.neighborNext;
+        Node& usedNode = m_nodes[usedNodeIndex];
+
+        uint32 gapOffset = freeNode.dataOffset;
+        uint32 gapSize = freeNode.dataSize();
+        uint32 neighborPrev = freeNode.neighborPrev;
+        removeNodeFromBin(freeNodeIndex);
+
+        // Used node takes the free node's place in the neighbor chain
+        usedNode.dataOffset = gapOffset;
+        usedNode.neighborPrev = neighborPrev;
+        if (neighborPrev != Node::unused) m_nodes[neighborPrev].neighborNext = usedNodeIndex;
+        else m_firstNode = usedNodeIndex;
+
+        // The gap now follows the used node. Merge it with the next node if that one is free.
+        uint32 neighborNext = usedNode.neighborNext;
+        if (neighborNext != Node::unused && !m_nodes[neighborNext].used())
+        {
+            gapSize += m_nodes[neighborNext].dataSize();
+            uint32 nextNext = m_nodes[neighborNext].neighborNext;
+            removeNodeFromBin(neighborNext);
+            neighborNext = nextNext;
+        }
+
+        uint32 gapNodeIndex = insertNodeIntoBin(gapSize, usedNode.dataOffset + usedNode.dataSize());
+        m_nodes[gapNodeIndex].neighborPrev = usedNodeIndex;
+        m_nodes[gapNodeIndex].neighborNext = neighborNext;
+        usedNode.neighborNext = gapNodeIndex;
+        if (neighborNext != Node::unused) m_nodes[neighborNext].neighborPrev = gapNodeIndex;
+        else m_lastNode = gapNodeIndex;
+
+        return gapNodeIndex;
+    }
+
+    uint32 Allocator::allocationOffset(Allocation allocation) const
+    {
+        if (allocation.metadata == NO_NODE) return Allocation::NO_SPACE;
+        if (!m_nodes) return Allocation::NO_SPACE;
+
+        return m_nodes[allocation.metadata].dataOffset;
+    }
+
     uint32 Allocator::allocationSize(Allocation allocation) const
     {
-        if (allocation.metadata == Allocation::NO_SPACE) return 0;
+        if (allocation.metadata == NO_NODE) return 0;
         if (!m_nodes) return 0;
 
-        return m_nodes[allocation.metadata].dataSize;
+        return m_nodes[allocation.metadata].dataSize();
     }
 
     StorageReport Allocator::storageReport() const
@@ -471,7 +838,7 @@ namespace OffsetAllocator
         uint32 freeStorage = 0;
 
         // Out of allocations? -> Zero free space
-        if (m_freeOffset > 0)
+        if (freeNodeCount() > 0)
         {
             freeStorage = m_freeStorage;
             if (m_usedBinsTop)
@@ -491,16 +858,27 @@ namespace OffsetAllocator
         StorageReportFull report;
         for (uint32 i = 0; i < NUM_LEAF_BINS; i++)
         {
-            uint32 count = 0;
-            uint32 nodeIndex = m_binIndices[i];
-            while (nodeIndex != Node::unused)
-            {
-                nodeIndex = m_nodes[nodeIndex].binListNext;
-                count++;
-            }
-            report.freeRegions[i] = { .size = SmallFloat::floatToUint(i), .count = count };
+            report.freeRegions[i] = { .size = SmallFloat::floatToUint(i), .count = m_binCounts[i] };
         }
         return report;
     }
-}
 
+    AllocatorStats Allocator::stats() const
+    {
+        uint32 nodeCount = m_nextUnusedNode - m_freeCount;
+        return {
+            .allocationCount = m_allocationCount,
+            .usedSize = m_size - m_freeStorage,
+            .freeRegionCount = nodeCount - m_allocationCount,
+            .peakAllocationCount = m_peakAllocationCount,
+            .peakUsedSize = m_peakUsedSize,
+            .peakNodeCount = m_peakNodeCount,
+            .failedAllocations = m_failedAllocations,
+        };
+    }
+
+    uint32 Allocator::metadataSize() const
+    {
+        return memoryRequirement(m_maxAllocs) + (uint32)sizeof(Allocator);
+    }
+}
@@ -2,7 +2,7 @@
 // MIT License (see file: LICENSE)
 #pragma once
 
-//#define USE_16_BIT_OFFSETS
+//#define USE_16_BIT_NODE_INDICES
 
 namespace OffsetAllocator
 {
@@ -10,13 +10,15 @@ namespace OffsetAllocator
     typedef unsigned short uint16;
     typedef unsigned int uint32;
 
-    // 16 bit offsets mode will halve the metadata storage cost
-    // But it only supports up to 65536 maximum allocation count
+    // 16 bit node index mode cuts the metadata storage cost by a third
+    // But it only supports up to 65535 maximum allocation count (index 0xffff marks "no node")
 #ifdef USE_16_BIT_NODE_INDICES
     typedef uint16 NodeIndex;
 #else
     typedef uint32 NodeIndex;
 #endif
+    static constexpr NodeIndex NO_NODE = (NodeIndex)0xffffffff;
+    static constexpr uint32 MAX_NODE_COUNT = NO_NODE;
 
     static constexpr uint32 NUM_TOP_BINS = 32;
     static constexpr uint32 BINS_PER_LEAF = 8;
@@ -24,18 +26,58 @@ namespace OffsetAllocator
     static constexpr uint32 LEAF_BINS_INDEX_MASK = 0x7;
     static constexpr uint32 NUM_LEAF_BINS = NUM_TOP_BINS * BINS_PER_LEAF;
 
+    // Bin size classes: sizes as floats with 3 mantissa bits. Shared with the front ends on top of Allocator.
+    namespace SmallFloat
+    {
+        uint32 uintToFloatRoundUp(uint32 size);
+        uint32 uintToFloatRoundDown(uint32 size);
+        uint32 floatToUint(uint32 floatValue);
+    }
+
+    // How allocate() picks among the free nodes that fit
+    enum AllocationPolicy : uint8
+    {
+        POLICY_GOOD_FIT,       // Top node of the first non-empty bin at or above the rounded up size, O(1)
+        POLICY_BEST_FIT,       // Smallest fitting node of that bin or the bin below, walks their lists
+        POLICY_LOWEST_ADDRESS, // Lowest offset among the fitting nodes of those two bins, walks their lists
+    };
+
     struct Allocation
     {
         static constexpr uint32 NO_SPACE = 0xffffffff;
 
         uint32 offset = NO_SPACE;
-        NodeIndex metadata = NO_SPACE; // internal: node index
+        NodeIndex metadata = NO_NODE; // internal: node index
+    };
+
+    // One allocation relocated by Allocator::defragment
+    struct Move
+    {
+        uint32 srcOffset;
+        uint32 dstOffset;
+        uint32 size;
+        NodeIndex metadata; // Allocation::metadata of the moved allocation, stays valid
     };
 
     struct StorageReport
     {
         uint32 totalFreeSpace;
         uint32 largestFreeRegion;
+
+        // 0 when the free space is one region, towards 1 as it splits into small ones
+        float fragmentation() const { return totalFreeSpace ? 1.0f - (float)largestFreeRegion / (float)totalFreeSpace : 0.0f; }
+    };
+
+    // Counters maintained by every allocate/free, reading them is O(1)
+    struct AllocatorStats
+    {
+        uint32 allocationCount;     // live allocations
+        uint32 usedSize;            // their total size
+        uint32 freeRegionCount;     // free nodes, see StorageReportFull for the sizes
+        uint32 peakAllocationCount; // high-water marks since construction or reset
+        uint32 peakUsedSize;
+        uint32 peakNodeCount;       // allocations + free regions, the maxAllocs budget
+        uint32 failedAllocations;   // allocate() calls that returned NO_SPACE
     };
 
     struct StorageReportFull
@@ -50,50 +92,124 @@ namespace OffsetAllocator
     class Allocator
     {
     public:
-        Allocator(uint32 size, uint32 maxAllocs = 128 * 1024);
+        // The node's used flag shares a word with its size
+        static constexpr uint32 MAX_SIZE = 0x7fffffff;
+
+        Allocator(uint32 size, uint32 maxAllocs = 128 * 1024, AllocationPolicy policy = POLICY_GOOD_FIT);
+        // Keeps its node storage in caller memory of at least memoryRequirement(maxAllocs) bytes,
+        // 4 byte aligned, for example from an arena. Contents need not be initialized. The memory
+        // must outlive the allocator, which never frees it.
+        Allocator(uint32 size, uint32 maxAllocs, void* memory, AllocationPolicy policy = POLICY_GOOD_FIT);
         Allocator(Allocator &&other);
         Allocator(const Allocator &other) = delete;
         ~Allocator();
+        // Frees everything. Cost is independent of maxAllocs: the node storage is reused and the
+        // freelist starts empty, untouched nodes are handed out by a bump index instead.
         void reset();
 
+        static uint32 memoryRequirement(uint32 maxAllocs);
+
         void operator=(Allocator &&other);
         void operator=(const Allocator &other) = delete;
 
         Allocation allocate(uint32 size);
         void free(Allocation allocation);
 
+        // Allocates count ranges with a single bin lookup when one free node fits them all: The node
+        // is carved into consecutive pieces, so out[i + 1].offset == out[i].offset + sizes[i].
+        // Otherwise falls back to one allocate per piece. With allOrNothing a failing piece rolls
+        // back the whole batch and every piece is NO_SPACE, else failed pieces are left as NO_SPACE. Returns true if every
+        // piece was allocated.
+        bool allocateBatch(const uint32* sizes, uint32 count, Allocation* out, bool allOrNothing = true);
+        // Frees in order, so a batch freed as a whole merges back into one free node.
+        void freeBatch(const Allocation* allocations, uint32 count);
+
+        // Extends the managed range to newSize. Existing allocations keep their offsets, the new
+        // space is merged into the last node when it is free or becomes a new free node after it.
+        // Fails if newSize is not larger than the current size or no node is left.
+        bool grow(uint32 newSize);
+        uint32 size() const { return m_size; }
+        AllocationPolicy policy() const { return m_policy; }
+
+        // Incremental compaction. Walks the neighbor chain from where the previous call stopped and
+        // slides used allocations down into the free space before them, writing at most maxMoves
+        // moves totalling at most maxSize (one larger move is allowed so big allocations still
+        // make progress). Returns the number of moves written. The allocations keep their metadata,
+        // their offset becomes the move's dstOffset (see allocationOffset). Moves of one call may
+        // overlap each other and themselves: copy every src range out before writing any dst.
+        uint32 defragment(Move* moves, uint32 maxMoves, uint32 maxSize);
+
+        uint32 allocationOffset(Allocation allocation) const;
         uint32 allocationSize(Allocation allocation) const;
         StorageReport storageReport() const;
+        // Free node count per bin, no list walks
         StorageReportFull storageReportFull() const;
+        AllocatorStats stats() const;
+        // Bytes of node storage, bin lists and freelist, independent of use
+        uint32 metadataSize() const;
 
     private:
+        Allocation allocateNode(uint32 size);
+        uint32 findFreeBin(uint32 minBinIndex) const;
+        uint32 findFitNode(uint32 size, uint32& binIndex) const;
+        uint32 searchBin(uint32 binIndex, uint32 size) const;
+        void unlinkNodeFromBin(uint32 nodeIndex, uint32 binIndex);
+        void addAllocations(uint32 count);
         uint32 insertNodeIntoBin(uint32 size, uint32 dataOffset);
         void removeNodeFromBin(uint32 nodeIndex);
+        uint32 slideNextNodeDown(uint32 freeNodeIndex);
+        void setMemory(void* memory);
+        uint32 freeNodeCount() const { return m_freeCount + m_maxAllocs - m_nextUnusedNode; }
+        uint32 popFreeNode();
+        void pushFreeNode(uint32 nodeIndex);
 
+        // Touched by every allocate/free, including the neighbor merge checks
         struct Node
         {
-            static constexpr NodeIndex unused = 0xffffffff;
+            static constexpr NodeIndex unused = NO_NODE;
+            static constexpr uint32 USED_BIT = 0x80000000;
 
             uint32 dataOffset = 0;
-            uint32 dataSize = 0;
-            NodeIndex binListPrev = unused;
-            NodeIndex binListNext = unused;
+            uint32 dataSizeUsed = 0; // Size in the low 31 bits, used flag on top
             NodeIndex neighborPrev = unused;
             NodeIndex neighborNext = unused;
-            bool used = false; // TODO: Merge as bit flag
+
+            uint32 dataSize() const { return dataSizeUsed & ~USED_BIT; }
+            bool used() const { return (dataSizeUsed & USED_BIT) != 0; }
+        };
+
+        // Only meaningful while a node is free and sits in a bin, kept out of the hot node data
+        struct BinLinks
+        {
+            NodeIndex binListPrev = Node::unused;
+            NodeIndex binListNext = Node::unused;
         };
 
         uint32 m_size;
         uint32 m_maxAllocs;
         uint32 m_freeStorage;
+        AllocationPolicy m_policy;
 
         uint32 m_usedBinsTop;
         uint8 m_usedBins[NUM_TOP_BINS];
         NodeIndex m_binIndices[NUM_LEAF_BINS];
+        uint32 m_binCounts[NUM_LEAF_BINS];
 
         Node* m_nodes;
-        NodeIndex* m_freeNodes;
-        uint32 m_freeOffset;
+        BinLinks* m_binLinks;
+        NodeIndex* m_freeNodes; // stack of recycled nodes
+        uint32 m_freeCount;
+        uint32 m_nextUnusedNode; // nodes from here up were not handed out since reset
+        bool m_ownsMemory;
+        uint32 m_firstNode; // node starting at offset 0, used or free
+        uint32 m_lastNode; // node ending at m_size, used or free
+        uint32 m_defragNode; // free node defragment() resumes from, unused = start over
+
+        uint32 m_allocationCount;
+        uint32 m_peakAllocationCount;
+        uint32 m_peakUsedSize;
+        uint32 m_peakNodeCount;
+        uint32 m_failedAllocations;
     };
 }
 
@@ -0,0 +1,184 @@
+// Allocate/free trace recording for OffsetAllocator::Allocator, replayed by OffsetAllocatorBench
+
+#include "offsetAllocatorTrace.h"
+
+#ifdef DEBUG
+#include <assert.h>
+#define ASSERT(x) assert(x)
+#else
+#define ASSERT(x)
+#endif
+
+#include <stdio.h>
+
+namespace OffsetAllocator
+{
+    TraceRecorder::TraceRecorder() :
+        m_file(nullptr),
+        m_nodeIds(nullptr),
+        m_lastId(0),
+        m_lastCount(0),
+        m_retryId(0),
+        m_retryEnd(0),
+        m_header{}
+    {
+    }
+
+    TraceRecorder::~TraceRecorder()
+    {
+        close();
+    }
+
+    bool TraceRecorder::open(const char* path, uint32 size, uint32 maxAllocs, AllocationPolicy policy)
+    {
+        close();
+        FILE* file = fopen(path, "wb");
+        if (!file) return false;
+
+        m_header = {.magic = TraceHeader::MAGIC, .version = TraceHeader::VERSION, .size = size, .maxAllocs = maxAllocs,
+                    .policy = policy, .opCount = 0, .idCount = 0};
+        // Rewritten with the final counts on close
+        if (fwrite(&m_header, sizeof(m_header), 1, file) != 1)
+        {
+            fclose(file);
+            return false;
+        }
+
+        m_file = file;
+        m_nodeIds = new uint32[maxAllocs];
+        m_lastId = m_lastCount = m_retryId = m_retryEnd = 0;
+        return true;
+    }
+
+    void TraceRecorder::close()
+    {
+        if (!m_file) return;
+
+        FILE* file = (FILE*)m_file;
+        fseek(file, 0, SEEK_SET);
+        fwrite(&m_header, sizeof(m_header), 1, file);
+        fclose(file);
+        delete[] m_nodeIds;
+        m_file = nullptr;
+        m_nodeIds = nullptr;
+    }
+
+    void TraceRecorder::write(uint32 type, uint32 id, uint32 size)
+    {
+        TraceOp op = {.type = type, .id = id, .size = size};
+        fwrite(&op, sizeof(op), 1, (FILE*)m_file);
+        m_header.opCount++;
+    }
+
+    uint32 TraceRecorder::nextId()
+    {
+        return m_retryId < m_retryEnd ? m_retryId++ : m_header.idCount++;
+    }
+
+    uint32 TraceRecorder::allocate(Allocation allocation, uint32 size)
+    {
+        if (!m_file) return 0;
+
+        uint32 id = nextId();
+        if (allocation.metadata != NO_NODE)
+        {
+            ASSERT(allocation.metadata < m_header.maxAllocs);
+            m_nodeIds[allocation.metadata] = id;
+        }
+        write(TRACE_ALLOCATE, id, size);
+        m_lastId = id;
+        m_lastCount = 1;
+        m_retryId = m_retryEnd;
+        return id;
+    }
+
+    uint32 TraceRecorder::allocateBatch(const Allocation* allocations, const uint32* sizes, uint32 count)
+    {
+        if (!m_file) return 0;
+
+        write(TRACE_BATCH, 0, count);
+        uint32 firstId = m_retryId < m_retryEnd ? m_retryId : m_header.idCount;
+        for (uint32 i = 0; i < count; i++)
+        {
+            uint32 id = nextId();
+            if (allocations[i].metadata != NO_NODE)
+            {
+                ASSERT(allocations[i].metadata < m_header.maxAllocs);
+                m_nodeIds[allocations[i].metadata] = id;
+            }
+            write(TRACE_ALLOCATE, id, sizes[i]);
+        }
+        m_lastId = firstId;
+        m_lastCount = count;
+        m_retryId = m_retryEnd;
+        return firstId;
+    }
+
+    void TraceRecorder::free(Allocation allocation)
+    {
+        if (!m_file) return;
+
+        ASSERT(allocation.metadata < m_header.maxAllocs);
+        write(TRACE_FREE, m_nodeIds[allocation.metadata], 0);
+    }
+
+    void TraceRecorder::freeId(uint32 id)
+    {
+        if (!m_file) return;
+
+        ASSERT(id < m_header.idCount);
+        write(TRACE_FREE, id, 0);
+    }
+
+    void TraceRecorder::retry()
+    {
+        if (!m_file) return;
+
+        write(TRACE_RETRY, m_lastId, m_lastCount);
+        m_retryId = m_lastId;
+        m_retryEnd = m_lastId + m_lastCount;
+    }
+
+    void TraceRecorder::grow(uint32 newSize)
+    {
+        if (!m_file) return;
+        write(TRACE_GROW, 0, newSize);
+    }
+
+    void TraceRecorder::frame()
+    {
+        if (!m_file) return;
+        write(TRACE_FRAME, 0, 0);
+    }
+
+    bool loadTrace(const char* path, TraceHeader& header, TraceOp*& ops)
+    {
+        ops = nullptr;
+        FILE* file = fopen(path, "rb");
+        if (!file) return false;
+
+        bool valid = fread(&header, sizeof(header), 1, file) == 1 && header.magic == TraceHeader::MAGIC &&
+                     header.version == TraceHeader::VERSION;
+        if (valid)
+        {
+            ops = new TraceOp[header.opCount];
+            valid = fread(ops, sizeof(TraceOp), header.opCount, file) == header.opCount;
+        }
+        fclose(file);
+
+        // Reject unknown ops and ids past the header's count, replays index per-id arrays with them
+        for (uint32 i = 0; valid && i < header.opCount; i++)
+        {
+            const TraceOp& op = ops[i];
+            if (op.type == TRACE_RETRY) valid = op.id < header.idCount && op.size <= header.idCount - op.id;
+            else valid = op.type <= TRACE_FRAME && (op.type > TRACE_FREE || op.id < header.idCount);
+        }
+
+        if (!valid)
+        {
+            delete[] ops;
+            ops = nullptr;
+        }
+        return valid;
+    }
+}
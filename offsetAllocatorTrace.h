@@ -0,0 +1,85 @@
+// Allocate/free trace recording for OffsetAllocator::Allocator, replayed by OffsetAllocatorBench
+#pragma once
+
+#include "offsetAllocator.h"
+
+namespace OffsetAllocator
+{
+    enum TraceOpType : uint32
+    {
+        TRACE_ALLOCATE, // id, size
+        TRACE_FREE,     // id of an earlier TRACE_ALLOCATE
+        TRACE_BATCH,    // size = number of TRACE_ALLOCATE ops that follow and form one allocateBatch call
+        TRACE_GROW,     // size = new allocator size
+        TRACE_FRAME,    // end of a frame of the recording application
+        TRACE_RETRY,    // ids [id, id + size) failed and the next TRACE_ALLOCATE or TRACE_BATCH repeats that call
+                        // with the same ids, e.g. after a TRACE_GROW. Replays skip it where the first attempt succeeded
+    };
+
+    // Ids number the allocations in recording order, failed ones included. A TRACE_FREE follows
+    // for every id its owner releases, also when the allocation failed; replays skip those.
+    struct TraceOp
+    {
+        uint32 type;
+        uint32 id;
+        uint32 size;
+    };
+
+    struct TraceHeader
+    {
+        static constexpr uint32 MAGIC = 0x5254414f; // "OATR"
+        static constexpr uint32 VERSION = 2;
+
+        uint32 magic;
+        uint32 version;
+        uint32 size;      // allocator size when recording started
+        uint32 maxAllocs;
+        uint32 policy;    // AllocationPolicy of the recorded allocator
+        uint32 opCount;
+        uint32 idCount;
+    };
+
+    // Writes the calls made on one allocator to a file, starting from its empty state. Record
+    // each call after making it, with the allocations it returned.
+    class TraceRecorder
+    {
+    public:
+        TraceRecorder();
+        TraceRecorder(const TraceRecorder &other) = delete;
+        ~TraceRecorder();
+
+        void operator=(const TraceRecorder &other) = delete;
+
+        bool open(const char* path, uint32 size, uint32 maxAllocs, AllocationPolicy policy);
+        // Completes the header. Also done by the destructor.
+        void close();
+        bool isOpen() const { return m_file != nullptr; }
+
+        // Return the id of the (first) recorded allocation
+        uint32 allocate(Allocation allocation, uint32 size);
+        uint32 allocateBatch(const Allocation* allocations, const uint32* sizes, uint32 count);
+        void free(Allocation allocation);
+        // Release of an allocation by id, for ones that failed and so have no node
+        void freeId(uint32 id);
+        // The last allocate or allocateBatch failed and is about to be repeated. Record the repeat
+        // as usual, it reuses the failed call's ids.
+        void retry();
+        void grow(uint32 newSize);
+        void frame();
+
+    private:
+        void write(uint32 type, uint32 id, uint32 size);
+        uint32 nextId();
+
+        void* m_file; // FILE*
+        uint32* m_nodeIds; // allocation id by node index (Allocation::metadata)
+        uint32 m_lastId;    // first id of the last allocate or allocateBatch call
+        uint32 m_lastCount;
+        uint32 m_retryId;   // next id reused by a retried call, m_retryEnd when not retrying
+        uint32 m_retryEnd;
+        TraceHeader m_header;
+    };
+
+    // Reads a trace written by TraceRecorder. ops is allocated with new[], the caller deletes it.
+    bool loadTrace(const char* path, TraceHeader& header, TraceOp*& ops);
+}
@@ -0,0 +1,88 @@
+// Transient per-frame front end with the OffsetAllocator::Allocation interface
+
+#include "ringOffsetAllocator.h"
+
+#ifdef DEBUG
+#include <assert.h>
+#define ASSERT(x) assert(x)
+#else
+#define ASSERT(x)
+#endif
+
+namespace OffsetAllocator
+{
+    RingAllocator::RingAllocator(uint32 size, uint32 frameCount) :
+        m_size(size),
+        m_frameCount(frameCount)
+    {
+        ASSERT(size > 0);
+        ASSERT(frameCount > 0 && frameCount <= MAX_FRAMES);
+        if (m_frameCount > MAX_FRAMES) m_frameCount = MAX_FRAMES;
+        reset();
+    }
+
+    void RingAllocator::reset()
+    {
+        m_head = 0;
+        m_tail = 0;
+        for (uint32 i = 0; i < MAX_FRAMES; i++)
+            m_frameEnds[i] = 0;
+        m_currentFrame = 0;
+    }
+
+    void RingAllocator::beginFrame(uint32 frameIndex)
+    {
+        ASSERT(frameIndex < m_frameCount);
+
+        // Close the current frame, then release what the slot held. Frames end in order, so the
+        // slot's end is the oldest position still in flight unless a newer frame was released.
+        m_frameEnds[m_currentFrame] = m_head;
+        if (m_frameEnds[frameIndex] > m_tail) m_tail = m_frameEnds[frameIndex];
+        m_currentFrame = frameIndex;
+    }
+
+    Allocation RingAllocator::allocate(uint32 size, uint32 alignment)
+    {
+        ASSERT(alignment > 0);
+        if (size == 0 || size > m_size) return {};
+
+        // Nothing in flight: Start over at offset 0, the largest contiguous range
+        if (m_head == m_tail) m_head = m_tail = (m_head + m_size - 1) / m_size * m_size;
+
+        uint64 head = m_head;
+        uint32 offset = (uint32)(head % m_size);
+        uint32 padding = (alignment - offset % alignment) % alignment;
+
+        // Doesn't fit before the end of the ring? Skip the rest, offset 0 is always aligned.
+        if ((uint64)offset + padding + size > m_size)
+        {
+            head += m_size - offset;
+            offset = 0;
+            padding = 0;
+        }
+
+        uint64 end = head + padding + size;
+        if (end - m_tail > m_size) return {};
+
+        m_head = end;
+        return {.offset = offset + padding, .metadata = NO_NODE};
+    }
+
+    StorageReport RingAllocator::storageReport() const
+    {
+        uint32 used = usedSize();
+        if (used == 0) return {.totalFreeSpace = m_size, .largestFreeRegion = m_size};
+
+        // Free space is [head, tail) around the ring, split at the end of the ring
+        uint32 headOffset = (uint32)(m_head % m_size);
+        uint32 tailOffset = (uint32)(m_tail % m_size);
+        uint32 largestFreeRegion = 0;
+        if (used < m_size)
+        {
+            if (headOffset < tailOffset) largestFreeRegion = tailOffset - headOffset;
+            else largestFreeRegion = m_size - headOffset > tailOffset ? m_size - headOffset : tailOffset;
+        }
+
+        return {.totalFreeSpace = m_size - used, .largestFreeRegion = largestFreeRegion};
+    }
+}
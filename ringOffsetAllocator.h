@@ -0,0 +1,47 @@
+// Transient per-frame front end with the OffsetAllocator::Allocation interface
+#pragma once
+
+#include "offsetAllocator.h"
+
+namespace OffsetAllocator
+{
+    typedef unsigned long long uint64;
+
+    // Linear allocator over a ring of size bytes for data that lives for a fixed number of frames.
+    // Allocations are never freed one by one: beginFrame(frameIndex) releases everything that was
+    // allocated the last time frameIndex began, so the caller must know the GPU is done with it,
+    // typically by waiting for the fence that frame signalled. No nodes, no bins, no fragmentation.
+    //
+    // Allocations are contiguous and never wrap: a request that does not fit before the end of
+    // the ring skips the rest and starts over at offset 0, the skipped bytes are released with
+    // the frame. Allocation::metadata is always NO_NODE.
+    class RingAllocator
+    {
+    public:
+        static constexpr uint32 MAX_FRAMES = 8;
+
+        RingAllocator(uint32 size, uint32 frameCount);
+
+        // frameIndex < frameCount, normally the frame ring index cycling 0, 1, .., frameCount - 1.
+        void beginFrame(uint32 frameIndex);
+        // Offset is a multiple of alignment (any non-zero value). NO_SPACE if the frames in
+        // flight leave no room, nothing is changed then.
+        Allocation allocate(uint32 size, uint32 alignment = 1);
+        // Releases every frame, only safe once the GPU is idle
+        void reset();
+
+        uint32 size() const { return m_size; }
+        // Bytes held by frames in flight, including the current one
+        uint32 usedSize() const { return (uint32)(m_head - m_tail); }
+        StorageReport storageReport() const;
+
+    private:
+        // Monotonic byte positions, the ring offset is position % m_size
+        uint64 m_head;
+        uint64 m_tail;
+        uint64 m_frameEnds[MAX_FRAMES]; // m_head when the frame in the slot ended
+        uint32 m_size;
+        uint32 m_frameCount;
+        uint32 m_currentFrame;
+    };
+}